@@ -0,0 +1,89 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stddef.h>
+#include <memory_resource>
+#include "jsoncpp.h"
+
+using namespace std;
+
+namespace minibar{
+
+// Monotonic allocator: allocation is a pointer bump, nothing is freed until
+// reset().  reset() keeps one chunk, grown to fit the largest reset so far,
+// so a steady stream of similar requests stops calling malloc altogether.
+class Arena: public std::pmr::memory_resource{
+    struct Chunk{
+        Chunk* next;
+        size_t size;
+    };
+
+    Chunk* chunks;          // most recent first
+    char* pos;
+    char* end;
+    size_t chunkSize;
+    size_t maxRetained;     // largest chunk kept across reset()
+    size_t usedBefore;      // bytes allocated from chunks other than the current one
+
+    void addChunk(size_t minSize);
+    void freeChunks();
+
+protected:
+    virtual void* do_allocate(size_t bytes,size_t alignment);
+    virtual void do_deallocate(void* ptr,size_t bytes,size_t alignment);
+    virtual bool do_is_equal(const std::pmr::memory_resource& other) const noexcept;
+
+public:
+    Arena(size_t chunkSize = 16384,size_t maxRetained = 1 << 20);
+    ~Arena();
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // bytes handed out since the last reset()
+    size_t bytesUsed() const;
+
+    void reset();
+};
+
+// Arena for the request being handled on this thread.  Memory from it must
+// not outlive the request: it is reset when processRequest returns.
+Arena& getRequestArena();
+
+// resets the request arena when it goes out of scope, recording how much of
+// it the request used
+struct RequestArenaScope{
+    ~RequestArenaScope();
+};
+
+// request arena usage across all threads, reported by the "stats" action
+Json::Value getArenaStats();
+
+}
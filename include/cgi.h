@@ -29,15 +29,66 @@ either expressed or implied, of the FreeBSD Project.
 */
 
 #include "jsoncpp.h"
+#include <memory_resource>
+#include <string>
+#include <string_view>
+#include <vector>
 
 namespace minibar{
 
 extern const char* STATUS_200;
 extern const char* STATUS_400;
 extern const char* STATUS_401;
+extern const char* STATUS_404;
 extern const char* STATUS_405;
 extern const char* STATUS_500;
 
-Json::Value parseQueryString(std::string);
+// Decoded query string.  Keys and values are views into the buffer passed
+// to parse(); if any of them contain '%' or '+' escapes, the query is copied
+// once and those pairs are decoded in place in the copy.  Nothing else is
+// allocated unless there are more than INLINE_PAIRS pairs.
+class QueryString{
+public:
+    struct Pair{
+        std::string_view key;
+        std::string_view value;
+        bool hasValue;          // false for a bare "key" with no '='
+    };
+
+private:
+    enum{
+        INLINE_PAIRS = 16
+    };
+    Pair inlinePairs[INLINE_PAIRS];
+    std::pmr::vector<Pair> overflow;
+    size_t count;
+    std::string_view source;
+    std::pmr::string storage;   // decoded copy, only used when needed
+
+    void addPair(const char* start,const char* equals,const char* end,bool escaped);
+
+public:
+    // 'resource' backs the decoded copy and any pairs past INLINE_PAIRS
+    QueryString(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // 'query' must outlive this object
+    void parse(std::string_view query);
+
+    size_t size() const{
+        return count;
+    }
+    const Pair& operator[](size_t index) const{
+        return index < INLINE_PAIRS ? inlinePairs[index] : overflow[index - INLINE_PAIRS];
+    }
+
+    // JSON for 'key': a string, null for a bare key, or an array when the key
+    // is repeated.  Returns false if the key is not present.
+    bool get(std::string_view key,Json::Value& result) const;
+
+    // every key, as get() would return it
+    Json::Value toJson() const;
+};
+
+Json::Value parseQueryString(std::string_view query);
 
 }
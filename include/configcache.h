@@ -0,0 +1,104 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdint.h>
+#include <pthread.h>
+#include <sys/types.h>
+#include <time.h>
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "configure.h"
+
+using namespace std;
+
+namespace minibar{
+
+// Compiled configs by filename.  Files are polled for changes by a watcher
+// thread; a changed file is compiled on that thread and published with an
+// atomic swap, so requests never wait on a reload.  Requests already running
+// keep the Config they started with, and a config that fails to compile
+// leaves the previous one in place.
+class ConfigCache{
+    struct FileStamp{
+        dev_t device;
+        ino_t inode;
+        off_t size;
+        struct timespec modified;
+
+        bool operator==(const FileStamp& other) const;
+    };
+
+    struct Entry{
+        std::string filename;
+        FileStamp stamp;
+        std::shared_ptr<Config> config;         // atomic_load/atomic_store only
+        std::atomic<uint64_t> generation;
+        std::vector<std::shared_ptr<Config>> retired;
+    };
+
+    uint64_t id;
+    int pollMillis;
+    std::map<std::string,std::unique_ptr<Entry>,std::less<>> entries;
+    pthread_mutex_t mutex;          // guards entries and the watcher state
+    pthread_mutex_t reloadMutex;    // serializes checkForChanges
+    pthread_cond_t wakeup;
+    pthread_t watcher;
+    bool watcherStarted;
+    bool stopping;
+
+    static bool statFile(const std::string& filename,FileStamp& stamp);
+    static std::shared_ptr<Config> compile(const std::string& filename);
+    static void* watcherMain(void* arg);
+
+    Entry* getEntry(std::string_view filename);
+
+public:
+    // 'pollMillis' of 0 disables the watcher thread; call checkForChanges() instead
+    ConfigCache(int pollMillis = 1000);
+    ~ConfigCache();
+
+    // The returned Config stays valid until this thread calls getConfig()
+    // again for the same file, even if it is reloaded in the meantime.
+    // Lock free once the file has been loaded by any thread.
+    Config* getConfig(std::string_view filename);
+
+    // stats every loaded file and recompiles the ones that changed; returns
+    // the number of configs replaced
+    int checkForChanges();
+
+    // number of times 'filename' has been replaced since it was first loaded
+    uint64_t getGeneration(std::string_view filename);
+};
+
+}
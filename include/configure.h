@@ -31,6 +31,8 @@ either expressed or implied, of the FreeBSD Project.
 #include "router.h"
 #include "database.h"
 #include "jsoncpp.h"
+#include "param.h"
+#include "resultcache.h"
 #include <map>
 #include <functional>
 
@@ -42,6 +44,7 @@ struct QueryParameter{
     string name;
     string path;
     Json::Value defaultValue;
+    bool hasDefault;
     Json::ValueType type;
     string validation;
 
@@ -51,13 +54,23 @@ struct QueryParameter{
 
 class Config;
 
+// no route matches a request; answered with 404 rather than as a failure
+struct UnknownRouteException: public MinibarException{
+    UnknownRouteException(std::string text): MinibarException(text){}
+};
+
 struct RestNode{
     std::string path;
     std::string specialAction;
     std::string databaseName;
     Database* database;
     vector<QueryParameter> parameters;
+    vector<ParamBinding> bindings;      // 'parameters', compiled
+    JsonProjection requestFields;       // request body paths 'bindings' use
     string query;
+    bool stream;
+    bool cached;        // responses kept in the config's ResultCache
+    int cacheTtl;       // seconds; 0 = until the data changes
 
     RestNode();
     RestNode(Config* config,const std::string& path,const Json::Value& root);
@@ -69,22 +82,25 @@ struct RestNode{
 class Config{
     bool debugMode;
     Json::Value root;
-    RouteNode router;
+    RouteTable router;
     vector<RestNode*> routes;
     map<std::string,Database*> databases;
+    ResultCache resultCache;
     
 public:
     Config();
     ~Config();
 
     void clear();
-    Json::Value getRoot();
+    const Json::Value& getRoot();
     void loadConfig(string filename);
 
     Database* getDatabase(string name);
-    RestNode* getRestNode(string path,Json::Value& pathValues);
+    ResultCache& getResultCache();
+    RestNode* getRestNode(std::string_view path,Json::Value& pathValues);
 
     Json::Value toJson();
+    Json::Value getStats();
 };
 
 }
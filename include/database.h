@@ -29,6 +29,9 @@ either expressed or implied, of the FreeBSD Project.
 */
 
 #include "jsoncpp.h"
+#include "jsonstream.h"
+#include "utils.h"
+#include <stdint.h>
 #include <string>
 #include <map>
 #include <functional>
@@ -39,11 +42,28 @@ namespace minibar {
 
 class Connection {
 public:
+    virtual ~Connection(){}
+
     virtual void prepare(std::string query) = 0;
-    virtual void bind(Json::Value value) = 0;
-    virtual void bind(std::string name,Json::Value value) = 0;
+    virtual void bind(const Json::Value& value) = 0;
+    virtual void bind(const std::string& name,const Json::Value& value) = 0;
     virtual Json::Value execute() = 0;
     virtual void close() = 0; 
+
+    // index of a named parameter in the prepared query, for bind(int,...);
+    // 0 if the query has no such parameter, or -1 if the driver can only
+    // bind by name
+    virtual int getParameterIndex(const std::string& name){
+        return -1;
+    }
+    virtual void bind(int index,const Json::Value& value){
+        throw MinibarException("Connection does not support binding by index");
+    }
+
+    // serializes the result rows to 'writer' as they are produced
+    virtual void executeStream(JsonStreamWriter& writer){
+        writer.value(execute());
+    }
 };
 
 class Database{
@@ -54,9 +74,50 @@ public:
 
     static bool registerDb(std::string name,CreateFn fn){
         registry[name] = fn;
+        return true;
     }
     
+    virtual ~Database(){}
+
     virtual Connection* getConnection() = 0;
+
+    // returns a connection obtained from getConnection()
+    virtual void releaseConnection(Connection* con){
+        delete con;
+    }
+
+    // runtime counters, reported by the "stats" special action
+    virtual Json::Value getStats(){
+        return Json::Value(Json::objectValue);
+    }
+
+    // Result caching: the data version is a counter that changes whenever
+    // the data may have changed, in this process or another.  Routes on a
+    // database that can't track changes can't be cached.
+    virtual bool tracksChanges(){
+        return false;
+    }
+    virtual uint64_t getDataVersion(){
+        return 0;
+    }
+};
+
+// scoped connection checkout - closes and releases the connection on exit
+struct RAIIConnection{
+    Database* database;
+    Connection* con;
+
+    RAIIConnection(Database* database){
+        this->database = database;
+        this->con = database->getConnection();
+    }
+    ~RAIIConnection(){
+        con->close();
+        database->releaseConnection(con);
+    }
+    Connection* operator->(){
+        return con;
+    }
 };
 
 
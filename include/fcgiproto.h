@@ -0,0 +1,187 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+
+using namespace std;
+
+namespace minibar{
+
+// FastCGI 1.0 wire protocol: record layout, constants and encoders
+
+namespace fcgi{
+
+enum{
+    VERSION_1 = 1,
+    HEADER_LENGTH = 8,
+    MAX_CONTENT_LENGTH = 65535,
+    NULL_REQUEST_ID = 0,
+    // largest PARAMS stream accepted; requests past it are refused with 431
+    MAX_PARAMS_LENGTH = 65536,
+    // default for the largest STDIN stream; requests past it get 413
+    DEFAULT_MAX_BODY_LENGTH = 1024 * 1024
+};
+
+enum RecordType{
+    BEGIN_REQUEST = 1,
+    ABORT_REQUEST = 2,
+    END_REQUEST = 3,
+    PARAMS = 4,
+    STDIN = 5,
+    STDOUT = 6,
+    STDERR = 7,
+    DATA = 8,
+    GET_VALUES = 9,
+    GET_VALUES_RESULT = 10,
+    UNKNOWN_TYPE = 11
+};
+
+enum Role{
+    RESPONDER = 1,
+    AUTHORIZER = 2,
+    FILTER = 3
+};
+
+// BEGIN_REQUEST flags
+enum{
+    KEEP_CONN = 1
+};
+
+// END_REQUEST protocol status
+enum ProtocolStatus{
+    REQUEST_COMPLETE = 0,
+    CANT_MPX_CONN = 1,
+    OVERLOADED = 2,
+    UNKNOWN_ROLE = 3
+};
+
+struct Header{
+    int version;
+    int type;
+    int requestId;
+    int contentLength;
+    int paddingLength;
+};
+
+// decodes a record header from HEADER_LENGTH bytes
+Header parseHeader(const unsigned char* data);
+
+// appends a record header
+void appendHeader(std::string& out,int type,int requestId,int contentLength,int paddingLength = 0);
+
+// appends 'content' as records of 'type', split at MAX_CONTENT_LENGTH; empty
+// content appends a single empty record, which ends a stream
+void appendStream(std::string& out,int type,int requestId,std::string_view content);
+
+void appendBeginRequest(std::string& out,int requestId,int role,int flags);
+void appendEndRequest(std::string& out,int requestId,uint32_t appStatus,int protocolStatus);
+
+// appends a name-value pair in PARAMS encoding
+void appendNameValue(std::string& out,std::string_view name,std::string_view value);
+
+// decodes one name-value pair from [pos,end) and advances pos; returns false
+// if the pair is truncated
+bool readNameValue(const char*& pos,const char* end,std::string_view& name,std::string_view& value);
+
+// the request parameters minibar uses, picked out in one pass over PARAMS
+enum Param{
+    PARAM_SCRIPT_FILENAME,
+    PARAM_REQUEST_METHOD,
+    PARAM_PATH_INFO,
+    PARAM_QUERY_STRING,
+    PARAM_COUNT
+};
+
+// A request on a ServerConnection, filled in as its records arrive
+struct ServerRequest{
+    int id;
+    bool keepConn;
+    bool paramsDone;
+    bool stdinDone;
+    bool aborted;               // ABORT_REQUEST arrived after it was handed out
+    std::string params;         // the PARAMS stream
+    std::string body;           // the STDIN stream
+    std::string_view values[PARAM_COUNT];   // into 'params', once paramsDone
+
+    std::string_view getParam(Param param){
+        return values[param];
+    }
+};
+
+// The application side of one FastCGI connection.  Records may be split
+// anywhere and may interleave any number of requests.  A request is handed
+// out once both its PARAMS and STDIN streams have ended; management records,
+// aborts and requests that can't be served are answered directly.
+class ServerConnection{
+    // indexed by request id; slots are kept for reuse
+    std::vector<std::unique_ptr<ServerRequest>> requests;
+    int activeCount;
+    int maxConnections;
+    int maxRequests;
+    size_t maxBodyLength;
+    bool closeRequested;
+
+    bool handleRecord(const Header& header,const char* content,std::string& out,
+        std::vector<ServerRequest*>& ready);
+    void refuse(ServerRequest* request,const char* status,std::string& out);
+    void release(ServerRequest* request);
+
+public:
+    // the first two limits are advertised as FCGI_MAX_CONNS and FCGI_MAX_REQS
+    ServerConnection(int maxConnections,int maxRequests,size_t maxBodyLength = DEFAULT_MAX_BODY_LENGTH);
+
+    // Decodes the complete records at the start of [data,data+length) and
+    // returns the number of bytes used, or -1 on a protocol error.  Replies
+    // are appended to 'out' and requests that became ready to 'ready'.
+    long consume(const char* data,size_t length,std::string& out,std::vector<ServerRequest*>& ready);
+
+    // appends the END_REQUEST for a request handed out by consume(), and
+    // releases it
+    void finish(ServerRequest* request,std::string& out);
+
+    // requests begun and not yet finished
+    int getActiveCount(){
+        return activeCount;
+    }
+
+    // true once a request without KEEP_CONN was aborted or refused by
+    // consume(), so the connection is to be closed after the replies
+    bool isCloseRequested(){
+        return closeRequested;
+    }
+};
+
+}
+
+}
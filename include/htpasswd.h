@@ -66,8 +66,8 @@ public:
     ~HtPasswdDbConnection();
     
     virtual void prepare(string query);
-    virtual void bind(Json::Value value);
-    virtual void bind(string name,Json::Value value);
+    virtual void bind(const Json::Value& value);
+    virtual void bind(const string& name,const Json::Value& value);
     virtual Json::Value execute();
     virtual void close();
 };
@@ -0,0 +1,96 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stddef.h>
+#include <string>
+#include <string_view>
+
+using namespace std;
+
+namespace minibar{
+
+// HTTP/1.1 wire protocol: request head parsing and response framing
+
+namespace http{
+
+enum{
+    // request line and headers, including the blank line
+    MAX_HEAD_LENGTH = 16384
+};
+
+enum ParseResult{
+    PARSE_INCOMPLETE,
+    PARSE_COMPLETE,
+    PARSE_ERROR
+};
+
+// A parsed request head.  The views point into the buffer that was parsed.
+struct Request{
+    std::string_view method;
+    std::string_view path;      // target up to '?', still escaped
+    std::string_view query;     // after '?', empty if none
+    int minorVersion;           // 1 for HTTP/1.1, 0 for HTTP/1.0
+    size_t headLength;          // bytes up to and including the blank line
+    size_t contentLength;
+    bool chunked;               // Transfer-Encoding: chunked
+    bool keepAlive;             // from the version and Connection header
+    bool expectContinue;        // Expect: 100-continue
+    int errorStatus;            // status to reply with on PARSE_ERROR
+};
+
+// Parses the request line and headers at the start of 'data'.  Returns
+// PARSE_INCOMPLETE until the blank line ending the head has arrived.
+ParseResult parseRequestHead(std::string_view data,Request& request);
+
+// appends 'path' with %XX escapes decoded; returns false if an escape is
+// malformed or decodes to a NUL
+bool decodePath(std::string_view path,std::string& out);
+
+// the reason phrase for a status code
+const char* reasonPhrase(int status);
+
+// Length of the CGI style head ("Status: 200 OK\r\n...\r\n\r\n") at the
+// start of 'data', as written by processRequest(), or 0 if it isn't complete.
+size_t findCgiHeadEnd(std::string_view data);
+
+// Appends an HTTP/1.1 status line and headers converted from a CGI head.
+// 'contentLength' of -1 selects chunked encoding.
+void appendResponseHead(std::string& out,std::string_view cgiHead,long contentLength,bool keepAlive);
+
+// appends a complete response with a plain text body
+void appendTextResponse(std::string& out,int status,std::string_view body,bool keepAlive);
+
+// chunked encoding; an empty chunk is skipped, as it would end the body
+void appendChunk(std::string& out,std::string_view data);
+void appendLastChunk(std::string& out);
+
+}
+
+}
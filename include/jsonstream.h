@@ -0,0 +1,99 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdint.h>
+#include <string>
+#include <string_view>
+#include <functional>
+#include <memory_resource>
+#include "jsoncpp.h"
+
+using namespace std;
+
+namespace minibar{
+
+// destination for serialized output
+typedef std::function<void(const char* data,size_t length)> WriteFn;
+
+// appends 'str' to 'out' as a quoted JSON string
+void appendJsonString(std::string& out,std::string_view str);
+void appendJsonString(std::pmr::string& out,std::string_view str);
+
+// Compact JSON writer that serializes values as they are produced and hands
+// the output to a sink in chunks of roughly 'flushSize' bytes.  Output still
+// buffered when the writer is destroyed is discarded; call flush() to send it.
+class JsonStreamWriter{
+    WriteFn sink;
+    std::pmr::string buffer;
+    size_t flushSize;
+    bool needComma;
+
+    void separate(){
+        if(needComma){
+            buffer += ',';
+        }
+        needComma = true;
+    }
+    void checkFlush(){
+        if(buffer.length() >= flushSize){
+            flush();
+        }
+    }
+
+public:
+    // 'resource' backs the output buffer
+    JsonStreamWriter(WriteFn sink,size_t flushSize = 4096,
+        std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // bytes written verbatim, outside of any JSON structure
+    void writeRaw(std::string_view data);
+
+    void beginArray();
+    void endArray();
+    void beginObject();
+    void endObject();
+
+    // object member name
+    void key(std::string_view name);
+    // object member name already quoted and followed by ':'
+    void escapedKey(std::string_view quotedKey);
+
+    void nullValue();
+    void boolValue(bool value);
+    void intValue(int64_t value);
+    void uintValue(uint64_t value);
+    void realValue(double value);
+    void stringValue(std::string_view value);
+    void value(const Json::Value& value);
+
+    void flush();
+};
+
+}
@@ -0,0 +1,154 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory_resource>
+#include "jsoncpp.h"
+#include "utils.h"
+
+using namespace std;
+
+namespace minibar{
+
+// The parts of a document a JsonTape parse should keep, as a tree of paths.
+// Members and elements off every path are still validated, but leave nothing
+// on the tape and their strings are not decoded.
+class JsonProjection{
+public:
+    struct Node{
+        std::string term;       // member name, or array index
+        size_t index;           // 'term' as an array index, or JsonTape::NOT_FOUND
+        bool all;               // keep everything below this node
+        size_t limit;           // one past the highest index in 'children'
+        std::vector<Node> children;
+
+        Node(std::string_view term);
+
+        // the selected member 'key', or element 'n', or NULL
+        const Node* child(std::string_view key) const;
+        const Node* element(size_t n) const;
+    };
+
+private:
+    Node root;
+
+public:
+    // selects nothing but the top level value
+    JsonProjection();
+
+    // keeps the value at path[start], path[start+1], ...; a path with
+    // nothing past 'start' keeps the whole document
+    void add(const TokenSet& path,size_t start = 0);
+
+    const Node& getRoot() const{
+        return root;
+    }
+};
+
+// In-situ JSON parser.  The document is parsed into a flat "tape" with one
+// entry per value, in document order, and strings are unescaped in place
+// inside the input buffer, so parsing allocates nothing but the tape.
+// Values are addressed by tape index; the root is at index 0.
+class JsonTape{
+public:
+    enum Type{
+        NULL_VALUE,
+        FALSE_VALUE,
+        TRUE_VALUE,
+        INT_VALUE,
+        UINT_VALUE,
+        REAL_VALUE,
+        STRING_VALUE,
+        ARRAY_VALUE,
+        OBJECT_VALUE
+    };
+
+    // objects are followed by key/value entry pairs, arrays by their elements
+    struct Entry{
+        uint8_t type;
+        uint32_t size;      // string length, or number of elements/members
+        uint32_t next;      // index just past this value and its children
+        union{
+            const char* string;
+            int64_t intValue;
+            uint64_t uintValue;
+            double realValue;
+        };
+    };
+
+    static constexpr size_t NOT_FOUND = (size_t)-1;
+
+private:
+    std::pmr::vector<Entry> tape;
+
+public:
+    // 'resource' backs the tape
+    JsonTape(std::pmr::memory_resource* resource = std::pmr::get_default_resource());
+
+    // Parses 'length' bytes at 'data', rewriting strings in place; the tape
+    // refers into 'data' afterwards.  Strings are checked to be valid UTF-8
+    // if 'validateUtf8' is set.  With a 'projection', only the values it
+    // selects are kept; unselected array elements before a selected one are
+    // kept as nulls, so indexes don't shift.  Throws MinibarException on
+    // malformed input, including in skipped values.
+    void parse(char* data,size_t length,bool validateUtf8 = true,
+        const JsonProjection* projection = NULL);
+
+    const Entry& operator[](size_t index) const{
+        return tape[index];
+    }
+    size_t size() const{
+        return tape.size();
+    }
+
+    std::string_view getString(size_t index) const{
+        return std::string_view(tape[index].string,tape[index].size);
+    }
+
+    // the last member called 'key' of the object at 'index' (as jsoncpp
+    // keeps the last of repeated keys), or NOT_FOUND
+    size_t find(size_t index,std::string_view key) const;
+
+    // element 'n' of the array at 'index', or NOT_FOUND
+    size_t element(size_t index,size_t n) const;
+
+    // as JsonChild(): an object member, or an array element if 'term' is a
+    // decimal index; NOT_FOUND if missing, null, or 'index' isn't a container
+    size_t child(size_t index,std::string_view term) const;
+
+    // copies the value at 'index' into a Json::Value
+    Json::Value toJson(size_t index) const;
+};
+
+}
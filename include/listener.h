@@ -0,0 +1,69 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string>
+#include <vector>
+
+namespace minibar{
+
+// Listening sockets for the frontends.  Sockets are non-blocking and
+// close-on-exec.  On failure the error is printed to stderr and -1 returned.
+
+// Binds the first address 'host' resolves to; an empty host listens on all.
+// With 'reusePort' several sockets can be bound to the same address, and
+// the kernel spreads incoming connections across them (SO_REUSEPORT).
+int listenTcp(const std::string& host,const std::string& port,bool reusePort = false);
+
+// replaces any file already at 'path'
+int listenUnix(const std::string& path);
+
+// Listening sockets are handed from a running process to its replacement
+// over a Unix domain socket at a path both are given.  The old process
+// listens there; the new one connects, receives the sockets with
+// SCM_RIGHTS and acknowledges them, after which the old one can stop
+// accepting.  Connections queued on the sockets are never dropped, since
+// the sockets stay open throughout.
+
+// listens on 'path' for a replacement process; only the same user may
+// connect
+int listenHandoff(const std::string& path);
+
+// accepts a replacement on 'handoffFd' and passes it 'listeners'; true
+// once the replacement has acknowledged them
+bool handOffListeners(int handoffFd,const std::vector<int>& listeners);
+
+// takes the listening sockets from a process listening on 'path', adding
+// them to 'listeners'; false if there is none or the handoff fails
+bool takeOverListeners(const std::string& path,std::vector<int>& listeners);
+
+// splits "host:port" or "[v6 address]:port"; false if there is no port
+bool parseListenAddress(const std::string& address,std::string& host,std::string& port);
+
+}
@@ -30,33 +30,55 @@ either expressed or implied, of the FreeBSD Project.
 
 #include "jsoncpp.h"
 #include <string>
+#include <string_view>
 #include <exception>
 
 using namespace std;
 
 namespace minibar{
 
-// externs for frontend - to be defined elsewhere
+// Frontend interface for a single request.  Each frontend implements one of
+// these per in-flight request; the views it hands out must remain valid until
+// the request completes.
 
-extern void logPrint(const char* format,...);
-extern void logString(std::string str);
-extern void writeString(std::string str);
-extern std::string getConfigFilename();
-extern std::string getRequestContent();
-extern std::string getQueryString();
-extern std::string getRestTarget();
-extern void logException(const std::exception& ex);
-extern void logException(const std::string& ex);
+class RequestContext{
+public:
+    virtual ~RequestContext(){}
+
+    virtual void write(const char* data,size_t length) = 0;
+    virtual void log(const char* data,size_t length) = 0;
+    virtual std::string_view getConfigFilename() = 0;
+    virtual std::string_view getRequestContent() = 0;
+    virtual std::string_view getQueryString() = 0;
+    virtual std::string_view getRestTarget() = 0;
+    virtual void logException(std::string_view msg) = 0;
+
+    // The request body in a buffer that can be modified in place, as the
+    // JSON parser does; getRequestContent() may return the modified data
+    // afterwards.  By default the body is copied into the request arena.
+    virtual char* getMutableRequestContent(size_t& length);
+
+    void writeString(std::string_view str){
+        write(str.data(),str.length());
+    }
+    void logString(std::string_view str){
+        log(str.data(),str.length());
+    }
+    void logPrint(const char* format,...);
+    void logException(const std::exception& ex){
+        logException(std::string_view(ex.what()));
+    }
+};
 
 // prototypes
 
-void processRequest();
+void processRequest(RequestContext& ctx);
 
 
 #ifdef DEBUG
-#define debugPrint(...) logPrint(__VA_ARGS__)
+#define debugPrint(ctx,...) (ctx).logPrint(__VA_ARGS__)
 #else
-#define debugPrint(...)
+#define debugPrint(ctx,...)
 #endif
 
 }
@@ -28,7 +28,121 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the FreeBSD Project.
 */
 
+#include <atomic>
+#include <string>
+#include <string_view>
+#include <vector>
+#include "jsoncpp.h"
+#include "minibar.h"
+#include "database.h"
+#include "cgi.h"
+#include "jsontape.h"
+#include "utils.h"
 
-struct param{
+using namespace std;
 
+namespace minibar{
+
+struct QueryParameter;
+
+// top level values a parameter path can start from
+enum ParamSource{
+    SOURCE_NONE,
+    SOURCE_CONF,
+    SOURCE_PATH,
+    SOURCE_REQUEST,
+    SOURCE_QUERY
+};
+
+ParamSource getParamSource(std::string_view name);
+
+// converts 'value' to a scalar 'type', as named by a parameter's "type";
+// null stays null.  Throws MinibarException if the value doesn't convert.
+Json::Value coerceValue(const Json::Value& value,Json::ValueType type);
+
+// Values visible to QueryParameter paths: 'conf', 'path', 'request' and
+// 'query'.  The request body and query string are only parsed the first time
+// a parameter refers to them, and the config tree is referenced, not copied.
+class ParamContext{
+    RequestContext& ctx;
+    const Json::Value& conf;
+    const Json::Value& path;
+    Json::Value request;
+    Json::Value query;
+    JsonTape requestTape;
+    const JsonProjection* requestProjection;
+    QueryString queryString;
+    bool requestTapeParsed;
+    bool requestParsed;
+    bool queryStringParsed;
+    bool queryParsed;
+
+    const QueryString& getQueryString();
+
+public:
+    // if 'requestProjection' is set, only the parts of the request body it
+    // selects are parsed, and 'request' holds nothing else
+    ParamContext(RequestContext& ctx,const Json::Value& conf,const Json::Value& path,
+        const JsonProjection* requestProjection = NULL);
+
+    // the top level value called 'name', or null if there is none
+    const Json::Value& getRoot(std::string_view name);
+    const Json::Value& getRoot(ParamSource source);
+
+    // the request body, parsed in place; values are only converted to
+    // Json::Value as parameters ask for them
+    const JsonTape& getRequestTape();
+
+    // a single query string value, without building the whole 'query'
+    // object; returns false if the key is not present
+    bool getQueryValue(std::string_view key,Json::Value& result);
+
+    // evaluates a path such as "request.user.name" or "request.items[0]";
+    // the result refers into the context
+    const Json::Value& resolve(const std::string& path);
+    const Json::Value& resolve(const TokenSet& path);
 };
+
+// A QueryParameter compiled at config load: the path is split and its source
+// resolved, the default is converted to the parameter type, and the position
+// or bind index is worked out once, so binding does no parsing or name
+// lookups per request.
+class ParamBinding{
+    std::string name;           // empty for positional parameters
+    ParamSource source;
+    TokenSet path;              // full path, including the source
+    Json::ValueType type;
+    bool hasDefault;
+    Json::Value defaultValue;
+
+    // index from Connection::getParameterIndex(), shared by every connection
+    // to the database; UNRESOLVED until the first request
+    mutable std::atomic<int> bindIndex;
+
+    enum{
+        UNRESOLVED = -2
+    };
+
+public:
+    ParamBinding(const QueryParameter& param);
+    ParamBinding(const ParamBinding& other);
+
+    // the parameter value for this request; returns a reference into the
+    // context where possible, otherwise into 'scratch'
+    const Json::Value& evaluate(ParamContext& context,Json::Value& scratch) const;
+
+    // evaluates the parameter and binds it to the prepared query on 'con'
+    void bind(ParamContext& context,Connection* con) const;
+
+    // binds a value already found with evaluate()
+    void bindValue(Connection* con,const Json::Value& value) const;
+
+    ParamSource getSource() const{
+        return source;
+    }
+    const TokenSet& getPath() const{
+        return path;
+    }
+};
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdint.h>
+#include <pthread.h>
+
+#include <string>
+#include <string_view>
+#include <list>
+#include <memory>
+#include <unordered_map>
+
+#include "jsoncpp.h"
+
+using namespace std;
+
+namespace minibar{
+
+// Serialized responses of routes that opt in with "cache", keyed by route
+// and parameter values.  An entry is only served while its database reports
+// the data version it was built from and its TTL hasn't passed; the least
+// recently used entries are evicted to keep under 'maxBytes'.
+class ResultCache{
+    struct Entry{
+        std::string key;
+        std::shared_ptr<const std::string> response;
+        uint64_t dataVersion;
+        int64_t expires;        // CLOCK_MONOTONIC ms; 0 = never
+        size_t size;            // bytes charged against maxBytes
+    };
+    typedef std::list<Entry> EntryList;
+
+    pthread_mutex_t mutex;
+    EntryList entries;          // most recently used first
+    std::unordered_map<std::string_view,EntryList::iterator> index;
+    size_t maxBytes;
+    size_t bytes;
+
+    unsigned long hits;
+    unsigned long misses;
+    unsigned long invalidated;  // found, but the data has changed since
+    unsigned long expired;      // found, but past the TTL
+    unsigned long evictions;    // dropped to make room
+
+    void remove(EntryList::iterator it);
+
+public:
+    ResultCache(size_t maxBytes = 16 * 1024 * 1024);
+    ~ResultCache();
+
+    // total bytes kept; entries over a quarter of this aren't cached
+    void setMaxBytes(size_t maxBytes);
+    size_t getMaxEntryBytes();
+
+    // the response stored under 'key', if it was built from 'dataVersion'
+    // and hasn't expired; NULL otherwise
+    std::shared_ptr<const std::string> get(const std::string& key,uint64_t dataVersion);
+
+    // stores 'response', built from 'dataVersion', for 'ttl' seconds (0 for
+    // no limit)
+    void put(const std::string& key,std::string&& response,uint64_t dataVersion,int ttl);
+
+    void clear();
+    Json::Value getStats();
+};
+
+}
@@ -29,7 +29,9 @@ either expressed or implied, of the FreeBSD Project.
 */
 
 
+#include <stdint.h>
 #include <string>
+#include <string_view>
 #include <vector>
 #include "json/json.h"
 #include "utils.h"
@@ -42,6 +44,7 @@ struct RouteException: public MinibarException{
     RouteException(const char* msg): MinibarException(msg){}
 };
 
+// linked trie of route tokens; superseded by RouteTable for request routing
 struct RouteNode {
     enum{
         NO_ROUTE_MATCH = -1
@@ -63,8 +66,62 @@ struct RouteNode {
 };
 
 
-#ifdef UNITTEST
-void routerUnittest();
-#endif
+// Route table compiled from "METHOD/segment/..." patterns.  Segments are
+// literal text, ':name' (captures the segment) or '*' (matches any segment).
+// Nodes live in one flat array with literal edges in a shared hash table, and
+// matching splits the target into views on the stack, so a lookup performs
+// no heap allocations.  At each level literal segments are tried first, then
+// ':name', then '*', backtracking when a branch fails.
+class RouteTable{
+public:
+    enum{
+        NO_ROUTE_MATCH = -1,
+        MAX_SEGMENTS = 32,
+        MAX_PARAMS = 16
+    };
+
+    struct Match{
+        int id;
+        int paramCount;
+        std::string_view params[MAX_PARAMS];  // ':name' segments, in route order
+    };
+
+private:
+    struct Node{
+        int matchId;
+        int paramChild;
+        int wildcardChild;
+    };
+
+    struct Edge{
+        uint64_t hash;
+        int parent;
+        int child;
+        uint32_t offset;    // segment text in 'segments'
+        uint32_t length;
+    };
+
+    vector<Node> nodes;
+    vector<Edge> edges;     // open addressing; size is a power of two
+    size_t edgeCount;
+    string segments;
+    vector<vector<string>> paramNames;
+
+    int newNode();
+    int findEdge(int parent,std::string_view segment,uint64_t hash) const;
+    void insertEdge(int parent,int child,std::string_view segment,uint64_t hash);
+    void growEdges();
+    bool match(int node,const std::string_view* segs,int count,Match& result) const;
+
+public:
+    RouteTable();
+
+    void clear();
+    void addRoute(std::string_view pattern,int matchId);
+    bool matchRoute(std::string_view target,Match& result) const;
+
+    // names of the ':name' segments of a route, in capture order
+    const vector<string>& getParamNames(int matchId) const;
+};
 
 }
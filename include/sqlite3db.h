@@ -30,9 +30,16 @@ either expressed or implied, of the FreeBSD Project.
 
 #include <stdarg.h>
 
+#include <pthread.h>
+#include <time.h>
+
 #include <string>
+#include <string_view>
 #include <exception>
 #include <vector>
+#include <list>
+#include <unordered_map>
+#include <atomic>
 
 #include "sqlite3.h"
 #include "jsoncpp.h"
@@ -51,33 +58,115 @@ struct SqlException: public std::exception{
     const char * what () const throw ();
 };
 
+class SqliteDb;
+
+// result column metadata, gathered once per prepared statement
+struct SqliteColumn{
+    std::string name;
+    std::string quotedKey;  // name as a JSON object key, including the ':'
+};
+
+// prepared statement kept by a connection for reuse
+struct SqliteStatement{
+    std::string query;
+    sqlite3_stmt* stmt;
+    std::vector<SqliteColumn> columns;
+    int reprepares;         // SQLITE_STMTSTATUS_REPREPARE when described; -1 before
+};
+
 class SqliteDbConnection: public Connection{
+    friend class SqliteDb;
+
+    typedef std::list<SqliteStatement> StatementList;
+
+    SqliteDb* db;
     sqlite3_stmt* stmt;
     sqlite3* handle;
     int bindIndex;
+    bool stmtCached;
+    bool written;           // a statement may have written since the last commit
+
+    // current statement; 'uncached' holds it when the cache is disabled
+    SqliteStatement* statement;
+    SqliteStatement uncached;
+
+    // LRU statement cache, most recently used first
+    StatementList statements;
+    std::unordered_map<std::string_view,StatementList::iterator> statementIndex;
+
+    // pool bookkeeping
+    pthread_t owner;
+    time_t released;
    
-    void bind(int idx,Json::Value value);
     int queryStep();
-    Json::Value queryGetRow();
+    const std::vector<SqliteColumn>& describe();
+    Json::Value queryGetRow(const std::vector<SqliteColumn>& columns);
 
 public:
-    SqliteDbConnection(std::string dbFile);
+    SqliteDbConnection(SqliteDb* db);
     ~SqliteDbConnection();
     
     virtual void prepare(std::string query);
-    virtual void bind(Json::Value value);
-    virtual void bind(std::string name,Json::Value value);
+    virtual void bind(const Json::Value& value);
+    virtual void bind(const std::string& name,const Json::Value& value);
+    virtual int getParameterIndex(const std::string& name);
+    virtual void bind(int idx,const Json::Value& value);
     virtual Json::Value execute();
     virtual void close();
+    virtual void executeStream(JsonStreamWriter& writer);
 };
 
+// Bounded pool of long-lived connections.  Idle connections are handed back
+// to the thread that last used them when possible.
 class SqliteDb: public Database{
-    std::string dbFile;
+    friend class SqliteDbConnection;
 
-    SqliteDb(std::string dbFile);
+    std::string dbFile;
+    size_t statementCacheSize;  // prepared statements kept per connection
+
+    size_t poolSize;        // max open connections
+    size_t maxIdle;         // max connections kept open while idle
+    int idleTimeout;        // seconds before an idle connection is closed; 0 = never
+    int waitTimeout;        // ms to wait for a connection when the pool is exhausted
+
+    pthread_mutex_t mutex;
+    pthread_cond_t available;
+    vector<SqliteDbConnection*> idle;
+    size_t openCount;
+
+    unsigned long hits;     // checkouts served by an idle connection
+    unsigned long misses;   // checkouts that opened a new connection
+    unsigned long waits;    // checkouts that blocked on an exhausted pool
+    unsigned long timeouts; // checkouts that gave up waiting
+
+    std::atomic<unsigned long> statementHits;
+    std::atomic<unsigned long> statementMisses;
+
+    // Bumped after every commit made through the pool.  Commits from other
+    // processes are found with PRAGMA data_version on a connection of its
+    // own, at most every 'dataVersionInterval' ms.
+    std::atomic<uint64_t> dataVersion;
+    int dataVersionInterval;
+    pthread_mutex_t versionMutex;
+    sqlite3* versionHandle;
+    sqlite3_stmt* versionStmt;
+    int64_t externalVersion;
+    std::atomic<int64_t> nextVersionCheck;
+
+    void expireIdle(vector<SqliteDbConnection*>& expired);
+    void checkExternalChanges();
+
+protected:
+    SqliteDb(std::string dbFile,const Json::Value& poolConfig,size_t statementCacheSize,
+        int dataVersionInterval = 1000);
     ~SqliteDb();
+
 public:
     virtual Connection* getConnection();
+    virtual void releaseConnection(Connection* con);
+    virtual Json::Value getStats();
+    virtual bool tracksChanges();
+    virtual uint64_t getDataVersion();
 
     static Database* Create(Json::Value root);
 };
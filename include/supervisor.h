@@ -0,0 +1,55 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <functional>
+
+namespace minibar{
+
+// Pre-fork process supervision for the frontends.
+//
+// superviseWorkers() forks 'processes' children, each of which runs
+// childMain(index) and exits with its result.  A child that exits or
+// crashes is started again with the same index, after a second's pause if
+// it didn't last a second.  SIGTERM or SIGINT is passed on to the children,
+// and superviseWorkers() returns once they have all exited.  Children get
+// SIGTERM if the supervisor dies.  It must be called before any threads
+// are started.
+//
+// If 'controlFd' is given, onControl() is called each time it becomes
+// readable, and the supervisor stops as if signalled once it returns true.
+// Children don't inherit it.
+int superviseWorkers(int processes,const std::function<int(int index)>& childMain,
+    int controlFd = -1,const std::function<bool()>& onControl = nullptr);
+
+// pins the calling process to the index'th of the CPUs it may run on,
+// wrapping around; returns false if the affinity can't be set
+bool pinToCpu(int index);
+
+}
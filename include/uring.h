@@ -0,0 +1,141 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stddef.h>
+#include <stdint.h>
+#include <linux/io_uring.h>
+
+namespace minibar{
+
+// A thin io_uring wrapper over the raw system calls, so no liburing is
+// needed.  One ring is owned and used by a single thread.
+class Uring{
+    int ringFd;
+    unsigned features;
+
+    void* sqRing;
+    size_t sqRingSize;
+    void* cqRing;
+    size_t cqRingSize;
+    struct io_uring_sqe* sqes;
+    size_t sqesSize;
+
+    unsigned* sqTail;
+    unsigned* sqHead;
+    unsigned sqMask;
+    unsigned sqEntries;
+    unsigned sqLocalTail;       // entries handed out but not yet published
+
+    unsigned* cqHead;
+    unsigned* cqTail;
+    unsigned cqMask;
+    struct io_uring_cqe* cqes;
+
+    int enter(unsigned toSubmit,unsigned minComplete,unsigned flags,void* arg,size_t argSize);
+
+public:
+    Uring();
+    ~Uring();
+
+    // Sets the ring up with room for 'entries' submissions and four times as
+    // many completions.  Returns false with errno set if io_uring is not
+    // available, or lacks a feature this wrapper relies on.
+    bool init(unsigned entries);
+
+    int getFd(){
+        return ringFd;
+    }
+
+    // A cleared submission entry, or NULL if the queue is full and could not
+    // be submitted to make room
+    struct io_uring_sqe* getSqe();
+
+    // Submits queued entries and waits until at least 'minComplete'
+    // completions are ready or 'timeoutMillis' passes (-1 waits forever).
+    // Returns the number submitted, or -errno; a timeout is not an error.
+    int submitAndWait(unsigned minComplete,int timeoutMillis = -1);
+
+    int submit(){
+        return submitAndWait(0);
+    }
+
+    // the oldest unconsumed completion, or NULL
+    struct io_uring_cqe* peekCqe(){
+        unsigned head = *cqHead;
+        if(head == __atomic_load_n(cqTail,__ATOMIC_ACQUIRE)){
+            return NULL;
+        }
+        return &cqes[head & cqMask];
+    }
+
+    // consumes the completion returned by peekCqe()
+    void advanceCqe(){
+        __atomic_store_n(cqHead,*cqHead + 1,__ATOMIC_RELEASE);
+    }
+};
+
+// A ring of equally sized receive buffers registered with a Uring
+// (IORING_REGISTER_PBUF_RING).  Receives submitted with IOSQE_BUFFER_SELECT
+// and this group id have the kernel pick a buffer as data arrives, so idle
+// connections hold no buffer at all.  Buffers go back to the ring with
+// recycle() once their data has been consumed.
+class BufferRing{
+    struct io_uring_buf_ring* ring;
+    size_t ringSize;
+    char* buffers;
+    unsigned count;
+    unsigned mask;
+    size_t bufferSize;
+    uint16_t tail;
+
+public:
+    BufferRing();
+    ~BufferRing();
+
+    // 'count' must be a power of two
+    bool init(Uring& uring,uint16_t groupId,unsigned count,size_t bufferSize);
+
+    char* get(uint16_t bufferId){
+        return buffers + bufferId * bufferSize;
+    }
+
+    void recycle(uint16_t bufferId){
+        // not ring->bufs: compiled as C++, the kernel header's flexible array
+        // doesn't start at the beginning of the ring
+        struct io_uring_buf* buf = (struct io_uring_buf*)ring + (tail & mask);
+        buf->addr = (uint64_t)(uintptr_t)get(bufferId);
+        buf->len = bufferSize;
+        buf->bid = bufferId;
+        tail++;
+        __atomic_store_n(&ring->tail,tail,__ATOMIC_RELEASE);
+    }
+};
+
+}
@@ -31,6 +31,8 @@ either expressed or implied, of the FreeBSD Project.
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <pthread.h>
 #include "jsoncpp.h"
 
 using namespace std;
@@ -52,24 +54,63 @@ struct MinibarException : public std::exception{
 };
 
 
+// scoped pthread mutex lock
+struct RAIILock{
+    pthread_mutex_t* mutex;
+
+    RAIILock(pthread_mutex_t* mutex){
+        this->mutex = mutex;
+        lock();
+    }
+    ~RAIILock(){
+        unlock();
+    }
+    void lock(){
+        pthread_mutex_lock(mutex);
+    }
+    void unlock(){
+        pthread_mutex_unlock(mutex);
+    }
+};
+
+
 typedef vector<string> TokenSet;
 typedef vector<string>::iterator TokenSetIter;
 
-TokenSet tokenize(const string& str,const string& delimiters = " ",bool trimEmpty = false);
+TokenSet tokenize(std::string_view str,std::string_view delimiters = " ",bool trimEmpty = false);
 
 
 struct QueryException: public std::exception{
     const char* text;
     TokenSet query;
     int errterm;
+    std::string message;
 
     QueryException(const char* text,TokenSet query,int errterm);
     const char* what() const throw();
 };
 
+// splits a JSON path such as "request.items[0].name" into the tokens
+// "request", "items", "0" and "name"
+TokenSet tokenizePath(std::string_view path);
+
+// the member 'term' of an object, or the element of an array if 'term' is a
+// decimal index; NULL if there is no such value or it is null
+const Json::Value* JsonChild(const Json::Value& node,const char* term,size_t length);
+
+inline const Json::Value* JsonChild(const Json::Value& node,const std::string& term){
+    return JsonChild(node,term.c_str(),term.length());
+}
+
+// Walks 'path' through 'root' by reference, without tokenizing or copying;
+// returns NULL if any element is missing.  The result is only valid while
+// 'root' is.
+const Json::Value* FindObject(const Json::Value& root,std::string_view path);
 
-Json::Value QueryObject(const Json::Value root,const TokenSet& query);
-Json::Value QueryObject(const Json::Value root,const std::string& query);
+// as FindObject, starting with the token at 'first', but throws
+// QueryException naming the element that could not be found
+const Json::Value& QueryObject(const Json::Value& root,const TokenSet& query,size_t first = 0);
+const Json::Value& QueryObject(const Json::Value& root,const std::string& query);
 
 void ParseHex(const char ch,int* accumulator);
 
@@ -0,0 +1,151 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <atomic>
+#include <new>
+#include <algorithm>
+
+#include "arena.h"
+
+namespace minibar{
+
+Arena::Arena(size_t chunkSize,size_t maxRetained):
+    chunks(NULL),pos(NULL),end(NULL),chunkSize(chunkSize),maxRetained(maxRetained),usedBefore(0){
+    //do nothing
+}
+
+Arena::~Arena(){
+    freeChunks();
+}
+
+void Arena::freeChunks(){
+    while(chunks != NULL){
+        Chunk* next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    pos = end = NULL;
+    usedBefore = 0;
+}
+
+void Arena::addChunk(size_t minSize){
+    if(chunks != NULL){
+        usedBefore += pos - ((char*)chunks + sizeof(Chunk));
+    }
+    size_t size = std::max(chunkSize,minSize + alignof(std::max_align_t));
+    Chunk* chunk = (Chunk*)malloc(sizeof(Chunk) + size);
+    if(chunk == NULL){
+        throw std::bad_alloc();
+    }
+    chunk->next = chunks;
+    chunk->size = size;
+    chunks = chunk;
+    pos = (char*)chunk + sizeof(Chunk);
+    end = pos + size;
+}
+
+void* Arena::do_allocate(size_t bytes,size_t alignment){
+    uintptr_t aligned = ((uintptr_t)pos + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    if(pos == NULL || aligned + bytes > (uintptr_t)end){
+        addChunk(bytes + alignment);
+        aligned = ((uintptr_t)pos + alignment - 1) & ~(uintptr_t)(alignment - 1);
+    }
+    pos = (char*)aligned + bytes;
+    return (void*)aligned;
+}
+
+void Arena::do_deallocate(void* ptr,size_t bytes,size_t alignment){
+    // memory is only reclaimed by reset()
+}
+
+bool Arena::do_is_equal(const std::pmr::memory_resource& other) const noexcept{
+    return this == &other;
+}
+
+size_t Arena::bytesUsed() const{
+    if(chunks == NULL){
+        return 0;
+    }
+    return usedBefore + (pos - ((char*)chunks + sizeof(Chunk)));
+}
+
+void Arena::reset(){
+    if(chunks == NULL){
+        return;
+    }
+    if(chunks->next != NULL){
+        // replace the chain with a single chunk big enough for all of it
+        size_t used = bytesUsed();
+        freeChunks();
+        if(used <= maxRetained){
+            chunkSize = std::max(chunkSize,used);
+            addChunk(0);
+        }
+        return;
+    }
+    pos = (char*)chunks + sizeof(Chunk);
+    usedBefore = 0;
+}
+
+static std::atomic<uint64_t> arenaRequests(0);
+static std::atomic<uint64_t> arenaBytes(0);
+static std::atomic<uint64_t> arenaMaxBytes(0);
+
+Arena& getRequestArena(){
+    static thread_local Arena arena;
+    return arena;
+}
+
+RequestArenaScope::~RequestArenaScope(){
+    Arena& arena = getRequestArena();
+    uint64_t used = arena.bytesUsed();
+
+    arenaRequests.fetch_add(1,std::memory_order_relaxed);
+    arenaBytes.fetch_add(used,std::memory_order_relaxed);
+    uint64_t max = arenaMaxBytes.load(std::memory_order_relaxed);
+    while(used > max && !arenaMaxBytes.compare_exchange_weak(max,used,std::memory_order_relaxed)){
+        //retry
+    }
+    arena.reset();
+}
+
+Json::Value getArenaStats(){
+    Json::Value result;
+    uint64_t requests = arenaRequests.load(std::memory_order_relaxed);
+    uint64_t bytes = arenaBytes.load(std::memory_order_relaxed);
+    result["requests"] = (Json::UInt64)requests;
+    result["bytes"] = (Json::UInt64)bytes;
+    result["bytesPerRequest"] = requests == 0 ? 0.0 : (double)bytes / requests;
+    result["maxBytes"] = (Json::UInt64)arenaMaxBytes.load(std::memory_order_relaxed);
+    return result;
+}
+
+}
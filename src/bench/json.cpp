@@ -0,0 +1,225 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "utils.h"
+#include "cgi.h"
+#include "jsonstream.h"
+#include "jsontape.h"
+#include "benchmark/benchmark.h"
+
+using namespace minibar;
+
+static void BM_ParseQueryString(benchmark::State& state){
+    std::string query = "username=guest&role=admin+user&filter=name%3Dbob%26age%3E30&limit=100&offset=200";
+    for(auto _: state){
+        Json::Value result = parseQueryString(query);
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_ParseQueryString);
+
+// decode only, then look up the one key a route refers to
+static void BM_QueryStringGet(benchmark::State& state){
+    std::string query = "username=guest&role=admin+user&filter=name%3Dbob%26age%3E30&limit=100&offset=200";
+    QueryString decoded;
+    Json::Value value;
+    for(auto _: state){
+        decoded.parse(query);
+        decoded.get("limit",value);
+        benchmark::DoNotOptimize(value);
+    }
+}
+BENCHMARK(BM_QueryStringGet);
+
+static void BM_QueryObject(benchmark::State& state){
+    Json::Value context;
+    context["path"]["username"] = "guest";
+    context["request"]["user"]["profile"]["email"] = "guest@example.com";
+    for(int i=0; i<state.range(0); i++){
+        context["conf"]["REST"]["GET/route" + std::to_string(i)]["query"] = "select * from users";
+    }
+
+    for(auto _: state){
+        Json::Value value = QueryObject(context,"request.user.profile.email");
+        benchmark::DoNotOptimize(value);
+    }
+}
+BENCHMARK(BM_QueryObject)->Arg(0)->Arg(100);
+
+// the same lookup by reference, with no tokenizing or copies
+static void BM_FindObject(benchmark::State& state){
+    Json::Value context;
+    context["path"]["username"] = "guest";
+    context["request"]["user"]["profile"]["email"] = "guest@example.com";
+    for(int i=0; i<state.range(0); i++){
+        context["conf"]["REST"]["GET/route" + std::to_string(i)]["query"] = "select * from users";
+    }
+
+    for(auto _: state){
+        const Json::Value* value = FindObject(context,"request.user.profile.email");
+        benchmark::DoNotOptimize(value);
+    }
+}
+BENCHMARK(BM_FindObject)->Arg(0)->Arg(100);
+
+// request bodies of a few typical sizes
+static std::string requestBody(int fields){
+    std::string body = "{";
+    for(int i=0; i<fields; i++){
+        if(i) body += ",";
+        body += "\"field" + std::to_string(i) + "\":";
+        switch(i % 3){
+        case 0:  body += "\"some string value " + std::to_string(i) + "\""; break;
+        case 1:  body += std::to_string(i * 12345); break;
+        default: body += "[1,2.5,true,null,{\"nested\":\"value\"}]"; break;
+        }
+    }
+    body += "}";
+    return body;
+}
+
+static void BM_JsonReader(benchmark::State& state){
+    std::string body = requestBody(state.range(0));
+    for(auto _: state){
+        Json::Reader reader;
+        Json::Value value;
+        reader.parse(body,value,false);
+        benchmark::DoNotOptimize(value);
+    }
+    state.SetBytesProcessed(state.iterations() * body.length());
+}
+BENCHMARK(BM_JsonReader)->Arg(2)->Arg(20)->Arg(1000);
+
+// the tape parses in place, so each iteration starts from a fresh copy
+static void BM_JsonTape(benchmark::State& state){
+    std::string body = requestBody(state.range(0));
+    std::string buffer;
+    JsonTape tape;
+    for(auto _: state){
+        buffer = body;
+        tape.parse(buffer.data(),buffer.length());
+        benchmark::DoNotOptimize(tape.size());
+    }
+    state.SetBytesProcessed(state.iterations() * body.length());
+}
+BENCHMARK(BM_JsonTape)->Arg(2)->Arg(20)->Arg(1000);
+
+// a route that reads one field of the body
+static void BM_JsonTapeProjected(benchmark::State& state){
+    std::string body = requestBody(state.range(0));
+    std::string buffer;
+    JsonProjection projection;
+    projection.add(tokenizePath("field1"));
+    JsonTape tape;
+    for(auto _: state){
+        buffer = body;
+        tape.parse(buffer.data(),buffer.length(),true,&projection);
+        benchmark::DoNotOptimize(tape.size());
+    }
+    state.SetBytesProcessed(state.iterations() * body.length());
+}
+BENCHMARK(BM_JsonTapeProjected)->Arg(2)->Arg(20)->Arg(1000);
+
+// result sets shaped like SqliteDbConnection::execute() output
+static Json::Value resultRows(int rows){
+    Json::Value result;
+    result.resize(0);
+    for(int i=0; i<rows; i++){
+        Json::Value row;
+        row["id"] = i;
+        row["username"] = "user" + std::to_string(i);
+        row["role"] = i % 2 ? "admin" : "guest";
+        row["score"] = i * 0.25;
+        row["note"] = "quote \" and newline \n in text";
+        result.append(row);
+    }
+    return result;
+}
+
+// rows of long text columns, mostly free of characters that need escaping
+static Json::Value textRows(int rows){
+    Json::Value result;
+    result.resize(0);
+    for(int i=0; i<rows; i++){
+        Json::Value row;
+        row["title"] = "Row " + std::to_string(i) + ": a short title for a text heavy result";
+        row["body"] = std::string(400,'x') + " and a \"quoted\" word, then some more plain text"
+            " that runs on for a while longer before the column ends.";
+        row["author"] = "someone@example.com";
+        result.append(row);
+    }
+    return result;
+}
+
+// rows of numeric columns, as from aggregate queries
+static Json::Value numericRows(int rows){
+    Json::Value result;
+    result.resize(0);
+    for(int i=0; i<rows; i++){
+        Json::Value row;
+        row["id"] = (Json::Int64)i * 1000003;
+        row["count"] = i;
+        row["total"] = (Json::Int64)i * -987654321;
+        row["mean"] = i / 7.0;
+        row["ratio"] = 0.1 * i;
+        row["price"] = 19.99 + i;
+        result.append(row);
+    }
+    return result;
+}
+
+static void BM_StyledWriter(benchmark::State& state,Json::Value (*makeRows)(int)){
+    Json::Value rows = makeRows(state.range(0));
+    for(auto _: state){
+        Json::StyledWriter writer;
+        std::string output = writer.write(rows);
+        benchmark::DoNotOptimize(output.data());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_StyledWriter,mixed,resultRows)->Arg(1)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_StyledWriter,text,textRows)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_StyledWriter,numeric,numericRows)->Arg(100)->Arg(10000);
+
+static void BM_JsonStreamWriter(benchmark::State& state,Json::Value (*makeRows)(int)){
+    Json::Value rows = makeRows(state.range(0));
+    for(auto _: state){
+        size_t total = 0;
+        JsonStreamWriter writer([&total](const char* data,size_t length){
+            total += length;
+        });
+        writer.value(rows);
+        writer.flush();
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK_CAPTURE(BM_JsonStreamWriter,mixed,resultRows)->Arg(1)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_JsonStreamWriter,text,textRows)->Arg(100)->Arg(10000);
+BENCHMARK_CAPTURE(BM_JsonStreamWriter,numeric,numericRows)->Arg(100)->Arg(10000);
@@ -0,0 +1,328 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+// In-process throughput driver: replays a weighted mix of requests from a
+// scenario file through processRequest() and reports throughput, latency
+// percentiles and heap allocations per request.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <fstream>
+#include <new>
+
+#include "utils.h"
+#include "minibar.h"
+#include "arena.h"
+
+// count every heap allocation made by the process
+static std::atomic<unsigned long> allocationCount(0);
+
+void* operator new(size_t size){
+    allocationCount.fetch_add(1,std::memory_order_relaxed);
+    void* ptr = malloc(size == 0 ? 1 : size);
+    if(ptr == NULL){
+        throw std::bad_alloc();
+    }
+    return ptr;
+}
+
+void operator delete(void* ptr) noexcept{
+    free(ptr);
+}
+
+void operator delete(void* ptr,size_t) noexcept{
+    free(ptr);
+}
+
+namespace minibar{
+
+struct ReplayRequest{
+    std::string target;
+    std::string query;
+    std::string body;
+};
+
+// RequestContext that discards output and records failures
+class ReplayRequestContext: public RequestContext{
+    const std::string& configFilename;
+    const ReplayRequest& request;
+
+public:
+    using RequestContext::logException;
+
+    size_t bytesWritten;
+    bool failed;
+
+    ReplayRequestContext(const std::string& configFilename,const ReplayRequest& request):
+        configFilename(configFilename),request(request){
+        bytesWritten = 0;
+        failed = false;
+    }
+
+    virtual void write(const char* data,size_t length){
+        bytesWritten += length;
+    }
+    virtual void log(const char* data,size_t length){
+        //do nothing
+    }
+    virtual std::string_view getConfigFilename(){
+        return configFilename;
+    }
+    virtual std::string_view getRequestContent(){
+        return request.body;
+    }
+    virtual std::string_view getQueryString(){
+        return request.query;
+    }
+    virtual std::string_view getRestTarget(){
+        return request.target;
+    }
+    virtual void logException(std::string_view msg){
+        failed = true;
+    }
+};
+
+struct Scenario{
+    std::string configFilename;
+    std::vector<ReplayRequest> requests;
+    std::vector<int> schedule;      // request indices, repeated by weight and shuffled
+};
+
+struct Worker{
+    pthread_t thread;
+    const Scenario* scenario;
+    long count;
+    size_t offset;
+    std::vector<uint64_t> latencies;
+    unsigned long errors;
+    uint64_t bytes;
+};
+
+static uint64_t nowNanos(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void loadScenario(const char* filename,Scenario& scenario){
+    Json::Reader reader;
+    Json::Value root;
+
+    std::ifstream inf(filename);
+    std::string data((std::istreambuf_iterator<char>(inf)),
+    std::istreambuf_iterator<char>());
+
+    if(!reader.parse(data,root,false)){
+        throw MinibarException(reader.getFormattedErrorMessages());
+    }
+    if(!root.isObject() || !root["requests"].isArray()){
+        throw MinibarException("Scenario must be an object with a 'requests' array");
+    }
+
+    scenario.configFilename = root.get("config","resources/test.mini").asString();
+    for(const Json::Value& item: root["requests"]){
+        ReplayRequest request;
+        request.target = item["target"].asString();
+        request.query = item.get("query","").asString();
+        if(item["body"].isString()){
+            request.body = item["body"].asString();
+        }
+        else if(!item["body"].isNull()){
+            Json::FastWriter writer;
+            request.body = writer.write(item["body"]);
+        }
+
+        int weight = item.get("weight",1).asInt();
+        for(int i=0; i<weight; i++){
+            scenario.schedule.push_back(scenario.requests.size());
+        }
+        scenario.requests.push_back(request);
+    }
+    if(scenario.schedule.empty()){
+        throw MinibarException("Scenario has no requests");
+    }
+
+    std::mt19937 rng(42);
+    std::shuffle(scenario.schedule.begin(),scenario.schedule.end(),rng);
+}
+
+static void* workerMain(void* arg){
+    Worker* worker = (Worker*)arg;
+    const Scenario& scenario = *worker->scenario;
+
+    for(long i=0; i<worker->count; i++){
+        const ReplayRequest& request = 
+            scenario.requests[scenario.schedule[(worker->offset + i) % scenario.schedule.size()]];
+        ReplayRequestContext ctx(scenario.configFilename,request);
+
+        uint64_t start = nowNanos();
+        processRequest(ctx);
+        worker->latencies.push_back(nowNanos() - start);
+
+        worker->bytes += ctx.bytesWritten;
+        if(ctx.failed){
+            worker->errors++;
+        }
+    }
+    return NULL;
+}
+
+static void runWorkers(const Scenario& scenario,std::vector<Worker>& workers,long total){
+    for(size_t i=0; i<workers.size(); i++){
+        Worker& worker = workers[i];
+        worker.scenario = &scenario;
+        worker.count = total / workers.size() + (i < total % workers.size() ? 1 : 0);
+        worker.offset = i * 7919;
+        worker.latencies.clear();
+        worker.latencies.reserve(worker.count);
+        worker.errors = 0;
+        worker.bytes = 0;
+        pthread_create(&worker.thread,NULL,workerMain,&worker);
+    }
+    for(Worker& worker: workers){
+        pthread_join(worker.thread,NULL);
+    }
+}
+
+static double percentile(const std::vector<uint64_t>& sorted,double p){
+    if(sorted.empty()) return 0;
+    size_t idx = std::min(sorted.size()-1,(size_t)(p * sorted.size()));
+    return sorted[idx] / 1000.0;
+}
+
+static void usage(const char* name){
+    fprintf(stderr,"usage: %s [-n requests] [-w warmup] [-t threads] [-j] scenario.json\n",name);
+    fprintf(stderr,"  -n requests  measured requests (default: 100000)\n");
+    fprintf(stderr,"  -w warmup    requests replayed before measuring (default: 1000)\n");
+    fprintf(stderr,"  -t threads   concurrent callers of processRequest (default: 1)\n");
+    fprintf(stderr,"  -j           print the report as JSON\n");
+}
+
+}
+
+using namespace minibar;
+
+int main(int argc,char** argv){
+    long requests = 100000;
+    long warmup = 1000;
+    long threads = 1;
+    bool json = false;
+    int opt;
+
+    while((opt = getopt(argc,argv,"n:w:t:j")) != -1){
+        switch(opt){
+        case 'n': requests = strtol(optarg,NULL,10); break;
+        case 'w': warmup = strtol(optarg,NULL,10); break;
+        case 't': threads = strtol(optarg,NULL,10); break;
+        case 'j': json = true; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc-1 || requests < 1 || warmup < 0 || threads < 1){
+        usage(argv[0]);
+        return 1;
+    }
+
+    Scenario scenario;
+    try{
+        loadScenario(argv[optind],scenario);
+    }
+    catch(const std::exception& ex){
+        fprintf(stderr,"%s: %s\n",argv[optind],ex.what());
+        return 1;
+    }
+
+    std::vector<Worker> workers(threads);
+    if(warmup > 0){
+        runWorkers(scenario,workers,warmup);
+    }
+
+    unsigned long allocationsBefore = allocationCount.load();
+    uint64_t arenaBefore = getArenaStats()["bytes"].asUInt64();
+    uint64_t start = nowNanos();
+    runWorkers(scenario,workers,requests);
+    uint64_t elapsed = nowNanos() - start;
+    unsigned long allocations = allocationCount.load() - allocationsBefore;
+    uint64_t arenaBytes = getArenaStats()["bytes"].asUInt64() - arenaBefore;
+
+    std::vector<uint64_t> latencies;
+    latencies.reserve(requests);
+    unsigned long errors = 0;
+    uint64_t bytes = 0;
+    for(Worker& worker: workers){
+        latencies.insert(latencies.end(),worker.latencies.begin(),worker.latencies.end());
+        errors += worker.errors;
+        bytes += worker.bytes;
+    }
+    std::sort(latencies.begin(),latencies.end());
+
+    // bookkeeping allocations made by the driver itself are negligible
+    Json::Value report;
+    report["requests"] = (Json::UInt64)requests;
+    report["threads"] = (Json::UInt64)threads;
+    report["errors"] = (Json::UInt64)errors;
+    report["seconds"] = elapsed / 1e9;
+    report["requestsPerSecond"] = requests / (elapsed / 1e9);
+    report["bytesPerRequest"] = (double)bytes / requests;
+    report["allocationsPerRequest"] = (double)allocations / requests;
+    report["arenaBytesPerRequest"] = (double)arenaBytes / requests;
+    report["latencyMicros"]["p50"] = percentile(latencies,0.50);
+    report["latencyMicros"]["p99"] = percentile(latencies,0.99);
+    report["latencyMicros"]["p999"] = percentile(latencies,0.999);
+    report["latencyMicros"]["max"] = percentile(latencies,1.0);
+
+    if(json){
+        Json::StyledWriter writer;
+        printf("%s",writer.write(report).c_str());
+    }
+    else{
+        printf("requests:       %ld (%lu errors) on %ld thread(s)\n",requests,errors,threads);
+        printf("throughput:     %.0f requests/sec\n",report["requestsPerSecond"].asDouble());
+        printf("latency (us):   p50 %.1f  p99 %.1f  p999 %.1f  max %.1f\n",
+            report["latencyMicros"]["p50"].asDouble(),
+            report["latencyMicros"]["p99"].asDouble(),
+            report["latencyMicros"]["p999"].asDouble(),
+            report["latencyMicros"]["max"].asDouble());
+        printf("allocations:    %.1f per request\n",report["allocationsPerRequest"].asDouble());
+        printf("request arena:  %.1f bytes per request\n",report["arenaBytesPerRequest"].asDouble());
+        printf("response bytes: %.1f per request\n",report["bytesPerRequest"].asDouble());
+    }
+    return errors == 0 ? 0 : 2;
+}
@@ -0,0 +1,105 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "router.h"
+#include "utils.h"
+#include "benchmark/benchmark.h"
+
+using namespace minibar;
+
+// route patterns shaped like a typical REST config
+static std::string routePattern(int i){
+    switch(i % 4){
+    case 0:  return "GET/resource" + std::to_string(i) + "/:id";
+    case 1:  return "PUT/resource" + std::to_string(i) + "/:id";
+    case 2:  return "GET/resource" + std::to_string(i) + "/:id/items/:item";
+    default: return "POST/resource" + std::to_string(i);
+    }
+}
+
+static std::string routeTarget(int i){
+    switch(i % 4){
+    case 0:  return "GET/resource" + std::to_string(i) + "/1234";
+    case 1:  return "PUT/resource" + std::to_string(i) + "/1234";
+    case 2:  return "GET/resource" + std::to_string(i) + "/1234/items/5678";
+    default: return "POST/resource" + std::to_string(i);
+    }
+}
+
+static void BM_RouteNodeMatch(benchmark::State& state){
+    int routes = state.range(0);
+    RouteNode root;
+    for(int i=0; i<routes; i++){
+        root.addRoute(tokenize(routePattern(i),"/"),i);
+    }
+
+    std::vector<std::string> targets;
+    for(int i=0; i<routes; i+=std::max(1,routes/16)){
+        targets.push_back(routeTarget(i));
+    }
+
+    size_t n = 0;
+    for(auto _: state){
+        Json::Value pathValues;
+        int id = root.matchRoute(tokenize(targets[n++ % targets.size()],"/"),pathValues);
+        benchmark::DoNotOptimize(id);
+    }
+    root.clear();
+}
+BENCHMARK(BM_RouteNodeMatch)->Arg(10)->Arg(100)->Arg(10000);
+
+static void BM_RouteTableMatch(benchmark::State& state){
+    int routes = state.range(0);
+    RouteTable table;
+    for(int i=0; i<routes; i++){
+        table.addRoute(routePattern(i),i);
+    }
+
+    std::vector<std::string> targets;
+    for(int i=0; i<routes; i+=std::max(1,routes/16)){
+        targets.push_back(routeTarget(i));
+    }
+
+    size_t n = 0;
+    RouteTable::Match match;
+    for(auto _: state){
+        bool found = table.matchRoute(targets[n++ % targets.size()],match);
+        benchmark::DoNotOptimize(found);
+    }
+}
+BENCHMARK(BM_RouteTableMatch)->Arg(10)->Arg(100)->Arg(10000);
+
+static void BM_Tokenize(benchmark::State& state){
+    std::string path = "GET/resource42/1234/items/5678";
+    for(auto _: state){
+        TokenSet tokens = tokenize(path,"/");
+        benchmark::DoNotOptimize(tokens.data());
+    }
+}
+BENCHMARK(BM_Tokenize);
@@ -0,0 +1,95 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "sqlite3db.h"
+#include "benchmark/benchmark.h"
+
+using namespace minibar;
+
+// SqliteDb over resources/test.db with a temp table of generated rows
+class SqliteDbBench : public SqliteDb{
+public:
+    SqliteDbBench(int rows): SqliteDb("resources/test.db",poolConfig(),32){
+        RAIIConnection con(this);
+        con->prepare("create temp table benchdata (id integer primary key, data text, modified datetime)");
+        con->execute();
+        con->prepare("insert into benchdata (data,modified) "
+            "with recursive n(i) as (select 1 union all select i+1 from n where i < ?) "
+            "select 'row ' || i, datetime('now') from n");
+        con->bind(Json::Value(rows));
+        con->execute();
+    }
+
+    static Json::Value poolConfig(){
+        Json::Value config;
+        config["size"] = 1;
+        return config;
+    }
+};
+
+static void BM_SqliteExecute(benchmark::State& state){
+    SqliteDbBench db(state.range(0));
+    for(auto _: state){
+        RAIIConnection con(&db);
+        con->prepare("select * from benchdata");
+        Json::Value result = con->execute();
+        benchmark::DoNotOptimize(result);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SqliteExecute)->Arg(1)->Arg(100)->Arg(10000);
+
+static void BM_SqliteExecuteStream(benchmark::State& state){
+    SqliteDbBench db(state.range(0));
+    for(auto _: state){
+        size_t total = 0;
+        JsonStreamWriter writer([&total](const char* data,size_t length){
+            total += length;
+        });
+        RAIIConnection con(&db);
+        con->prepare("select * from benchdata");
+        con->executeStream(writer);
+        writer.flush();
+        benchmark::DoNotOptimize(total);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_SqliteExecuteStream)->Arg(1)->Arg(100)->Arg(10000);
+
+static void BM_SqliteLookup(benchmark::State& state){
+    SqliteDbBench db(1);
+    for(auto _: state){
+        RAIIConnection con(&db);
+        con->prepare("select * from users where username = ?");
+        con->bind(Json::Value("guest"));
+        Json::Value result = con->execute();
+        benchmark::DoNotOptimize(result);
+    }
+}
+BENCHMARK(BM_SqliteLookup);
@@ -26,6 +26,10 @@ The views and conclusions contained in the software and documentation are those
 of the authors and should not be interpreted as representing official policies, 
 either expressed or implied, of the FreeBSD Project.
 */
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "cgi.h"
 #include "utils.h"
 #include "minibar.h"
@@ -35,61 +39,186 @@ namespace minibar{
 const char* STATUS_200 = "Status: 200 OK\r\nContent-type: application/json\r\n\r\n";
 const char* STATUS_400 = "Status: 400 Bad Request\r\nContent-type: application/json\r\n\r\n";
 const char* STATUS_401 = "Status: 401 Unauthorized\r\nContent-type: application/json\r\n";
+const char* STATUS_404 = "Status: 404 Not Found\r\nContent-type: application/json\r\n\r\n";
 const char* STATUS_405 = "Status: 405 Method Not Allowed\r\n";
 const char* STATUS_500 = "Status: 500 Internal Server Error\r\nContent-type: application/json\r\n\r\n";
 
-enum{ KEY, VALUE };
-
-Json::Value parseQueryString(std::string query){
-    Json::Value result(Json::ValueType::objectValue);
-    int state = KEY;
-    char* p = (char*)query.c_str();
-    std::string key,value;
+// decodes '+' and '%xx' escapes in place; returns the decoded length
+static size_t decodeInPlace(char* data,size_t length){
+    char* out = data;
+    char* p = data;
+    char* end = data + length;
     int i;
 
-    // bail out if there's no query string
-    if(p == NULL || *p == '\0') return result;
-
-    key.reserve(20);
-    value.reserve(20);
-
-    while(*p != '\0'){
+    while(p != end){
         switch(*p){
-        case '=':
-            state = VALUE;
-            key = value;
-            value.clear();
-            break;
-        case '&':
-            result[key] = value;
-            key.clear();
-            value.clear();
-            state = KEY;
-            break;
         case '%':
             i = 0;
-            ParseHex(*(++p),&i); //TODO: handle EOF here
+            if(end - p < 3){
+                throw MinibarException("Truncated hex expression in query string");
+            }
+            ParseHex(*(++p),&i);
             ParseHex(*(++p),&i);
-            value += (char)i;
+            *out++ = (char)i;
             break;
         case '+':
-            value += ' ';
+            *out++ = ' ';
             break;
         default:
-            value += *p;
+            *out++ = *p;
         }
         p++;
     }
-    if(state == VALUE){
-        // finish off the k/v pair
-        result[key] = value;
+    return out - data;
+}
+
+QueryString::QueryString(std::pmr::memory_resource* resource):
+    overflow(resource),storage(resource){
+    count = 0;
+}
+
+void QueryString::addPair(const char* start,const char* equals,const char* end,bool escaped){
+    // skip empty segments, as in "a=1&&b=2"
+    if(start == end) return;
+
+    Pair pair;
+    pair.hasValue = equals != NULL;
+    const char* keyEnd = pair.hasValue ? equals : end;
+
+    if(!escaped){
+        pair.key = std::string_view(start,keyEnd - start);
+        if(pair.hasValue){
+            pair.value = std::string_view(equals+1,end - equals - 1);
+        }
+    }
+    else{
+        // the source may be read-only, so decode in a copy of it
+        if(storage.empty()){
+            storage.assign(source);
+        }
+        char* copy = storage.data() + (start - source.data());
+        size_t keyLength = keyEnd - start;
+        pair.key = std::string_view(copy,decodeInPlace(copy,keyLength));
+        if(pair.hasValue){
+            char* value = copy + keyLength + 1;
+            pair.value = std::string_view(value,decodeInPlace(value,end - equals - 1));
+        }
+    }
+
+    if(count < INLINE_PAIRS){
+        inlinePairs[count] = pair;
     }
     else{
-        result[value] = Json::Value();
+        overflow.push_back(pair);
+    }
+    count++;
+}
+
+void QueryString::parse(std::string_view query){
+    count = 0;
+    overflow.clear();
+    storage.clear();
+    source = query;
+
+    const char* p = query.data();
+    const char* end = p + query.length();
+    const char* start = p;
+    const char* equals = NULL;
+    bool escaped = false;
+
+    auto delimiter = [&](const char* c){
+        switch(*c){
+        case '&':
+            addPair(start,equals,c,escaped);
+            start = c + 1;
+            equals = NULL;
+            escaped = false;
+            break;
+        case '=':
+            // later '=' are part of the value
+            if(equals == NULL){
+                equals = c;
+            }
+            break;
+        default:
+            escaped = true;
+        }
+    };
+
+#ifdef __SSE2__
+    // find '&', '=', '%' and '+' sixteen bytes at a time
+    const __m128i amp = _mm_set1_epi8('&');
+    const __m128i eq = _mm_set1_epi8('=');
+    const __m128i pct = _mm_set1_epi8('%');
+    const __m128i plus = _mm_set1_epi8('+');
+    while(end - p >= 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i hits = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk,amp),_mm_cmpeq_epi8(chunk,eq)),
+            _mm_or_si128(_mm_cmpeq_epi8(chunk,pct),_mm_cmpeq_epi8(chunk,plus)));
+        unsigned mask = _mm_movemask_epi8(hits);
+        while(mask != 0){
+            delimiter(p + __builtin_ctz(mask));
+            mask &= mask - 1;
+        }
+        p += 16;
+    }
+#endif
+    for(; p != end; p++){
+        if(*p == '&' || *p == '=' || *p == '%' || *p == '+'){
+            delimiter(p);
+        }
+    }
+    addPair(start,equals,end,escaped);
+}
+
+static Json::Value pairValue(const QueryString::Pair& pair){
+    if(!pair.hasValue){
+        return Json::Value();
+    }
+    return Json::Value(pair.value.data(),pair.value.data() + pair.value.length());
+}
+
+bool QueryString::get(std::string_view key,Json::Value& result) const{
+    bool found = false;
+    for(size_t i=0; i<count; i++){
+        const Pair& pair = (*this)[i];
+        if(pair.key != key) continue;
+
+        if(!found){
+            result = pairValue(pair);
+            found = true;
+        }
+        else{
+            // repeated keys collect into an array
+            if(!result.isArray()){
+                Json::Value first = result;
+                result = Json::Value(Json::arrayValue);
+                result.append(first);
+            }
+            result.append(pairValue(pair));
+        }
+    }
+    return found;
+}
+
+Json::Value QueryString::toJson() const{
+    Json::Value result(Json::ValueType::objectValue);
+    for(size_t i=0; i<count; i++){
+        const Pair& pair = (*this)[i];
+        std::string key(pair.key);
+        if(!result.isMember(key)){
+            get(pair.key,result[key]);
+        }
     }
     return result;
 }
 
+Json::Value parseQueryString(std::string_view query){
+    QueryString decoded;
+    decoded.parse(query);
+    return decoded.toJson();
+}
 }
 
 #ifdef UNITTEST
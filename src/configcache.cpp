@@ -0,0 +1,238 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdio.h>
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+
+#include <algorithm>
+
+#include "utils.h"
+#include "configcache.h"
+
+namespace minibar{
+
+static std::atomic<uint64_t> nextCacheId(1);
+
+// per thread view of the caches, so that requests only need an atomic read
+// to find out whether their Config is still current
+struct LocalConfig{
+    uint64_t cacheId;
+    std::string filename;
+    void* entry;
+    uint64_t generation;
+    std::shared_ptr<Config> config;
+};
+static thread_local std::vector<LocalConfig> localConfigs;
+
+bool ConfigCache::FileStamp::operator==(const FileStamp& other) const{
+    return device == other.device && inode == other.inode && size == other.size &&
+        modified.tv_sec == other.modified.tv_sec && modified.tv_nsec == other.modified.tv_nsec;
+}
+
+ConfigCache::ConfigCache(int pollMillis):
+    id(nextCacheId++),pollMillis(pollMillis),watcherStarted(false),stopping(false){
+    pthread_mutex_init(&mutex,NULL);
+    pthread_mutex_init(&reloadMutex,NULL);
+    pthread_cond_init(&wakeup,NULL);
+}
+
+ConfigCache::~ConfigCache(){
+    bool joinWatcher;
+    {
+        RAIILock lock(&mutex);
+        stopping = true;
+        joinWatcher = watcherStarted;
+        pthread_cond_signal(&wakeup);
+    }
+    if(joinWatcher){
+        pthread_join(watcher,NULL);
+    }
+    pthread_cond_destroy(&wakeup);
+    pthread_mutex_destroy(&reloadMutex);
+    pthread_mutex_destroy(&mutex);
+}
+
+bool ConfigCache::statFile(const std::string& filename,FileStamp& stamp){
+    struct stat st;
+    if(stat(filename.c_str(),&st) != 0){
+        return false;
+    }
+    stamp.device = st.st_dev;
+    stamp.inode = st.st_ino;
+    stamp.size = st.st_size;
+    stamp.modified = st.st_mtim;
+    return true;
+}
+
+std::shared_ptr<Config> ConfigCache::compile(const std::string& filename){
+    std::shared_ptr<Config> config = std::make_shared<Config>();
+    config->loadConfig(filename);
+    return config;
+}
+
+ConfigCache::Entry* ConfigCache::getEntry(std::string_view filename){
+    RAIILock lock(&mutex);
+
+    auto iter = entries.find(filename);
+    if(iter != entries.end()){
+        return iter->second.get();
+    }
+
+    // first load is compiled by the requesting thread; a file that fails to
+    // compile is not cached, so the error is reported on every request
+    std::unique_ptr<Entry> entry(new Entry());
+    entry->filename = filename;
+    if(!statFile(entry->filename,entry->stamp)){
+        memset(&entry->stamp,0,sizeof(entry->stamp));
+    }
+    entry->config = compile(entry->filename);
+    entry->generation = 0;
+
+    Entry* result = entry.get();
+    entries.emplace(filename,std::move(entry));
+
+    if(pollMillis > 0 && !watcherStarted){
+        watcherStarted = pthread_create(&watcher,NULL,watcherMain,this) == 0;
+    }
+    return result;
+}
+
+Config* ConfigCache::getConfig(std::string_view filename){
+    LocalConfig* local = NULL;
+    for(LocalConfig& item: localConfigs){
+        if(item.cacheId == id && item.filename == filename){
+            local = &item;
+            break;
+        }
+    }
+    if(local == NULL){
+        Entry* entry = getEntry(filename);
+        localConfigs.push_back(LocalConfig{id,std::string(filename),entry,0,NULL});
+        local = &localConfigs.back();
+        local->generation = entry->generation.load(std::memory_order_acquire);
+        local->config = std::atomic_load(&entry->config);
+        return local->config.get();
+    }
+
+    Entry* entry = (Entry*)local->entry;
+    uint64_t generation = entry->generation.load(std::memory_order_acquire);
+    if(generation != local->generation){
+        // dropping the old reference here is safe; the previous request on
+        // this thread has finished with it
+        local->config = std::atomic_load(&entry->config);
+        local->generation = generation;
+    }
+    return local->config.get();
+}
+
+int ConfigCache::checkForChanges(){
+    RAIILock reloadLock(&reloadMutex);
+
+    std::vector<Entry*> snapshot;
+    {
+        RAIILock lock(&mutex);
+        for(auto& pair: entries){
+            snapshot.push_back(pair.second.get());
+        }
+    }
+
+    int reloaded = 0;
+    for(Entry* entry: snapshot){
+        // configs replaced earlier are destroyed here once the last request
+        // thread has let go, so database teardown stays off the request path
+        auto& retired = entry->retired;
+        retired.erase(std::remove_if(retired.begin(),retired.end(),[](const std::shared_ptr<Config>& config){
+            return config.use_count() == 1;
+        }),retired.end());
+
+        FileStamp stamp;
+        if(!statFile(entry->filename,stamp) || stamp == entry->stamp){
+            // a missing file is usually an editor mid-save; keep the old config
+            continue;
+        }
+        entry->stamp = stamp;
+
+        std::shared_ptr<Config> config;
+        try{
+            config = compile(entry->filename);
+        }
+        catch(const std::exception& ex){
+            fprintf(stderr,"minibar: keeping previous config, reload of %s failed: %s\n",
+                entry->filename.c_str(),ex.what());
+            continue;
+        }
+
+        retired.push_back(std::atomic_load(&entry->config));
+        std::atomic_store(&entry->config,config);
+        entry->generation.fetch_add(1,std::memory_order_release);
+        reloaded++;
+    }
+    return reloaded;
+}
+
+uint64_t ConfigCache::getGeneration(std::string_view filename){
+    RAIILock lock(&mutex);
+    auto iter = entries.find(filename);
+    if(iter == entries.end()){
+        return 0;
+    }
+    return iter->second->generation.load(std::memory_order_acquire);
+}
+
+void* ConfigCache::watcherMain(void* arg){
+    ConfigCache* cache = (ConfigCache*)arg;
+
+    while(true){
+        {
+            RAIILock lock(&cache->mutex);
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME,&deadline);
+            deadline.tv_sec += cache->pollMillis / 1000;
+            deadline.tv_nsec += (cache->pollMillis % 1000) * 1000000L;
+            if(deadline.tv_nsec >= 1000000000L){
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while(!cache->stopping){
+                if(pthread_cond_timedwait(&cache->wakeup,&cache->mutex,&deadline) == ETIMEDOUT){
+                    break;
+                }
+            }
+            if(cache->stopping){
+                break;
+            }
+        }
+        cache->checkForChanges();
+    }
+    return NULL;
+}
+
+}
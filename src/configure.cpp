@@ -44,10 +44,12 @@ static Json::ValueType getJsonScalarType(string name){
 }
 
 QueryParameter::QueryParameter(){
-    //do nothing
+    hasDefault = false;
+    type = Json::nullValue;
 }
     
 QueryParameter::QueryParameter(const Json::Value& param){
+    hasDefault = false;
     if(param.isObject() && !param.isNull()){
         path = param["path"].asString();
         if(param.isMember("name")){
@@ -60,7 +62,8 @@ QueryParameter::QueryParameter(const Json::Value& param){
             type = Json::nullValue;
         }
         if(param.isMember("default")){
-            defaultValue = param["default"].asString();
+            defaultValue = param["default"];
+            hasDefault = true;
         }
         if(param.isMember("validation")){
             validation = param["validation"].asString();
@@ -78,11 +81,16 @@ QueryParameter::QueryParameter(const Json::Value& param){
 ///////////////////
 
 RestNode::RestNode(){
-    //do nothing
+    stream = false;
+    cached = false;
+    cacheTtl = 0;
 }
 
 RestNode::RestNode(Config* config,const std::string& path,const Json::Value& root){
     this->path = path;
+    this->stream = false;
+    this->cached = false;
+    this->cacheTtl = 0;
 
     if(!root.isObject() || root.isNull()){
         throw MinibarException("REST node must be an object");
@@ -97,10 +105,35 @@ RestNode::RestNode(Config* config,const std::string& path,const Json::Value& roo
         databaseName = dbName;
  
         query = root["query"].asString();
+        stream = root.get("stream",config->getRoot().get("stream",false)).asBool();
+
+        // "cache": true, or a TTL in seconds
+        // (jsoncpp counts booleans as numeric, so they're checked first)
+        Json::Value cache = root.get("cache",false);
+        if(cache.isBool()){
+            cached = cache.asBool();
+        }
+        else if(cache.isNumeric()){
+            cached = true;
+            cacheTtl = cache.asInt();
+        }
+        else{
+            cached = cache.asBool();
+        }
+        if(cached && path.compare(0,4,"GET/") != 0){
+            throw MinibarException("Only GET routes can be cached: " + path);
+        }
+        if(cached && !database->tracksChanges()){
+            throw MinibarException("Database " + dbName + " does not support result caching");
+        }
         
         Json::Value params = root["params"];
         for(Json::Value value: params){
             parameters.push_back(QueryParameter(value));
+            bindings.push_back(ParamBinding(parameters.back()));
+            if(bindings.back().getSource() == SOURCE_REQUEST){
+                requestFields.add(bindings.back().getPath(),1);
+            }
         }
     }
 }
@@ -123,6 +156,10 @@ Json::Value RestNode::toJson(){
         }
         result["params"] = params;
         result["database"] = databaseName; 
+        result["stream"] = stream;
+        if(cached){
+            result["cache"] = cacheTtl > 0 ? Json::Value(cacheTtl) : Json::Value(true);
+        }
     }
     return result;
 }
@@ -140,6 +177,7 @@ Config::~Config(){
 void Config::clear(){
     router.clear();
     root = Json::Value::null;
+    resultCache.clear();
 
     for(auto pair: databases){
         delete pair.second;
@@ -152,7 +190,7 @@ void Config::clear(){
     routes.clear();
 }
 
-Json::Value Config::getRoot(){
+const Json::Value& Config::getRoot(){
     return root;
 }
 
@@ -175,6 +213,9 @@ void Config::loadConfig(string filename){
     // debug mode
     debugMode = root.get("debug",false).asBool();
 
+    // memory for cached responses, shared by every cached route
+    resultCache.setMaxBytes(root.get("resultCacheSize",16 * 1024 * 1024).asUInt64());
+
     // compile databases
     Json::Value dbNode = root["DB"];
     if(!dbNode.isObject()){
@@ -195,9 +236,8 @@ void Config::loadConfig(string filename){
     }
     for(string key: restNode.getMemberNames()){
         Json::Value value = restNode[key];
-        TokenSet tokens = tokenize(key,"/");
 
-        router.addRoute(tokens,routes.size());
+        router.addRoute(key,routes.size());
         routes.push_back(new RestNode(this,key,value));
     }
 }
@@ -213,12 +253,17 @@ Database* Config::getDatabase(string name){
 }
 
 
-RestNode* Config::getRestNode(string path,Json::Value& pathValues){
-    int idx = router.matchRoute(tokenize(path,"/"),pathValues);
-    if(idx == RouteNode::NO_ROUTE_MATCH){
-        throw MinibarException(std::string("Unknown route ") + path);
+RestNode* Config::getRestNode(std::string_view path,Json::Value& pathValues){
+    RouteTable::Match match;
+    if(!router.matchRoute(path,match)){
+        throw UnknownRouteException(std::string("Unknown route ").append(path));
+    }
+
+    const vector<string>& names = router.getParamNames(match.id);
+    for(int i=0; i<match.paramCount; i++){
+        pathValues[names[i]] = std::string(match.params[i]);
     }
-    return routes[idx];
+    return routes[match.id];
 }
 
 Json::Value Config::toJson(){
@@ -236,4 +281,19 @@ Json::Value Config::toJson(){
     return result;
 }
 
+ResultCache& Config::getResultCache(){
+    return resultCache;
+}
+
+Json::Value Config::getStats(){
+    Json::Value result(Json::objectValue);
+    result["resultCache"] = resultCache.getStats();
+
+    for(auto dbPair: databases){
+        result["DB"][dbPair.first] = dbPair.second->getStats();
+    }
+
+    return result;
+}
+
 }
@@ -27,98 +27,783 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the FreeBSD Project.
 */
 
-#include "fcgi_config.h"
-#include "fcgiapp.h"
-
-#include <stdarg.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
 
 #include <string>
-#include <exception>
 #include <vector>
-#include <memory>
-#include <fstream>
+#include <algorithm>
 
 #include "utils.h"
 #include "minibar.h"
+#include "fcgiproto.h"
+#include "listener.h"
+#include "supervisor.h"
 
 namespace minibar{
 
-// global vars for working with FastCGI
-FCGX_Stream *inStream, *outStream, *errStream;
-FCGX_ParamArray envp;
+enum{
+    // the socket a web server passes to a FastCGI application it starts
+    FCGI_LISTENSOCK_FILENO = 0,
+    READ_SIZE = 16384,
+    // response bytes gathered before they are sent as STDOUT records
+    STDOUT_BUFFER = 32768,
+    // queued output above which further requests wait for the web server,
+    // and a request producing output waits for it to be sent
+    MAX_PENDING_OUTPUT = 1024 * 1024,
+    // seconds a request waits for the web server to take any of its output
+    SEND_TIMEOUT = 30,
+    // requests one connection may have open at once
+    MAX_REQUESTS = 64,
+    MAX_EVENTS = 64
+};
+
+// the sockets this process accepts on; more than one if it took over more
+// SO_REUSEPORT sockets than it has worker processes
+static std::vector<int> listenFds;
+static long threads = 1;
+static int maxConnections;
+static size_t maxBodyLength = fcgi::DEFAULT_MAX_BODY_LENGTH;
+// seconds open requests get to finish once the process is told to stop
+static int drainTimeout = 30;
+// becomes readable, and stays so, when SIGTERM or SIGINT arrives
+static int stopFd = -1;
+// peers allowed by FCGI_WEB_SERVER_ADDRS; empty allows any
+static std::vector<std::string> webServerAddrs;
+
+// One web server connection, owned by the worker thread that accepted it.
+// Any number of requests may be open on it at once; each is run as soon as
+// its PARAMS and STDIN streams are complete, and the responses of
+// interleaved requests are told apart by their request ids.
+class FcgiConnection{
+    std::vector<char> in;       // unprocessed input is [inStart,inEnd)
+    size_t inStart;
+    size_t inEnd;
+    bool readPaused;            // stopped reading with input still buffered
+    std::vector<fcgi::ServerRequest*> ready;
+    size_t readyPos;
+
+    void runRequest(fcgi::ServerRequest* request);
+
+public:
+    int fd;
+    size_t slot;                // index in the worker's connection list
+    fcgi::ServerConnection protocol;
+
+    std::string out;            // queued output is [outPos,out.length())
+    size_t outPos;
+    bool closing;               // close once the queued output is sent
+    bool readClosed;            // the web server has finished sending
+    bool broken;                // the peer has gone; output is dropped
+    bool heldBack;              // requests wait for queued output to drain
+
+    // per request buffers, kept for their capacity
+    std::string restTarget;
+    std::string pending;
+
+    FcgiConnection(int fd);
+    ~FcgiConnection();
+
+    bool readInput();
+    bool flush();
+    bool waitForOutput();
+    void processRecords();
+
+    // true once the connection can be closed
+    bool isDone(){
+        return outPos == out.length() && (closing || readClosed);
+    }
+
+    // true if closing the connection would lose no request or output
+    bool isIdle(){
+        return protocol.getActiveCount() == 0 && inStart == inEnd && outPos == out.length();
+    }
+};
+
+// RequestContext over one request of a FcgiConnection.  The response is
+// sent as STDOUT records of up to STDOUT_BUFFER bytes as it is produced,
+// and log output as STDERR records, which web servers write to their
+// error log.
+class FastCgiRequestContext: public RequestContext{
+    FcgiConnection& connection;
+    fcgi::ServerRequest& request;
+    bool logged;
+
+    void sendOutput(){
+        fcgi::appendStream(connection.out,fcgi::STDOUT,request.id,connection.pending);
+        connection.pending.clear();
+        if(!connection.flush() || !connection.waitForOutput()){
+            connection.broken = true;
+        }
+    }
+
+public:
+    using RequestContext::logException;
+
+    FastCgiRequestContext(FcgiConnection& connection,fcgi::ServerRequest& request):
+        connection(connection),request(request),logged(false){
+        connection.pending.clear();
+        connection.restTarget.assign(request.getParam(fcgi::PARAM_REQUEST_METHOD));
+        connection.restTarget.append(request.getParam(fcgi::PARAM_PATH_INFO));
+    }
+
+    virtual void write(const char* data,size_t length){
+        if(connection.broken){
+            return;
+        }
+        connection.pending.append(data,length);
+        if(connection.pending.length() >= STDOUT_BUFFER){
+            sendOutput();
+        }
+    }
+
+    virtual void log(const char* data,size_t length){
+        if(connection.broken || length == 0){
+            return;
+        }
+        fcgi::appendStream(connection.out,fcgi::STDERR,request.id,std::string_view(data,length));
+        logged = true;
+    }
+
+    virtual std::string_view getConfigFilename(){
+        return request.getParam(fcgi::PARAM_SCRIPT_FILENAME);
+    }
+
+    virtual std::string_view getRequestContent(){
+        return request.body;
+    }
 
-#define BUFFER_SIZE 1024
+    // the body is already buffered in the request, so it can be decoded in
+    // place without another copy
+    virtual char* getMutableRequestContent(size_t& length){
+        length = request.body.length();
+        return request.body.data();
+    }
 
-std::string FCGX_ReadString(FCGX_Stream* stream){
-    std::unique_ptr<char> buf(new char[BUFFER_SIZE]);
-    std::string result;
-    size_t amount;
-    
-    do {
-        amount = FCGX_GetStr(buf.get(),BUFFER_SIZE,stream);
-        result.append(buf.get(),amount);
-    } while(amount == BUFFER_SIZE);
+    virtual std::string_view getQueryString(){
+        return request.getParam(fcgi::PARAM_QUERY_STRING);
+    }
+
+    virtual std::string_view getRestTarget(){
+        return connection.restTarget;
+    }
 
-    return result;
+    virtual void logException(std::string_view msg){
+        //@breakpoint
+        logPrint("Exception: %.*s\n",(int)msg.length(),msg.data());
+        write(msg.data(),msg.length());
+    }
+
+    // ends the STDOUT and STDERR streams and the request
+    void finish(){
+        if(!connection.pending.empty()){
+            fcgi::appendStream(connection.out,fcgi::STDOUT,request.id,connection.pending);
+        }
+        fcgi::appendStream(connection.out,fcgi::STDOUT,request.id,"");
+        if(logged){
+            fcgi::appendStream(connection.out,fcgi::STDERR,request.id,"");
+        }
+        connection.protocol.finish(&request,connection.out);
+    }
+};
+
+///////////
+
+FcgiConnection::FcgiConnection(int fd): in(READ_SIZE),protocol(maxConnections,MAX_REQUESTS,maxBodyLength){
+    this->fd = fd;
+    slot = 0;
+    inStart = 0;
+    inEnd = 0;
+    readPaused = false;
+    readyPos = 0;
+    outPos = 0;
+    closing = false;
+    readClosed = false;
+    broken = false;
+    heldBack = false;
 }
 
-void FCGX_WriteString(const std::string str,FCGX_Stream* stream){
-    FCGX_PutStr(str.data(),str.length(),stream);
+FcgiConnection::~FcgiConnection(){
+    close(fd);
 }
 
-void logPrint(const char* format,...){
-    va_list vptr;
-    va_start(vptr,format);
-    FCGX_VFPrintF(errStream,format,vptr);
-    FCGX_FFlush(errStream);
+// reads until the socket is drained, as edge-triggered epoll requires, or
+// until the buffered input reaches MAX_PENDING_OUTPUT while requests are
+// held back
+bool FcgiConnection::readInput(){
+    readPaused = false;
+    while(!readClosed){
+        if(heldBack && inEnd - inStart >= MAX_PENDING_OUTPUT){
+            readPaused = true;
+            return true;
+        }
+        if(inEnd == in.size()){
+            if(inStart > 0){
+                memmove(in.data(),in.data() + inStart,inEnd - inStart);
+                inEnd -= inStart;
+                inStart = 0;
+            }
+            else{
+                in.resize(in.size() * 2);
+            }
+        }
+        ssize_t amount = recv(fd,in.data() + inEnd,in.size() - inEnd,0);
+        if(amount > 0){
+            inEnd += amount;
+        }
+        else if(amount == 0){
+            readClosed = true;
+        }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK){
+            return true;
+        }
+        else if(errno != EINTR){
+            return false;
+        }
+    }
+    return true;
 }
 
-void logString(string str){
-    FCGX_WriteString(str,errStream);
+bool FcgiConnection::flush(){
+    while(outPos < out.length()){
+        ssize_t amount = send(fd,out.data() + outPos,out.length() - outPos,MSG_NOSIGNAL);
+        if(amount > 0){
+            outPos += amount;
+        }
+        else if(amount < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return true;
+        }
+        else if(amount < 0 && errno != EINTR){
+            return false;
+        }
+    }
+    out.clear();
+    outPos = 0;
+    return true;
 }
 
-void writeString(string str){
-    FCGX_WriteString(str,outStream);
+// Called as a request writes its response.  Once more than
+// MAX_PENDING_OUTPUT is queued, blocks until the web server has taken
+// enough of it, so that a result streamed to a slow reader doesn't pile up
+// in memory.  The worker's other connections wait meanwhile.  Returns false
+// if the peer fails or takes nothing for SEND_TIMEOUT seconds.
+bool FcgiConnection::waitForOutput(){
+    while(out.length() - outPos > MAX_PENDING_OUTPUT){
+        struct pollfd pfd = {fd,POLLOUT,0};
+        int ready = poll(&pfd,1,SEND_TIMEOUT * 1000);
+        if(ready < 0 && errno == EINTR){
+            continue;
+        }
+        if(ready <= 0 || !flush()){
+            return false;
+        }
+    }
+    // output that has been sent is only dropped once all of it has, so it
+    // is trimmed here while more keeps being queued
+    if(outPos >= MAX_PENDING_OUTPUT){
+        out.erase(0,outPos);
+        outPos = 0;
+    }
+    return true;
 }
 
-std::string getConfigFilename(){
-    return FCGX_GetParam("SCRIPT_FILENAME",envp);
+void FcgiConnection::runRequest(fcgi::ServerRequest* request){
+    if(!request->keepConn){
+        closing = true;
+    }
+    if(request->aborted){
+        protocol.finish(request,out);
+        return;
+    }
+    FastCgiRequestContext ctx(*this,*request);
+    processRequest(ctx);
+    ctx.finish();
 }
 
-std::string getRequestContent(){
-    return FCGX_ReadString(inStream);
+// Runs the requests that are complete and decodes more records once they
+// have all run, so that a connection holds at most one batch of decoded
+// requests.  A web server that doesn't set KEEP_CONN gets its connection
+// closed after the response.
+void FcgiConnection::processRecords(){
+    heldBack = false;
+    while(true){
+        while(readyPos < ready.size()){
+            if(out.length() - outPos >= MAX_PENDING_OUTPUT){
+                heldBack = true;
+                break;
+            }
+            runRequest(ready[readyPos++]);
+        }
+        if(heldBack){
+            break;
+        }
+        ready.clear();
+        readyPos = 0;
+        if(closing || inStart == inEnd){
+            break;
+        }
+        long used = protocol.consume(in.data() + inStart,inEnd - inStart,out,ready);
+        if(used < 0){
+            fprintf(stderr,"FastCGI protocol error; closing the connection\n");
+            broken = true;
+            closing = true;
+            break;
+        }
+        inStart += used;
+        if(protocol.isCloseRequested()){
+            closing = true;
+        }
+        if(ready.empty()){
+            break;
+        }
+    }
+    if(inStart == inEnd){
+        inStart = 0;
+        inEnd = 0;
+    }
+
+    // input left in the socket while requests were held back
+    if(readPaused && !heldBack && !closing){
+        if(readInput()){
+            processRecords();
+        }
+        else{
+            broken = true;
+            closing = true;
+        }
+    }
 }
 
-std::string getQueryString(){
-    return FCGX_GetParam("QUERY_STRING",envp);
+///////////
+
+// true if FCGI_WEB_SERVER_ADDRS allows the peer of a TCP connection
+static bool isAllowedPeer(int fd){
+    if(webServerAddrs.empty()){
+        return true;
+    }
+    struct sockaddr_storage addr;
+    socklen_t length = sizeof(addr);
+    if(getpeername(fd,(struct sockaddr*)&addr,&length) < 0){
+        return false;
+    }
+    char text[INET6_ADDRSTRLEN];
+    if(addr.ss_family == AF_INET){
+        inet_ntop(AF_INET,&((struct sockaddr_in*)&addr)->sin_addr,text,sizeof(text));
+    }
+    else if(addr.ss_family == AF_INET6){
+        inet_ntop(AF_INET6,&((struct sockaddr_in6*)&addr)->sin6_addr,text,sizeof(text));
+    }
+    else{
+        // Unix domain sockets are governed by file permissions
+        return true;
+    }
+    for(const std::string& allowed: webServerAddrs){
+        if(allowed == text){
+            return true;
+        }
+    }
+    return false;
 }
 
-std::string getRestTarget(){
-    std::string restTarget;
-    restTarget += FCGX_GetParam("REQUEST_METHOD",envp);
-    restTarget += FCGX_GetParam("PATH_INFO",envp);
-    return restTarget;
+// a worker's epoll loop; every worker waits on the listening sockets and
+// serves the connections it accepts
+//
+// Once told to stop, a worker stops accepting and closes each connection
+// as soon as it has no request open, including keep-alive connections
+// between requests.  It returns when none are left, or after drainTimeout
+// seconds.
+class Worker{
+    int epollFd;
+    std::vector<FcgiConnection*> connections;
+    bool draining;
+    struct timespec deadline;
+
+    void acceptConnections(){
+        for(int listenFd: listenFds){
+            acceptConnections(listenFd);
+        }
+    }
+
+    void acceptConnections(int listenFd){
+        while(true){
+            int fd = accept4(listenFd,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0){
+                if(errno == EINTR || errno == ECONNABORTED){
+                    continue;
+                }
+                if(errno != EAGAIN && errno != EWOULDBLOCK){
+                    perror("accept");
+                }
+                return;
+            }
+            if(!isAllowedPeer(fd)){
+                close(fd);
+                continue;
+            }
+            // fails harmlessly on Unix domain sockets
+            int one = 1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+            FcgiConnection* connection = new FcgiConnection(fd);
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = connection;
+            if(epoll_ctl(epollFd,EPOLL_CTL_ADD,fd,&event) < 0){
+                perror("epoll_ctl");
+                delete connection;
+                continue;
+            }
+            connection->slot = connections.size();
+            connections.push_back(connection);
+        }
+    }
+
+    void closeConnection(FcgiConnection* connection){
+        FcgiConnection* last = connections.back();
+        connections[connection->slot] = last;
+        last->slot = connection->slot;
+        connections.pop_back();
+        delete connection;
+    }
+
+    // returns false if the connection should be closed now
+    bool handleEvent(FcgiConnection* connection,uint32_t events){
+        if(events & EPOLLERR){
+            return false;
+        }
+        if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)){
+            if(!connection->readInput()){
+                return false;
+            }
+        }
+        // requests held back by queued output run once it drains, here or
+        // on a later EPOLLOUT
+        do{
+            connection->processRecords();
+            if(!connection->flush() || connection->broken){
+                return false;
+            }
+        }while(connection->heldBack && connection->outPos == connection->out.length());
+        return !connection->isDone();
+    }
+
+    void startDraining(){
+        draining = true;
+        clock_gettime(CLOCK_MONOTONIC,&deadline);
+        deadline.tv_sec += drainTimeout;
+        // the stop event is never consumed, so that every worker sees it
+        epoll_ctl(epollFd,EPOLL_CTL_DEL,stopFd,NULL);
+        for(int listenFd: listenFds){
+            epoll_ctl(epollFd,EPOLL_CTL_DEL,listenFd,NULL);
+        }
+        // requests already in the socket buffers are served first
+        for(size_t i=connections.size(); i>0; i--){
+            FcgiConnection* connection = connections[i-1];
+            if(!handleEvent(connection,EPOLLIN) || connection->isIdle()){
+                closeConnection(connection);
+            }
+        }
+    }
+
+    // milliseconds left to drain, or -1 when not draining
+    int drainMillis(){
+        if(!draining){
+            return -1;
+        }
+        struct timespec now;
+        clock_gettime(CLOCK_MONOTONIC,&now);
+        long millis = (deadline.tv_sec - now.tv_sec) * 1000 + (deadline.tv_nsec - now.tv_nsec) / 1000000;
+        return millis > 0 ? (int)millis : 0;
+    }
+
+public:
+    void run(){
+        draining = false;
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(epollFd < 0){
+            perror("epoll_create1");
+            return;
+        }
+        // only one worker is woken per incoming connection
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+        for(int listenFd: listenFds){
+            if(epoll_ctl(epollFd,EPOLL_CTL_ADD,listenFd,&event) < 0){
+                perror("epoll_ctl");
+                return;
+            }
+        }
+        event.events = EPOLLIN;
+        event.data.ptr = &stopFd;
+        if(epoll_ctl(epollFd,EPOLL_CTL_ADD,stopFd,&event) < 0){
+            perror("epoll_ctl");
+            return;
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        while(!draining || !connections.empty()){
+            int timeout = drainMillis();
+            if(timeout == 0){
+                fprintf(stderr,"closing %zu connections with requests still open\n",connections.size());
+                break;
+            }
+            int count = epoll_wait(epollFd,events,MAX_EVENTS,timeout);
+            if(count < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                perror("epoll_wait");
+                break;
+            }
+            // draining closes connections, so it waits until no event in
+            // this batch can refer to them
+            bool stopped = false;
+            for(int i=0; i<count; i++){
+                FcgiConnection* connection = (FcgiConnection*)events[i].data.ptr;
+                if(events[i].data.ptr == &stopFd){
+                    stopped = true;
+                }
+                else if(connection == NULL){
+                    acceptConnections();
+                }
+                else if(!handleEvent(connection,events[i].events) || (draining && connection->isIdle())){
+                    closeConnection(connection);
+                }
+            }
+            if(stopped){
+                startDraining();
+            }
+        }
+        while(!connections.empty()){
+            closeConnection(connections.back());
+        }
+        close(epollFd);
+    }
+};
+
+static void* workerMain(void*){
+    Worker worker;
+    worker.run();
+    return NULL;
 }
 
-void logException(const std::exception& ex){
-    //@breakpoint
-    logPrint("Exception: %s\n",ex.what());
-    FCGX_PutS(ex.what(),outStream);
-    FCGX_FFlush(outStream);
+static void onStop(int){
+    int saved = errno;
+    uint64_t one = 1;
+    if(write(stopFd,&one,sizeof(one)) < 0){
+        //the counter can't overflow in practice
+    }
+    errno = saved;
 }
 
-void logException(const std::string& ex){
-    //@breakpoint
-    logPrint("Exception: %s\n",ex.c_str()); 
-    FCGX_PutS(ex.c_str(),outStream);
-    FCGX_FFlush(outStream);
+// runs the worker threads of this process until SIGTERM or SIGINT, and
+// their open requests have finished
+static int serve(){
+    stopFd = eventfd(0,EFD_NONBLOCK | EFD_CLOEXEC);
+    if(stopFd < 0){
+        perror("eventfd");
+        return 1;
+    }
+    struct sigaction action;
+    memset(&action,0,sizeof(action));
+    sigemptyset(&action.sa_mask);
+    action.sa_handler = onStop;
+    sigaction(SIGTERM,&action,NULL);
+    sigaction(SIGINT,&action,NULL);
+
+    // the main thread doubles as the last worker
+    std::vector<pthread_t> workers(threads-1);
+    for(pthread_t& worker: workers){
+        pthread_create(&worker,NULL,workerMain,NULL);
+    }
+    workerMain(NULL);
+    for(pthread_t& worker: workers){
+        pthread_join(worker,NULL);
+    }
+    return 0;
 }
 
+static void usage(const char* name){
+    fprintf(stderr,"usage: %s [options]\n",name);
+    fprintf(stderr,"  -t threads    number of event loop threads; 0 uses one per core (default: 1)\n");
+    fprintf(stderr,"  -p processes  fork this many copies under a supervisor that restarts them;\n");
+    fprintf(stderr,"                0 uses one per core (default: 1)\n");
+    fprintf(stderr,"  -a host:port  listen on a TCP address\n");
+    fprintf(stderr,"  -s socket     listen on a Unix domain socket\n");
+    fprintf(stderr,"  -b bytes      largest request body accepted (default: 1048576)\n");
+    fprintf(stderr,"  -u socket     take the listening sockets from the process serving on\n");
+    fprintf(stderr,"                this handoff socket, then serve it for the next restart\n");
+    fprintf(stderr,"  -g seconds    time open requests get to finish on SIGTERM or handoff\n");
+    fprintf(stderr,"                (default: 30)\n");
+    fprintf(stderr,"By default the listening socket is inherited as file descriptor 0 from\n");
+    fprintf(stderr,"the web server or spawn-fcgi.\n");
 }
 
-int main(){
-    while(FCGX_Accept(&minibar::inStream,&minibar::outStream,&minibar::errStream,&minibar::envp) >= 0){
-        minibar::processRequest();
+}
+
+int main(int argc,char** argv){
+    long& threads = minibar::threads;
+    long processes = 1;
+    std::string host;
+    std::string port;
+    std::string socketPath;
+    std::string handoffPath;
+    int opt;
+
+    while((opt = getopt(argc,argv,"t:p:a:s:b:u:g:")) != -1){
+        switch(opt){
+        case 't':
+            threads = strtol(optarg,NULL,10);
+            break;
+        case 'p':
+            processes = strtol(optarg,NULL,10);
+            break;
+        case 'a':
+            if(!minibar::parseListenAddress(optarg,host,port)){
+                minibar::usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            socketPath = optarg;
+            break;
+        case 'b':
+            minibar::maxBodyLength = strtoul(optarg,NULL,10);
+            break;
+        case 'u':
+            handoffPath = optarg;
+            break;
+        case 'g':
+            minibar::drainTimeout = strtol(optarg,NULL,10);
+            break;
+        default:
+            minibar::usage(argv[0]);
+            return 1;
+        }
     }
-    return 0;
+    if(threads == 0){
+        threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(processes == 0){
+        processes = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(threads < 1 || processes < 1 || minibar::drainTimeout < 0 || optind != argc){
+        minibar::usage(argv[0]);
+        return 1;
+    }
+
+    // The handoff socket for the next restart is bound under a temporary
+    // name before any sockets are taken over, since the old process stops
+    // once it has handed them over and nothing may fail after that.  It is
+    // renamed into place afterwards.
+    int handoffFd = -1;
+    std::string pendingPath;
+    if(!handoffPath.empty()){
+        pendingPath = handoffPath + "." + std::to_string(getpid());
+        handoffFd = minibar::listenHandoff(pendingPath);
+        if(handoffFd < 0){
+            return 1;
+        }
+    }
+
+    // Worker processes on TCP get a socket each, bound with SO_REUSEPORT so
+    // the kernel balances connections between them.  Other sockets are
+    // shared.  Sockets handed over by a running process are used as they
+    // are, whatever the options say.
+    std::vector<int> listeners;
+    if(!handoffPath.empty() && minibar::takeOverListeners(handoffPath,listeners)){
+        fprintf(stderr,"took over %zu listening sockets\n",listeners.size());
+    }
+    else if(!socketPath.empty()){
+        listeners.push_back(minibar::listenUnix(socketPath));
+    }
+    else if(!port.empty()){
+        for(int i=0; i<processes; i++){
+            listeners.push_back(minibar::listenTcp(host,port,processes > 1));
+        }
+    }
+    else{
+        int listening = 0;
+        socklen_t length = sizeof(listening);
+        if(getsockopt(minibar::FCGI_LISTENSOCK_FILENO,SOL_SOCKET,SO_ACCEPTCONN,&listening,&length) < 0 || !listening){
+            fprintf(stderr,"%s: standard input is not a listening socket; use -a or -s\n",argv[0]);
+            listeners.push_back(-1);
+        }
+        else{
+            fcntl(minibar::FCGI_LISTENSOCK_FILENO,F_SETFL,fcntl(minibar::FCGI_LISTENSOCK_FILENO,F_GETFL) | O_NONBLOCK);
+            listeners.push_back(minibar::FCGI_LISTENSOCK_FILENO);
+        }
+    }
+    for(int fd: listeners){
+        if(fd < 0){
+            if(!pendingPath.empty()){
+                unlink(pendingPath.c_str());
+            }
+            return 1;
+        }
+    }
+    // a failure here leaves the sockets served, just not handed on
+    if(!pendingPath.empty() && rename(pendingPath.c_str(),handoffPath.c_str()) < 0){
+        perror(handoffPath.c_str());
+    }
+
+    // comma separated addresses of the web servers allowed to connect
+    const char* addrs = getenv("FCGI_WEB_SERVER_ADDRS");
+    if(addrs != NULL){
+        std::string list = addrs;
+        size_t start = 0;
+        while(start <= list.length()){
+            size_t comma = std::min(list.find(',',start),list.length());
+            std::string addr = list.substr(start,comma - start);
+            if(!addr.empty()){
+                minibar::webServerAddrs.push_back(addr);
+            }
+            start = comma + 1;
+        }
+    }
+    minibar::maxConnections = sysconf(_SC_OPEN_MAX);
+
+    signal(SIGPIPE,SIG_IGN);
+
+    // a handoff needs a process that holds the sockets while workers drain
+    if(handoffFd < 0 && processes == 1){
+        minibar::listenFds = listeners;
+        return minibar::serve();
+    }
+    return minibar::superviseWorkers(processes,[&](int index){
+        // every socket is served, even when more were handed over than
+        // there are processes
+        std::vector<int>& own = minibar::listenFds;
+        for(size_t i=index % listeners.size(); i<listeners.size(); i+=processes){
+            own.push_back(listeners[i]);
+        }
+        for(int fd: listeners){
+            if(std::find(own.begin(),own.end(),fd) == own.end()){
+                close(fd);
+            }
+        }
+        // one thread per process runs on a core of its own
+        if(threads == 1){
+            minibar::pinToCpu(index);
+        }
+        return minibar::serve();
+    },handoffFd,[&](){
+        // the replacement now owns the handoff socket's path
+        return minibar::handOffListeners(handoffFd,listeners);
+    });
 }
@@ -0,0 +1,362 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <algorithm>
+
+#include "fcgiproto.h"
+
+namespace minibar{
+
+namespace fcgi{
+
+Header parseHeader(const unsigned char* data){
+    Header header;
+    header.version = data[0];
+    header.type = data[1];
+    header.requestId = (data[2] << 8) | data[3];
+    header.contentLength = (data[4] << 8) | data[5];
+    header.paddingLength = data[6];
+    return header;
+}
+
+void appendHeader(std::string& out,int type,int requestId,int contentLength,int paddingLength){
+    out += (char)VERSION_1;
+    out += (char)type;
+    out += (char)((requestId >> 8) & 0xff);
+    out += (char)(requestId & 0xff);
+    out += (char)((contentLength >> 8) & 0xff);
+    out += (char)(contentLength & 0xff);
+    out += (char)paddingLength;
+    out += (char)0;
+}
+
+void appendStream(std::string& out,int type,int requestId,std::string_view content){
+    do{
+        size_t length = std::min(content.length(),(size_t)MAX_CONTENT_LENGTH);
+        // pad records to a multiple of 8 bytes, as recommended by the spec
+        int padding = (8 - (length % 8)) % 8;
+        appendHeader(out,type,requestId,length,padding);
+        out.append(content.data(),length);
+        out.append(padding,'\0');
+        content.remove_prefix(length);
+    }while(!content.empty());
+}
+
+void appendBeginRequest(std::string& out,int requestId,int role,int flags){
+    appendHeader(out,BEGIN_REQUEST,requestId,8);
+    out += (char)((role >> 8) & 0xff);
+    out += (char)(role & 0xff);
+    out += (char)flags;
+    out.append(5,'\0');
+}
+
+void appendEndRequest(std::string& out,int requestId,uint32_t appStatus,int protocolStatus){
+    appendHeader(out,END_REQUEST,requestId,8);
+    out += (char)((appStatus >> 24) & 0xff);
+    out += (char)((appStatus >> 16) & 0xff);
+    out += (char)((appStatus >> 8) & 0xff);
+    out += (char)(appStatus & 0xff);
+    out += (char)protocolStatus;
+    out.append(3,'\0');
+}
+
+static void appendLength(std::string& out,size_t length){
+    if(length < 128){
+        out += (char)length;
+    }
+    else{
+        out += (char)(((length >> 24) & 0x7f) | 0x80);
+        out += (char)((length >> 16) & 0xff);
+        out += (char)((length >> 8) & 0xff);
+        out += (char)(length & 0xff);
+    }
+}
+
+void appendNameValue(std::string& out,std::string_view name,std::string_view value){
+    appendLength(out,name.length());
+    appendLength(out,value.length());
+    out.append(name);
+    out.append(value);
+}
+
+static bool readLength(const char*& pos,const char* end,size_t& length){
+    if(pos == end) return false;
+    const unsigned char* p = (const unsigned char*)pos;
+    if((p[0] & 0x80) == 0){
+        length = p[0];
+        pos++;
+        return true;
+    }
+    if(end - pos < 4) return false;
+    length = ((size_t)(p[0] & 0x7f) << 24) | (p[1] << 16) | (p[2] << 8) | p[3];
+    pos += 4;
+    return true;
+}
+
+bool readNameValue(const char*& pos,const char* end,std::string_view& name,std::string_view& value){
+    const char* p = pos;
+    size_t nameLength,valueLength;
+    if(!readLength(p,end,nameLength) || !readLength(p,end,valueLength)){
+        return false;
+    }
+    if((size_t)(end - p) < nameLength + valueLength){
+        return false;
+    }
+    name = std::string_view(p,nameLength);
+    value = std::string_view(p+nameLength,valueLength);
+    pos = p + nameLength + valueLength;
+    return true;
+}
+
+///////////
+
+// picks the parameters minibar uses out of a finished PARAMS stream, by
+// name length first so most names are skipped after one comparison
+static bool indexParams(ServerRequest& request){
+    const char* pos = request.params.data();
+    const char* end = pos + request.params.length();
+    std::string_view name,value;
+    while(pos < end){
+        if(!readNameValue(pos,end,name,value)){
+            return false;
+        }
+        switch(name.length()){
+        case 9:
+            if(name == "PATH_INFO") request.values[PARAM_PATH_INFO] = value;
+            break;
+        case 12:
+            if(name == "QUERY_STRING") request.values[PARAM_QUERY_STRING] = value;
+            break;
+        case 14:
+            if(name == "REQUEST_METHOD") request.values[PARAM_REQUEST_METHOD] = value;
+            break;
+        case 15:
+            if(name == "SCRIPT_FILENAME") request.values[PARAM_SCRIPT_FILENAME] = value;
+            break;
+        }
+    }
+    return true;
+}
+
+ServerConnection::ServerConnection(int maxConnections,int maxRequests,size_t maxBodyLength){
+    this->activeCount = 0;
+    this->maxConnections = maxConnections;
+    this->maxRequests = maxRequests;
+    this->maxBodyLength = maxBodyLength;
+    this->closeRequested = false;
+}
+
+long ServerConnection::consume(const char* data,size_t length,std::string& out,
+    std::vector<ServerRequest*>& ready){
+
+    size_t pos = 0;
+    while(length - pos >= HEADER_LENGTH){
+        Header header = parseHeader((const unsigned char*)data + pos);
+        if(header.version != VERSION_1){
+            return -1;
+        }
+        size_t recordLength = HEADER_LENGTH + header.contentLength + header.paddingLength;
+        if(length - pos < recordLength){
+            break;
+        }
+        if(!handleRecord(header,data + pos + HEADER_LENGTH,out,ready)){
+            return -1;
+        }
+        pos += recordLength;
+    }
+    return pos;
+}
+
+bool ServerConnection::handleRecord(const Header& header,const char* content,std::string& out,
+    std::vector<ServerRequest*>& ready){
+
+    int id = header.requestId;
+    if(id == NULL_REQUEST_ID){
+        if(header.type != GET_VALUES){
+            appendHeader(out,UNKNOWN_TYPE,NULL_REQUEST_ID,8);
+            out += (char)header.type;
+            out.append(7,'\0');
+            return true;
+        }
+        std::string values;
+        const char* pos = content;
+        const char* end = content + header.contentLength;
+        std::string_view name,value;
+        while(pos < end){
+            if(!readNameValue(pos,end,name,value)){
+                return false;
+            }
+            if(name == "FCGI_MAX_CONNS"){
+                appendNameValue(values,name,std::to_string(maxConnections));
+            }
+            else if(name == "FCGI_MAX_REQS"){
+                appendNameValue(values,name,std::to_string(maxRequests));
+            }
+            else if(name == "FCGI_MPXS_CONNS"){
+                appendNameValue(values,name,"1");
+            }
+        }
+        appendStream(out,GET_VALUES_RESULT,NULL_REQUEST_ID,values);
+        return true;
+    }
+
+    ServerRequest* request = (size_t)id < requests.size() ? requests[id].get() : NULL;
+    bool active = request != NULL && request->id != NULL_REQUEST_ID;
+    const unsigned char* body = (const unsigned char*)content;
+
+    switch(header.type){
+    case BEGIN_REQUEST:
+        if(header.contentLength < 8 || active){
+            return false;
+        }
+        if(((body[0] << 8) | body[1]) != RESPONDER){
+            appendEndRequest(out,id,0,UNKNOWN_ROLE);
+            return true;
+        }
+        if(activeCount >= maxRequests){
+            appendEndRequest(out,id,0,OVERLOADED);
+            return true;
+        }
+        if((size_t)id >= requests.size()){
+            requests.resize(id + 1);
+        }
+        if(!requests[id]){
+            requests[id].reset(new ServerRequest());
+        }
+        request = requests[id].get();
+        request->id = id;
+        request->keepConn = (body[2] & KEEP_CONN) != 0;
+        request->paramsDone = false;
+        request->stdinDone = false;
+        request->aborted = false;
+        request->params.clear();
+        request->body.clear();
+        for(std::string_view& value: request->values){
+            value = std::string_view();
+        }
+        activeCount++;
+        return true;
+
+    case ABORT_REQUEST:
+        if(!active){
+            return true;
+        }
+        if(request->paramsDone && request->stdinDone){
+            // already handed out; it is ended by finish()
+            request->aborted = true;
+        }
+        else{
+            appendEndRequest(out,id,0,REQUEST_COMPLETE);
+            if(!request->keepConn){
+                closeRequested = true;
+            }
+            release(request);
+        }
+        return true;
+
+    case PARAMS:
+        if(!active || request->paramsDone){
+            return true;
+        }
+        if(request->params.length() + header.contentLength > MAX_PARAMS_LENGTH){
+            refuse(request,"431 Request Header Fields Too Large",out);
+            return true;
+        }
+        if(header.contentLength > 0){
+            request->params.append(content,header.contentLength);
+            return true;
+        }
+        request->paramsDone = true;
+        if(!indexParams(*request)){
+            return false;
+        }
+        break;
+
+    case STDIN:
+        if(!active || request->stdinDone){
+            return true;
+        }
+        if(request->body.length() + header.contentLength > maxBodyLength){
+            refuse(request,"413 Content Too Large",out);
+            return true;
+        }
+        if(header.contentLength > 0){
+            request->body.append(content,header.contentLength);
+            return true;
+        }
+        request->stdinDone = true;
+        break;
+
+    default:
+        // DATA is only sent to filters; anything else is ignored, as the
+        // spec allows for records of an unknown request
+        return true;
+    }
+
+    if(request->paramsDone && request->stdinDone){
+        ready.push_back(request);
+    }
+    return true;
+}
+
+void ServerConnection::finish(ServerRequest* request,std::string& out){
+    appendEndRequest(out,request->id,0,REQUEST_COMPLETE);
+    release(request);
+}
+
+// Answers a request that is still arriving with an error status and ends
+// it, so that its buffers stop growing.  The rest of its records are
+// ignored, as for any request that isn't active.
+void ServerConnection::refuse(ServerRequest* request,const char* status,std::string& out){
+    std::string response = "Status: ";
+    response += status;
+    response += "\r\nContent-type: text/plain\r\n\r\n";
+    response += status;
+    response += '\n';
+    appendStream(out,STDOUT,request->id,response);
+    appendStream(out,STDOUT,request->id,"");
+    appendEndRequest(out,request->id,0,REQUEST_COMPLETE);
+    if(!request->keepConn){
+        closeRequested = true;
+    }
+    release(request);
+}
+
+void ServerConnection::release(ServerRequest* request){
+    request->id = NULL_REQUEST_ID;
+    activeCount--;
+    // slots are reused, but not with the memory of an unusually large request
+    if(request->body.capacity() > 1024 * 1024){
+        std::string().swap(request->body);
+    }
+}
+
+}
+
+}
@@ -39,6 +39,7 @@ either expressed or implied, of the FreeBSD Project.
 #include <string.h>
 #include <pthread.h>
 #include "htpasswd.h"
+#include "utils.h"
 
 namespace minibar{
 
@@ -48,26 +49,7 @@ REGISTER_DB(htpasswd,htpasswd::HtPasswdDb::Create);
 
 namespace htpasswd{
 
-
-///////// 
-
-struct RAIILock{
-    pthread_mutex_t* mutex;
-
-    RAIILock(pthread_mutex_t* mutex){
-        this->mutex = mutex;
-        lock();
-    }
-    ~RAIILock(){
-        unlock();
-    }
-    void lock(){
-        pthread_mutex_lock(mutex);
-    }
-    void unlock(){
-        pthread_mutex_unlock(mutex);
-    }
-};
+using minibar::RAIILock;
 
 
 ///////// 
@@ -117,12 +99,12 @@ void HtPasswdDbConnection::bind(int idx,Json::Value value){
     }
 }
 
-void HtPasswdDbConnection::bind(Json::Value value){
+void HtPasswdDbConnection::bind(const Json::Value& value){
     bind(bindIndex+1,value);
     bindIndex++;
 }
 
-void HtPasswdDbConnection::bind(string name,Json::Value value){
+void HtPasswdDbConnection::bind(const string& name,const Json::Value& value){
     if(name.compare("username")){
         bind(HTPASSWD_USERNAME_IDX,value);
     }
@@ -0,0 +1,1151 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <string>
+#include <vector>
+
+#include "utils.h"
+#include "minibar.h"
+#include "httpproto.h"
+#include "listener.h"
+#include "supervisor.h"
+#ifdef MINIBAR_IO_URING
+#include "uring.h"
+#endif
+
+namespace minibar{
+
+enum{
+    READ_SIZE = 16384,
+    // response bytes gathered before an HTTP/1.1 response switches from
+    // Content-Length to chunked encoding
+    CHUNK_SIZE = 65536,
+    // queued output above which pipelined requests wait for the client, and
+    // a streamed response waits for it to be sent
+    MAX_PENDING_OUTPUT = 1024 * 1024,
+    // seconds a streamed response waits for the client to take any of it
+    SEND_TIMEOUT = 30,
+    MAX_EVENTS = 64,
+    // io_uring submission queue size, and receive buffers shared by all of a
+    // worker's connections
+    RING_ENTRIES = 256,
+    RECV_BUFFERS = 256
+};
+
+struct ServerOptions{
+    std::string configFile;
+    std::string host;
+    std::string port;
+    std::string socketPath;
+    long threads;
+    long processes;
+    int keepAliveTimeout;       // seconds a connection may sit idle
+    size_t maxBodyLength;
+    bool ioUring;               // serve with io_uring rather than epoll
+};
+
+static ServerOptions options;
+static int listenFd = -1;
+
+// One client connection, owned by the worker thread that accepted it.
+// Requests are run in the order they arrive, so pipelined responses are
+// queued in order without any bookkeeping.
+class HttpConnection{
+    bool continueSent;
+
+    void reject(int status);
+
+protected:
+    std::vector<char> in;       // unprocessed input is [inStart,inEnd)
+    size_t inStart;
+    size_t inEnd;
+    bool readPaused;            // stopped reading with input still buffered
+
+    void reserveInput(size_t length);
+
+public:
+    int fd;
+    size_t slot;                // index in the worker's connection list
+    time_t lastActive;
+
+    std::string out;            // queued output is [outPos,out.length())
+    size_t outPos;
+    bool closing;               // close once the queued output is sent
+    bool readClosed;            // the client has finished sending
+    bool broken;                // the client has gone; output is dropped
+    bool heldBack;              // requests wait for queued output to drain
+
+    // per request buffers, kept for their capacity
+    std::string restTarget;
+    std::string pending;
+
+    HttpConnection(int fd);
+    virtual ~HttpConnection();
+
+    virtual bool readInput();
+    virtual bool flush();
+    virtual bool waitForOutput();
+    void processRequests();
+
+    // true once the connection can be closed
+    bool isDone(){
+        return outPos == out.length() && (closing || readClosed);
+    }
+};
+
+// RequestContext over one request of an HttpConnection.  The body is used
+// in place in the connection's input buffer.  processRequest() writes a CGI
+// style head, which is turned into an HTTP status line; the body is sent
+// with Content-Length, unless it grows past CHUNK_SIZE on an HTTP/1.1
+// connection, in which case it is sent in chunks as it is produced.
+class HttpRequestContext: public RequestContext{
+    HttpConnection& connection;
+    const http::Request& request;
+    char* body;
+    size_t headLength;          // CGI head in 'pending', once complete
+    bool headSent;              // the rest of the body goes out chunked
+    bool failed;
+    std::string failure;
+
+    void sendChunk(){
+        std::string_view data(connection.pending);
+        if(!headSent){
+            http::appendResponseHead(connection.out,data.substr(0,headLength),-1,request.keepAlive);
+            data.remove_prefix(headLength);
+            headSent = true;
+        }
+        http::appendChunk(connection.out,data);
+        connection.pending.clear();
+        if(!connection.flush() || !connection.waitForOutput()){
+            connection.broken = true;
+        }
+    }
+
+public:
+    using RequestContext::logException;
+
+    HttpRequestContext(HttpConnection& connection,const http::Request& request,char* body):
+        connection(connection),request(request),body(body),
+        headLength(0),headSent(false),failed(false){
+        connection.pending.clear();
+    }
+
+    virtual void write(const char* data,size_t length){
+        if(connection.broken || failed){
+            return;
+        }
+        connection.pending.append(data,length);
+        if(headLength == 0 && !headSent){
+            headLength = http::findCgiHeadEnd(connection.pending);
+        }
+        if((headLength != 0 || headSent) && request.minorVersion >= 1 &&
+            connection.pending.length() - headLength >= CHUNK_SIZE){
+            sendChunk();
+            headLength = 0;
+        }
+    }
+
+    virtual void log(const char* data,size_t length){
+        fwrite(data,1,length,stderr);
+    }
+
+    virtual std::string_view getConfigFilename(){
+        return options.configFile;
+    }
+
+    virtual std::string_view getRequestContent(){
+        return std::string_view(body,request.contentLength);
+    }
+
+    virtual char* getMutableRequestContent(size_t& length){
+        length = request.contentLength;
+        return body;
+    }
+
+    virtual std::string_view getQueryString(){
+        return request.query;
+    }
+
+    virtual std::string_view getRestTarget(){
+        return connection.restTarget;
+    }
+
+    virtual void logException(std::string_view msg){
+        logPrint("Exception: %.*s\n",(int)msg.length(),msg.data());
+        failed = true;
+        failure = msg;
+    }
+
+    // queues whatever is left of the response
+    void finish(){
+        std::string& out = connection.out;
+        if(failed && headSent){
+            // too late to change the status; cut the body short instead
+            connection.closing = true;
+        }
+        else if(failed){
+            http::appendTextResponse(out,500,failure,request.keepAlive);
+        }
+        else if(headSent){
+            http::appendChunk(out,connection.pending);
+            http::appendLastChunk(out);
+        }
+        else if(headLength == 0){
+            http::appendTextResponse(out,500,connection.pending,request.keepAlive);
+        }
+        else{
+            std::string_view data(connection.pending);
+            http::appendResponseHead(out,data.substr(0,headLength),data.length() - headLength,
+                request.keepAlive);
+            out.append(data.substr(headLength));
+        }
+    }
+};
+
+///////////
+
+HttpConnection::HttpConnection(int fd): in(READ_SIZE){
+    this->fd = fd;
+    slot = 0;
+    lastActive = time(NULL);
+    inStart = 0;
+    inEnd = 0;
+    readPaused = false;
+    continueSent = false;
+    outPos = 0;
+    closing = false;
+    readClosed = false;
+    broken = false;
+    heldBack = false;
+}
+
+HttpConnection::~HttpConnection(){
+    close(fd);
+}
+
+// reads until the socket is drained, as edge-triggered epoll requires, or
+// until a full request and body are buffered and still waiting to be run
+bool HttpConnection::readInput(){
+    size_t maxInput = http::MAX_HEAD_LENGTH + options.maxBodyLength;
+    readPaused = false;
+    while(!readClosed){
+        if(inEnd - inStart >= maxInput){
+            readPaused = true;
+            return true;
+        }
+        if(inEnd == in.size()){
+            reserveInput(1);
+        }
+        ssize_t amount = recv(fd,in.data() + inEnd,in.size() - inEnd,0);
+        if(amount > 0){
+            inEnd += amount;
+        }
+        else if(amount == 0){
+            readClosed = true;
+        }
+        else if(errno == EAGAIN || errno == EWOULDBLOCK){
+            return true;
+        }
+        else if(errno != EINTR){
+            return false;
+        }
+    }
+    return true;
+}
+
+// makes room for 'length' more bytes at inEnd, moving buffered input to the
+// front before growing the buffer
+void HttpConnection::reserveInput(size_t length){
+    if(in.size() - inEnd >= length){
+        return;
+    }
+    if(inStart > 0){
+        memmove(in.data(),in.data() + inStart,inEnd - inStart);
+        inEnd -= inStart;
+        inStart = 0;
+    }
+    size_t size = in.size();
+    while(size - inEnd < length){
+        size *= 2;
+    }
+    in.resize(size);
+}
+
+bool HttpConnection::flush(){
+    while(outPos < out.length()){
+        ssize_t amount = send(fd,out.data() + outPos,out.length() - outPos,MSG_NOSIGNAL);
+        if(amount > 0){
+            outPos += amount;
+        }
+        else if(amount < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)){
+            return true;
+        }
+        else if(amount < 0 && errno != EINTR){
+            return false;
+        }
+    }
+    out.clear();
+    outPos = 0;
+    return true;
+}
+
+// Called as a response is streamed.  Once more than MAX_PENDING_OUTPUT is
+// queued, blocks until the client has taken enough of it, so that a large
+// result sent to a slow reader doesn't pile up in memory.  The thread's
+// other connections wait meanwhile.  Returns false if the client fails or
+// takes nothing for SEND_TIMEOUT seconds.
+bool HttpConnection::waitForOutput(){
+    while(out.length() - outPos > MAX_PENDING_OUTPUT){
+        struct pollfd pfd = {fd,POLLOUT,0};
+        int ready = poll(&pfd,1,SEND_TIMEOUT * 1000);
+        if(ready < 0 && errno == EINTR){
+            continue;
+        }
+        if(ready <= 0 || !flush()){
+            return false;
+        }
+    }
+    // output that has been sent is only dropped once all of it has, so it
+    // is trimmed here while more keeps being queued
+    if(outPos >= MAX_PENDING_OUTPUT){
+        out.erase(0,outPos);
+        outPos = 0;
+    }
+    return true;
+}
+
+void HttpConnection::reject(int status){
+    http::appendTextResponse(out,status,http::reasonPhrase(status),false);
+    closing = true;
+    inStart = inEnd;
+}
+
+void HttpConnection::processRequests(){
+    heldBack = false;
+    while(!closing && inStart < inEnd){
+        if(out.length() - outPos >= MAX_PENDING_OUTPUT){
+            heldBack = true;
+            break;
+        }
+        std::string_view data(in.data() + inStart,inEnd - inStart);
+        http::Request request;
+        http::ParseResult result = http::parseRequestHead(data,request);
+        if(result == http::PARSE_INCOMPLETE){
+            break;
+        }
+        if(result == http::PARSE_ERROR){
+            reject(request.errorStatus);
+            break;
+        }
+        if(request.chunked){
+            // request bodies must come with a Content-Length
+            reject(411);
+            break;
+        }
+        if(request.contentLength > options.maxBodyLength){
+            reject(413);
+            break;
+        }
+
+        size_t total = request.headLength + request.contentLength;
+        if(data.length() < total){
+            if(request.expectContinue && !continueSent && request.minorVersion >= 1){
+                out += "HTTP/1.1 100 Continue\r\n\r\n";
+                continueSent = true;
+            }
+            break;
+        }
+
+        restTarget.assign(request.method);
+        if(!http::decodePath(request.path,restTarget)){
+            reject(400);
+            break;
+        }
+
+        HttpRequestContext ctx(*this,request,in.data() + inStart + request.headLength);
+        processRequest(ctx);
+        ctx.finish();
+
+        inStart += total;
+        continueSent = false;
+        if(!request.keepAlive){
+            closing = true;
+        }
+    }
+    if(inStart == inEnd){
+        inStart = 0;
+        inEnd = 0;
+    }
+
+    // input left in the socket while the buffer was full
+    if(readPaused && !closing && inEnd - inStart < http::MAX_HEAD_LENGTH + options.maxBodyLength){
+        if(readInput()){
+            processRequests();
+        }
+        else{
+            broken = true;
+            closing = true;
+        }
+    }
+}
+
+///////////
+
+// a worker's epoll loop; every worker waits on the listening socket and
+// serves the connections it accepts
+class Worker{
+    int epollFd;
+    std::vector<HttpConnection*> connections;
+
+    void acceptConnections(){
+        while(true){
+            int fd = accept4(listenFd,NULL,NULL,SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if(fd < 0){
+                if(errno == EINTR || errno == ECONNABORTED){
+                    continue;
+                }
+                if(errno != EAGAIN && errno != EWOULDBLOCK){
+                    perror("accept");
+                }
+                return;
+            }
+            // fails harmlessly on Unix domain sockets
+            int one = 1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+            HttpConnection* connection = new HttpConnection(fd);
+            struct epoll_event event;
+            event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            event.data.ptr = connection;
+            if(epoll_ctl(epollFd,EPOLL_CTL_ADD,fd,&event) < 0){
+                perror("epoll_ctl");
+                delete connection;
+                continue;
+            }
+            connection->slot = connections.size();
+            connections.push_back(connection);
+        }
+    }
+
+    void closeConnection(HttpConnection* connection){
+        HttpConnection* last = connections.back();
+        connections[connection->slot] = last;
+        last->slot = connection->slot;
+        connections.pop_back();
+        delete connection;
+    }
+
+    // returns false if the connection should be closed now
+    bool handleEvent(HttpConnection* connection,uint32_t events){
+        if(events & EPOLLERR){
+            return false;
+        }
+        if(events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP)){
+            if(!connection->readInput()){
+                return false;
+            }
+        }
+        // pipelined requests held back by queued output run once it drains,
+        // here or on a later EPOLLOUT
+        do{
+            connection->processRequests();
+            if(!connection->flush() || connection->broken){
+                return false;
+            }
+        }while(connection->heldBack && connection->outPos == connection->out.length());
+        return !connection->isDone();
+    }
+
+    void closeIdle(time_t now){
+        for(size_t i=connections.size(); i-- > 0;){
+            if(now - connections[i]->lastActive > options.keepAliveTimeout){
+                closeConnection(connections[i]);
+            }
+        }
+    }
+
+public:
+    void run(){
+        epollFd = epoll_create1(EPOLL_CLOEXEC);
+        if(epollFd < 0){
+            perror("epoll_create1");
+            return;
+        }
+        // only one worker is woken per incoming connection
+        struct epoll_event event;
+        event.events = EPOLLIN | EPOLLEXCLUSIVE;
+        event.data.ptr = NULL;
+        if(epoll_ctl(epollFd,EPOLL_CTL_ADD,listenFd,&event) < 0){
+            perror("epoll_ctl");
+            return;
+        }
+
+        struct epoll_event events[MAX_EVENTS];
+        time_t lastSweep = time(NULL);
+        while(true){
+            int count = epoll_wait(epollFd,events,MAX_EVENTS,1000);
+            if(count < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                perror("epoll_wait");
+                break;
+            }
+            time_t now = time(NULL);
+            for(int i=0; i<count; i++){
+                HttpConnection* connection = (HttpConnection*)events[i].data.ptr;
+                if(connection == NULL){
+                    acceptConnections();
+                    continue;
+                }
+                connection->lastActive = now;
+                if(!handleEvent(connection,events[i].events)){
+                    closeConnection(connection);
+                }
+            }
+            if(now != lastSweep){
+                closeIdle(now);
+                lastSweep = now;
+            }
+        }
+        close(epollFd);
+    }
+};
+
+#ifdef MINIBAR_IO_URING
+
+class UringWorker;
+
+// An HttpConnection whose reads and writes are io_uring operations.  Input
+// arrives from a multishot receive and is copied out of the worker's shared
+// buffers.  Output is handed to the kernel a batch at a time: 'out' collects
+// the next batch while 'sending' is in flight, so neither buffer is touched
+// while the kernel may still read from it.
+class UringConnection: public HttpConnection{
+    UringWorker& worker;
+
+public:
+    std::string sending;        // in flight from sendPos
+    size_t sendPos;
+    bool receiving;             // a multishot receive is armed
+    bool cancelling;            // and is being cancelled
+    bool released;              // closed; freed once nothing is in flight
+
+    UringConnection(int fd,UringWorker& worker): HttpConnection(fd),worker(worker){
+        sendPos = 0;
+        receiving = false;
+        cancelling = false;
+        released = false;
+    }
+
+    // appends received data; returns false once a full request is waiting,
+    // to stop receiving until it has run
+    bool received(const char* data,size_t length){
+        reserveInput(length);
+        memcpy(in.data() + inEnd,data,length);
+        inEnd += length;
+        if(inEnd - inStart >= http::MAX_HEAD_LENGTH + options.maxBodyLength){
+            readPaused = true;
+            return false;
+        }
+        return true;
+    }
+
+    bool isPaused(){
+        return readPaused;
+    }
+
+    // true once the connection can be closed
+    bool isDone(){
+        return out.empty() && sending.empty() && (closing || readClosed);
+    }
+
+    bool startSend();
+    virtual bool readInput();
+    virtual bool flush();
+    virtual bool waitForOutput();
+};
+
+// a worker's io_uring loop, the counterpart of Worker.  Accepts and
+// receives are multishot, so an idle connection costs no submissions, and
+// every submission and completion of a loop iteration shares one
+// io_uring_enter() call.
+class UringWorker{
+    enum Operation{
+        OP_ACCEPT,
+        OP_RECV,
+        OP_SEND,
+        OP_CANCEL,
+        OP_MASK = 3
+    };
+
+    // a completion reaped early, while a response waited for its sends
+    struct Completion{
+        uint64_t userData;
+        int result;
+        uint32_t flags;
+    };
+
+    Uring ring;
+    BufferRing buffers;
+    std::vector<UringConnection*> connections;
+    std::vector<Completion> deferred;
+    bool accepting;
+
+    struct io_uring_sqe* prepare(uint8_t opcode,int fd,UringConnection* connection,Operation op){
+        struct io_uring_sqe* sqe = ring.getSqe();
+        if(sqe != NULL){
+            sqe->opcode = opcode;
+            sqe->fd = fd;
+            sqe->user_data = (uint64_t)(uintptr_t)connection | op;
+        }
+        return sqe;
+    }
+
+    void startAccept(){
+        struct io_uring_sqe* sqe = prepare(IORING_OP_ACCEPT,listenFd,NULL,OP_ACCEPT);
+        if(sqe != NULL){
+            sqe->ioprio = IORING_ACCEPT_MULTISHOT;
+            sqe->accept_flags = SOCK_CLOEXEC;
+            accepting = true;
+        }
+    }
+
+    bool startReceive(UringConnection* connection){
+        struct io_uring_sqe* sqe = prepare(IORING_OP_RECV,connection->fd,connection,OP_RECV);
+        if(sqe == NULL){
+            return false;
+        }
+        sqe->ioprio = IORING_RECV_MULTISHOT;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = 0;
+        connection->receiving = true;
+        return true;
+    }
+
+    void cancelReceive(UringConnection* connection){
+        struct io_uring_sqe* sqe = prepare(IORING_OP_ASYNC_CANCEL,-1,NULL,OP_CANCEL);
+        if(sqe != NULL){
+            sqe->addr = (uint64_t)(uintptr_t)connection | OP_RECV;
+            connection->cancelling = true;
+        }
+    }
+
+    void acceptConnection(int fd){
+        // fails harmlessly on Unix domain sockets
+        int one = 1;
+        setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+
+        UringConnection* connection = new UringConnection(fd,*this);
+        if(!startReceive(connection)){
+            delete connection;
+            return;
+        }
+        connection->slot = connections.size();
+        connections.push_back(connection);
+    }
+
+    // runs whatever requests are complete, sends their responses and keeps
+    // the receive armed; returns false if the connection should be closed
+    bool serve(UringConnection* connection){
+        connection->processRequests();
+        if(connection->broken || !connection->startSend()){
+            return false;
+        }
+        if(!connection->receiving && !connection->readClosed && !connection->closing &&
+            !connection->isPaused() && !startReceive(connection)){
+            return false;
+        }
+        return !connection->isDone();
+    }
+
+    // Closes the connection to the client.  Operations still in flight are
+    // ended by the shutdown, and the connection is freed with the last of them.
+    void closeConnection(UringConnection* connection){
+        UringConnection* last = connections.back();
+        connections[connection->slot] = last;
+        last->slot = connection->slot;
+        connections.pop_back();
+
+        connection->released = true;
+        if(connection->receiving || !connection->sending.empty()){
+            shutdown(connection->fd,SHUT_RDWR);
+        }
+        else{
+            delete connection;
+        }
+    }
+
+    void release(UringConnection* connection){
+        if(!connection->receiving && connection->sending.empty()){
+            delete connection;
+        }
+    }
+
+    void handleReceive(UringConnection* connection,int result,uint32_t flags){
+        if(!(flags & IORING_CQE_F_MORE)){
+            connection->receiving = false;
+            connection->cancelling = false;
+        }
+        if(result > 0){
+            uint16_t bufferId = flags >> IORING_CQE_BUFFER_SHIFT;
+            bool more = connection->released || connection->received(buffers.get(bufferId),result);
+            buffers.recycle(bufferId);
+            if(!more && connection->receiving && !connection->cancelling){
+                cancelReceive(connection);
+            }
+        }
+        else if(result == 0){
+            connection->readClosed = true;
+        }
+        else if(result != -ENOBUFS && result != -ECANCELED){
+            // rearmed by serve() if out of buffers, or once unpaused if cancelled
+            connection->broken = true;
+        }
+
+        if(connection->released){
+            release(connection);
+        }
+        else if(connection->broken || !serve(connection)){
+            closeConnection(connection);
+        }
+    }
+
+    void handleSend(UringConnection* connection,int result){
+        if(result < 0){
+            connection->sending.clear();
+            connection->broken = true;
+        }
+        else{
+            connection->sendPos += result;
+            if(connection->sendPos == connection->sending.length()){
+                connection->sending.clear();
+            }
+            else if(connection->released || !send(connection)){
+                connection->sending.clear();
+                connection->broken = true;
+            }
+        }
+
+        if(connection->released){
+            release(connection);
+        }
+        else if(connection->broken || !serve(connection)){
+            closeConnection(connection);
+        }
+    }
+
+    void handleCompletion(uint64_t userData,int result,uint32_t flags,time_t now){
+        UringConnection* connection = (UringConnection*)(uintptr_t)(userData & ~(uint64_t)OP_MASK);
+        Operation op = (Operation)(userData & OP_MASK);
+        if(op == OP_ACCEPT){
+            if(!(flags & IORING_CQE_F_MORE)){
+                accepting = false;
+            }
+            if(result >= 0){
+                acceptConnection(result);
+            }
+            else if(result != -EAGAIN && result != -ECONNABORTED && result != -EINTR){
+                errno = -result;
+                perror("accept");
+            }
+            return;
+        }
+        if(op == OP_CANCEL){
+            return;
+        }
+        connection->lastActive = now;
+        if(op == OP_RECV){
+            handleReceive(connection,result,flags);
+        }
+        else{
+            handleSend(connection,result);
+        }
+    }
+
+    void closeIdle(time_t now){
+        for(size_t i=connections.size(); i-- > 0;){
+            if(now - connections[i]->lastActive > options.keepAliveTimeout){
+                closeConnection(connections[i]);
+            }
+        }
+    }
+
+public:
+    UringWorker(): accepting(false){}
+
+    bool init(){
+        if(!ring.init(RING_ENTRIES) || !buffers.init(ring,0,RECV_BUFFERS,READ_SIZE)){
+            return false;
+        }
+        if(!probeReceive()){
+            errno = EOPNOTSUPP;
+            return false;
+        }
+        return true;
+    }
+
+    // Arms a multishot receive on a socketpair.  Linux 5.19 sets up the ring
+    // and the buffer ring but refuses multishot receives, which would
+    // otherwise fail every connection.
+    bool probeReceive(){
+        int fds[2];
+        if(socketpair(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0,fds) < 0){
+            return false;
+        }
+        bool received = false;
+        bool more = write(fds[1],"x",1) == 1;
+        close(fds[1]);
+        struct io_uring_sqe* sqe = prepare(IORING_OP_RECV,fds[0],NULL,OP_RECV);
+        if(sqe == NULL){
+            more = false;
+        }
+        else{
+            sqe->ioprio = IORING_RECV_MULTISHOT;
+            sqe->flags = IOSQE_BUFFER_SELECT;
+            sqe->buf_group = 0;
+        }
+        // the data, then end of stream, which ends the receive
+        while(more){
+            if(ring.submitAndWait(1,1000) < 0){
+                break;
+            }
+            struct io_uring_cqe* cqe = ring.peekCqe();
+            if(cqe == NULL){
+                break;
+            }
+            if(cqe->flags & IORING_CQE_F_BUFFER){
+                buffers.recycle(cqe->flags >> IORING_CQE_BUFFER_SHIFT);
+            }
+            if(cqe->res > 0){
+                received = true;
+            }
+            more = cqe->flags & IORING_CQE_F_MORE;
+            ring.advanceCqe();
+        }
+        close(fds[0]);
+        return received && !more;
+    }
+
+    // queues a send of what is left of the connection's 'sending' buffer
+    bool send(UringConnection* connection){
+        struct io_uring_sqe* sqe = prepare(IORING_OP_SEND,connection->fd,connection,OP_SEND);
+        if(sqe == NULL){
+            return false;
+        }
+        sqe->addr = (uint64_t)(uintptr_t)(connection->sending.data() + connection->sendPos);
+        sqe->len = connection->sending.length() - connection->sendPos;
+        sqe->msg_flags = MSG_NOSIGNAL;
+        return true;
+    }
+
+    bool resumeReceive(UringConnection* connection){
+        return connection->receiving || startReceive(connection);
+    }
+
+    void submit(){
+        ring.submit();
+    }
+
+    // Waits for the connection's send in flight to complete, while a
+    // response is being produced.  Other completions are kept for run() to
+    // handle, so no other connection is served meanwhile.  Returns false if
+    // the send fails or the client takes nothing for SEND_TIMEOUT seconds.
+    bool waitForSend(UringConnection* connection){
+        uint64_t sendData = (uint64_t)(uintptr_t)connection | OP_SEND;
+        time_t deadline = time(NULL) + SEND_TIMEOUT;
+        while(!connection->sending.empty()){
+            time_t now = time(NULL);
+            if(now >= deadline){
+                return false;
+            }
+            int result = ring.submitAndWait(1,(deadline - now) * 1000);
+            if(result < 0 && result != -EBUSY){
+                return false;
+            }
+            struct io_uring_cqe* cqe;
+            while((cqe = ring.peekCqe()) != NULL){
+                Completion completion = {cqe->user_data,cqe->res,cqe->flags};
+                ring.advanceCqe();
+                if(completion.userData != sendData){
+                    deferred.push_back(completion);
+                }
+                else if(completion.result < 0){
+                    connection->sending.clear();
+                    return false;
+                }
+                else{
+                    connection->sendPos += completion.result;
+                    deadline = time(NULL) + SEND_TIMEOUT;
+                    if(connection->sendPos == connection->sending.length()){
+                        connection->sending.clear();
+                    }
+                    else if(!send(connection)){
+                        connection->sending.clear();
+                        return false;
+                    }
+                }
+            }
+        }
+        return true;
+    }
+
+    void run(){
+        time_t lastSweep = time(NULL);
+        while(true){
+            if(!accepting){
+                startAccept();
+            }
+            int result = ring.submitAndWait(deferred.empty() ? 1 : 0,1000);
+            if(result < 0 && result != -EBUSY){
+                errno = -result;
+                perror("io_uring_enter");
+                break;
+            }
+            time_t now = time(NULL);
+            std::vector<Completion> early;
+            early.swap(deferred);
+            for(const Completion& completion: early){
+                handleCompletion(completion.userData,completion.result,completion.flags,now);
+            }
+            struct io_uring_cqe* cqe;
+            while((cqe = ring.peekCqe()) != NULL){
+                Completion completion = {cqe->user_data,cqe->res,cqe->flags};
+                ring.advanceCqe();
+                handleCompletion(completion.userData,completion.result,completion.flags,now);
+            }
+            if(now != lastSweep){
+                closeIdle(now);
+                lastSweep = now;
+            }
+        }
+    }
+};
+
+// hands queued output to the kernel, if nothing else is in flight
+bool UringConnection::startSend(){
+    if(!sending.empty() || out.empty()){
+        return true;
+    }
+    sending.swap(out);
+    sendPos = 0;
+    if(!worker.send(this)){
+        sending.clear();
+        return false;
+    }
+    return true;
+}
+
+// called by processRequests() once paused input has been consumed
+bool UringConnection::readInput(){
+    readPaused = false;
+    return worker.resumeReceive(this);
+}
+
+// called while a response is being produced, so chunks go out right away
+bool UringConnection::flush(){
+    if(!startSend()){
+        return false;
+    }
+    worker.submit();
+    return true;
+}
+
+// Called as a response is streamed.  The worker's loop doesn't run until
+// the request ends, so once more than MAX_PENDING_OUTPUT is queued behind
+// the send in flight, the send is waited for here and the queue handed to
+// the kernel in its place.
+bool UringConnection::waitForOutput(){
+    while(out.length() > MAX_PENDING_OUTPUT){
+        if(!worker.waitForSend(this) || !flush()){
+            return false;
+        }
+    }
+    return true;
+}
+
+#endif
+
+static void* workerMain(void*){
+#ifdef MINIBAR_IO_URING
+    if(options.ioUring){
+        UringWorker worker;
+        if(worker.init()){
+            worker.run();
+            return NULL;
+        }
+        perror("io_uring unavailable, using epoll");
+    }
+#endif
+    Worker worker;
+    worker.run();
+    return NULL;
+}
+
+// runs the worker threads of this process
+static int serve(){
+    // the main thread doubles as the last worker
+    std::vector<pthread_t> workers(options.threads-1);
+    for(pthread_t& worker: workers){
+        pthread_create(&worker,NULL,workerMain,NULL);
+    }
+    workerMain(NULL);
+    for(pthread_t& worker: workers){
+        pthread_join(worker,NULL);
+    }
+    return 0;
+}
+
+static void usage(const char* name){
+    fprintf(stderr,"usage: %s -c config [options]\n",name);
+    fprintf(stderr,"  -c config     minibar config file to serve\n");
+    fprintf(stderr,"  -a host:port  listen on a TCP address (default: 127.0.0.1:8080)\n");
+    fprintf(stderr,"  -s socket     listen on a Unix domain socket instead\n");
+    fprintf(stderr,"  -t threads    number of event loop threads; 0 uses one per core (default: 1)\n");
+    fprintf(stderr,"  -p processes  fork this many copies under a supervisor that restarts them;\n");
+    fprintf(stderr,"                0 uses one per core (default: 1)\n");
+    fprintf(stderr,"  -k seconds    idle keep-alive timeout (default: 30)\n");
+    fprintf(stderr,"  -b bytes      largest request body accepted (default: 1048576)\n");
+#ifdef MINIBAR_IO_URING
+    fprintf(stderr,"  -e            serve with epoll even where io_uring is available\n");
+#endif
+}
+
+}
+
+int main(int argc,char** argv){
+    minibar::ServerOptions& options = minibar::options;
+    options.host = "127.0.0.1";
+    options.port = "8080";
+    options.threads = 1;
+    options.processes = 1;
+    options.keepAliveTimeout = 30;
+    options.maxBodyLength = 1024 * 1024;
+#ifdef MINIBAR_IO_URING
+    options.ioUring = true;
+#else
+    options.ioUring = false;
+#endif
+    int opt;
+
+    while((opt = getopt(argc,argv,"c:a:s:t:p:k:b:e")) != -1){
+        switch(opt){
+        case 'c':
+            options.configFile = optarg;
+            break;
+        case 'a':
+            if(!minibar::parseListenAddress(optarg,options.host,options.port)){
+                minibar::usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's':
+            options.socketPath = optarg;
+            break;
+        case 't':
+            options.threads = strtol(optarg,NULL,10);
+            break;
+        case 'p':
+            options.processes = strtol(optarg,NULL,10);
+            break;
+        case 'k':
+            options.keepAliveTimeout = atoi(optarg);
+            break;
+        case 'b':
+            options.maxBodyLength = strtoul(optarg,NULL,10);
+            break;
+        case 'e':
+            options.ioUring = false;
+            break;
+        default:
+            minibar::usage(argv[0]);
+            return 1;
+        }
+    }
+    if(options.threads == 0){
+        options.threads = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(options.processes == 0){
+        options.processes = sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if(options.configFile.empty() || options.threads < 1 || options.processes < 1 || optind != argc){
+        minibar::usage(argv[0]);
+        return 1;
+    }
+
+    signal(SIGPIPE,SIG_IGN);
+
+    // Worker processes on TCP get a socket each, bound with SO_REUSEPORT so
+    // the kernel balances connections between them.  The supervisor keeps
+    // them open, so connections queued on a crashed worker's socket are
+    // picked up by its replacement.
+    std::vector<int> listeners;
+    int listenerCount = options.socketPath.empty() ? options.processes : 1;
+    for(int i=0; i<listenerCount; i++){
+        int fd = options.socketPath.empty() ?
+            minibar::listenTcp(options.host,options.port,options.processes > 1) :
+            minibar::listenUnix(options.socketPath);
+        if(fd < 0){
+            return 1;
+        }
+        listeners.push_back(fd);
+    }
+
+    if(options.processes == 1){
+        minibar::listenFd = listeners[0];
+        return minibar::serve();
+    }
+    return minibar::superviseWorkers(options.processes,[&](int index){
+        minibar::listenFd = listeners[index % listeners.size()];
+        for(int fd: listeners){
+            if(fd != minibar::listenFd){
+                close(fd);
+            }
+        }
+        // one thread per process runs on a core of its own
+        if(options.threads == 1){
+            minibar::pinToCpu(index);
+        }
+        return minibar::serve();
+    });
+}
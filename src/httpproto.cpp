@@ -0,0 +1,369 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string.h>
+#include <charconv>
+
+#include "httpproto.h"
+
+namespace minibar{
+
+namespace http{
+
+static bool isTokenChar(char ch){
+    if((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9')){
+        return true;
+    }
+    return strchr("!#$%&'*+-.^_`|~",ch) != NULL && ch != '\0';
+}
+
+static bool equalsIgnoreCase(std::string_view a,std::string_view b){
+    return a.length() == b.length() && strncasecmp(a.data(),b.data(),a.length()) == 0;
+}
+
+static std::string_view trim(std::string_view str){
+    while(!str.empty() && (str.front() == ' ' || str.front() == '\t')){
+        str.remove_prefix(1);
+    }
+    while(!str.empty() && (str.back() == ' ' || str.back() == '\t')){
+        str.remove_suffix(1);
+    }
+    return str;
+}
+
+// true if the comma separated 'list' contains 'token'
+static bool listContains(std::string_view list,std::string_view token){
+    while(!list.empty()){
+        size_t comma = list.find(',');
+        if(equalsIgnoreCase(trim(list.substr(0,comma)),token)){
+            return true;
+        }
+        if(comma == std::string_view::npos){
+            break;
+        }
+        list.remove_prefix(comma + 1);
+    }
+    return false;
+}
+
+static ParseResult fail(Request& request,int status){
+    request.errorStatus = status;
+    return PARSE_ERROR;
+}
+
+static ParseResult parseHeader(std::string_view name,std::string_view value,Request& request,
+    bool& hasContentLength,bool& hasConnection){
+
+    if(equalsIgnoreCase(name,"Content-Length")){
+        size_t length;
+        const char* last = value.data() + value.length();
+        auto result = std::from_chars(value.data(),last,length);
+        if(value.empty() || result.ec != std::errc() || result.ptr != last){
+            return fail(request,400);
+        }
+        // repeated lengths must agree
+        if(hasContentLength && length != request.contentLength){
+            return fail(request,400);
+        }
+        request.contentLength = length;
+        hasContentLength = true;
+    }
+    else if(equalsIgnoreCase(name,"Transfer-Encoding")){
+        // only chunked is understood, and it must be the last coding
+        size_t comma = value.rfind(',');
+        std::string_view last = trim(comma == std::string_view::npos ? value : value.substr(comma + 1));
+        if(!equalsIgnoreCase(last,"chunked")){
+            return fail(request,501);
+        }
+        request.chunked = true;
+    }
+    else if(equalsIgnoreCase(name,"Connection")){
+        if(listContains(value,"close")){
+            request.keepAlive = false;
+        }
+        else if(listContains(value,"keep-alive")){
+            request.keepAlive = true;
+        }
+        hasConnection = true;
+    }
+    else if(equalsIgnoreCase(name,"Expect")){
+        if(!equalsIgnoreCase(value,"100-continue")){
+            return fail(request,417);
+        }
+        request.expectContinue = true;
+    }
+    return PARSE_COMPLETE;
+}
+
+ParseResult parseRequestHead(std::string_view data,Request& request){
+    request.method = std::string_view();
+    request.path = std::string_view();
+    request.query = std::string_view();
+    request.minorVersion = 1;
+    request.headLength = 0;
+    request.contentLength = 0;
+    request.chunked = false;
+    request.keepAlive = true;
+    request.expectContinue = false;
+    request.errorStatus = 0;
+
+    // empty lines ahead of the request line are ignored
+    size_t start = 0;
+    while(data.length() - start >= 2 && data[start] == '\r' && data[start+1] == '\n'){
+        start += 2;
+    }
+    size_t end = data.find("\r\n\r\n",start);
+    if(end == std::string_view::npos){
+        if(data.length() > MAX_HEAD_LENGTH){
+            return fail(request,431);
+        }
+        return PARSE_INCOMPLETE;
+    }
+    if(end + 4 > MAX_HEAD_LENGTH){
+        return fail(request,431);
+    }
+    request.headLength = end + 4;
+
+    // request line: method SP target SP version
+    size_t lineEnd = data.find("\r\n",start);
+    std::string_view line = data.substr(start,lineEnd - start);
+    size_t space = line.find(' ');
+    if(space == 0 || space == std::string_view::npos){
+        return fail(request,400);
+    }
+    request.method = line.substr(0,space);
+    for(char ch: request.method){
+        if(!isTokenChar(ch)){
+            return fail(request,400);
+        }
+    }
+    line.remove_prefix(space + 1);
+    space = line.find(' ');
+    if(space == 0 || space == std::string_view::npos){
+        return fail(request,400);
+    }
+    std::string_view target = line.substr(0,space);
+    std::string_view version = line.substr(space + 1);
+
+    if(version == "HTTP/1.1"){
+        request.minorVersion = 1;
+    }
+    else if(version == "HTTP/1.0"){
+        request.minorVersion = 0;
+        request.keepAlive = false;
+    }
+    else if(version.substr(0,5) == "HTTP/"){
+        return fail(request,505);
+    }
+    else{
+        return fail(request,400);
+    }
+
+    // absolute-form targets are reduced to their path
+    if(target.substr(0,7) == "http://" || target.substr(0,8) == "https://"){
+        size_t slash = target.find('/',target.find("//") + 2);
+        target = slash == std::string_view::npos ? std::string_view("/") : target.substr(slash);
+    }
+    if(target.empty() || target[0] != '/'){
+        return fail(request,400);
+    }
+    for(char ch: target){
+        if((unsigned char)ch <= ' ' || ch == 0x7f){
+            return fail(request,400);
+        }
+    }
+    size_t question = target.find('?');
+    request.path = target.substr(0,question);
+    if(question != std::string_view::npos){
+        request.query = target.substr(question + 1);
+    }
+
+    // header fields
+    bool hasContentLength = false;
+    bool hasConnection = false;
+    size_t pos = lineEnd + 2;
+    while(pos < end + 2){
+        lineEnd = data.find("\r\n",pos);
+        line = data.substr(pos,lineEnd - pos);
+        pos = lineEnd + 2;
+
+        size_t colon = line.find(':');
+        if(colon == 0 || colon == std::string_view::npos){
+            return fail(request,400);
+        }
+        // also rejects obsolete line folding and space before the colon
+        std::string_view name = line.substr(0,colon);
+        for(char ch: name){
+            if(!isTokenChar(ch)){
+                return fail(request,400);
+            }
+        }
+        std::string_view value = trim(line.substr(colon + 1));
+        if(parseHeader(name,value,request,hasContentLength,hasConnection) == PARSE_ERROR){
+            return PARSE_ERROR;
+        }
+    }
+
+    // a request with both framings could be read two ways; refuse it
+    if(request.chunked && hasContentLength){
+        return fail(request,400);
+    }
+    return PARSE_COMPLETE;
+}
+
+static int hexValue(char ch){
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+bool decodePath(std::string_view path,std::string& out){
+    while(!path.empty()){
+        size_t percent = path.find('%');
+        out.append(path.substr(0,percent));
+        if(percent == std::string_view::npos){
+            break;
+        }
+        if(path.length() - percent < 3){
+            return false;
+        }
+        int high = hexValue(path[percent+1]);
+        int low = hexValue(path[percent+2]);
+        if(high < 0 || low < 0 || (high == 0 && low == 0)){
+            return false;
+        }
+        out += (char)((high << 4) | low);
+        path.remove_prefix(percent + 3);
+    }
+    return true;
+}
+
+const char* reasonPhrase(int status){
+    switch(status){
+    case 100: return "Continue";
+    case 200: return "OK";
+    case 400: return "Bad Request";
+    case 401: return "Unauthorized";
+    case 404: return "Not Found";
+    case 405: return "Method Not Allowed";
+    case 408: return "Request Timeout";
+    case 411: return "Length Required";
+    case 413: return "Content Too Large";
+    case 417: return "Expectation Failed";
+    case 431: return "Request Header Fields Too Large";
+    case 500: return "Internal Server Error";
+    case 501: return "Not Implemented";
+    case 503: return "Service Unavailable";
+    case 505: return "HTTP Version Not Supported";
+    default:  return "Unknown";
+    }
+}
+
+size_t findCgiHeadEnd(std::string_view data){
+    size_t end = data.find("\r\n\r\n");
+    return end == std::string_view::npos ? 0 : end + 4;
+}
+
+static void appendNumber(std::string& out,size_t value,int base = 10){
+    char buf[24];
+    out.append(buf,std::to_chars(buf,buf + sizeof(buf),value,base).ptr - buf);
+}
+
+static void appendFraming(std::string& out,long contentLength,bool keepAlive){
+    if(contentLength < 0){
+        out += "Transfer-Encoding: chunked\r\n";
+    }
+    else{
+        out += "Content-Length: ";
+        appendNumber(out,contentLength);
+        out += "\r\n";
+    }
+    if(!keepAlive){
+        out += "Connection: close\r\n";
+    }
+    out += "\r\n";
+}
+
+void appendResponseHead(std::string& out,std::string_view cgiHead,long contentLength,bool keepAlive){
+    std::string_view status = "200 OK";
+    size_t headerStart = out.length();
+    out += "HTTP/1.1 200 OK\r\n";
+
+    while(!cgiHead.empty()){
+        size_t lineEnd = cgiHead.find("\r\n");
+        std::string_view line = cgiHead.substr(0,lineEnd);
+        cgiHead.remove_prefix(lineEnd == std::string_view::npos ? cgiHead.length() : lineEnd + 2);
+        if(line.empty()){
+            break;
+        }
+        if(line.length() > 7 && equalsIgnoreCase(line.substr(0,7),"Status:")){
+            status = trim(line.substr(7));
+        }
+        else{
+            out.append(line);
+            out += "\r\n";
+        }
+    }
+    if(status != "200 OK"){
+        std::string statusLine = "HTTP/1.1 ";
+        statusLine.append(status);
+        statusLine += "\r\n";
+        out.replace(headerStart,17,statusLine);
+    }
+    appendFraming(out,contentLength,keepAlive);
+}
+
+void appendTextResponse(std::string& out,int status,std::string_view body,bool keepAlive){
+    out += "HTTP/1.1 ";
+    appendNumber(out,status);
+    out += ' ';
+    out += reasonPhrase(status);
+    out += "\r\nContent-Type: text/plain\r\n";
+    appendFraming(out,body.length(),keepAlive);
+    out.append(body);
+}
+
+void appendChunk(std::string& out,std::string_view data){
+    if(data.empty()){
+        return;
+    }
+    appendNumber(out,data.length(),16);
+    out += "\r\n";
+    out.append(data);
+    out += "\r\n";
+}
+
+void appendLastChunk(std::string& out){
+    out += "0\r\n\r\n";
+}
+
+}
+
+}
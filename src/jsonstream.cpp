@@ -0,0 +1,250 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <math.h>
+#include <charconv>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "jsonstream.h"
+
+namespace minibar{
+
+static const char hexDigits[] = "0123456789abcdef";
+
+// the first character from 'p' that must be escaped: a quote, a backslash
+// or a control character; sixteen bytes are checked at a time
+static const char* findEscape(const char* p,const char* end){
+#ifdef __SSE2__
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while(end - p >= 16){
+        __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+        __m128i stops = _mm_or_si128(
+            _mm_or_si128(_mm_cmpeq_epi8(chunk,quote),_mm_cmpeq_epi8(chunk,backslash)),
+            _mm_cmpeq_epi8(_mm_min_epu8(chunk,control),chunk));
+        unsigned mask = _mm_movemask_epi8(stops);
+        if(mask != 0){
+            return p + __builtin_ctz(mask);
+        }
+        p += 16;
+    }
+#endif
+    while(p != end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20){
+        p++;
+    }
+    return p;
+}
+
+// runs that need no escaping are copied in one append
+template<typename String>
+static void appendEscaped(String& out,std::string_view str){
+    const char* p = str.data();
+    const char* end = p + str.length();
+    out += '"';
+    while(true){
+        const char* run = p;
+        p = findEscape(p,end);
+        out.append(run,p - run);
+        if(p == end){
+            break;
+        }
+        char ch = *p++;
+        switch(ch){
+        case '"':  out += "\\\""; break;
+        case '\\': out += "\\\\"; break;
+        case '\b': out += "\\b"; break;
+        case '\f': out += "\\f"; break;
+        case '\n': out += "\\n"; break;
+        case '\r': out += "\\r"; break;
+        case '\t': out += "\\t"; break;
+        default:
+            out += "\\u00";
+            out += hexDigits[(ch >> 4) & 0xf];
+            out += hexDigits[ch & 0xf];
+        }
+    }
+    out += '"';
+}
+
+void appendJsonString(std::string& out,std::string_view str){
+    appendEscaped(out,str);
+}
+
+void appendJsonString(std::pmr::string& out,std::string_view str){
+    appendEscaped(out,str);
+}
+
+///////////
+
+JsonStreamWriter::JsonStreamWriter(WriteFn sink,size_t flushSize,std::pmr::memory_resource* resource):
+    buffer(resource){
+    this->sink = sink;
+    this->flushSize = flushSize;
+    this->needComma = false;
+    buffer.reserve(flushSize + flushSize/4);
+}
+
+void JsonStreamWriter::writeRaw(std::string_view data){
+    buffer.append(data);
+    checkFlush();
+}
+
+void JsonStreamWriter::beginArray(){
+    separate();
+    buffer += '[';
+    needComma = false;
+}
+
+void JsonStreamWriter::endArray(){
+    buffer += ']';
+    needComma = true;
+    checkFlush();
+}
+
+void JsonStreamWriter::beginObject(){
+    separate();
+    buffer += '{';
+    needComma = false;
+}
+
+void JsonStreamWriter::endObject(){
+    buffer += '}';
+    needComma = true;
+    checkFlush();
+}
+
+void JsonStreamWriter::key(std::string_view name){
+    separate();
+    appendJsonString(buffer,name);
+    buffer += ':';
+    needComma = false;
+}
+
+void JsonStreamWriter::escapedKey(std::string_view quotedKey){
+    separate();
+    buffer.append(quotedKey);
+    needComma = false;
+}
+
+void JsonStreamWriter::nullValue(){
+    separate();
+    buffer += "null";
+    checkFlush();
+}
+
+void JsonStreamWriter::boolValue(bool value){
+    separate();
+    buffer += value ? "true" : "false";
+    checkFlush();
+}
+
+void JsonStreamWriter::intValue(int64_t value){
+    char buf[32];
+    separate();
+    buffer.append(buf,std::to_chars(buf,buf + sizeof(buf),value).ptr - buf);
+    checkFlush();
+}
+
+void JsonStreamWriter::uintValue(uint64_t value){
+    char buf[32];
+    separate();
+    buffer.append(buf,std::to_chars(buf,buf + sizeof(buf),value).ptr - buf);
+    checkFlush();
+}
+
+// reals are written as the shortest text that reads back to the same value
+void JsonStreamWriter::realValue(double value){
+    char buf[32];
+    separate();
+    if(!isfinite(value)){
+        // JSON has no representation for NaN or infinity
+        buffer += "null";
+    }
+    else{
+        buffer.append(buf,std::to_chars(buf,buf + sizeof(buf),value).ptr - buf);
+    }
+    checkFlush();
+}
+
+void JsonStreamWriter::stringValue(std::string_view value){
+    separate();
+    appendJsonString(buffer,value);
+    checkFlush();
+}
+
+void JsonStreamWriter::value(const Json::Value& value){
+    switch(value.type()){
+    case Json::nullValue:
+        nullValue();
+        break;
+    case Json::intValue:
+        intValue(value.asLargestInt());
+        break;
+    case Json::uintValue:
+        uintValue(value.asLargestUInt());
+        break;
+    case Json::realValue:
+        realValue(value.asDouble());
+        break;
+    case Json::stringValue:
+        stringValue(value.asCString());
+        break;
+    case Json::booleanValue:
+        boolValue(value.asBool());
+        break;
+    case Json::arrayValue:
+        beginArray();
+        for(const Json::Value& item: value){
+            this->value(item);
+        }
+        endArray();
+        break;
+    case Json::objectValue:
+        beginObject();
+        for(auto it = value.begin(); it != value.end(); it++){
+            key(it.memberName());
+            this->value(*it);
+        }
+        endObject();
+        break;
+    }
+}
+
+void JsonStreamWriter::flush(){
+    if(!buffer.empty()){
+        sink(buffer.data(),buffer.length());
+        buffer.clear();
+    }
+}
+
+}
@@ -0,0 +1,693 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string.h>
+#include <algorithm>
+#include <charconv>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "utils.h"
+#include "jsontape.h"
+
+namespace minibar{
+
+enum{
+    MAX_DEPTH = 256
+};
+
+static bool isUtf8(const unsigned char* p,const unsigned char* end){
+    while(p != end){
+        unsigned char ch = *p;
+        if(ch < 0x80){
+            p++;
+            continue;
+        }
+        int count;
+        uint32_t min;
+        uint32_t code;
+        if((ch & 0xe0) == 0xc0){
+            count = 1; min = 0x80; code = ch & 0x1f;
+        }
+        else if((ch & 0xf0) == 0xe0){
+            count = 2; min = 0x800; code = ch & 0x0f;
+        }
+        else if((ch & 0xf8) == 0xf0){
+            count = 3; min = 0x10000; code = ch & 0x07;
+        }
+        else{
+            return false;
+        }
+        if(end - p <= count){
+            return false;
+        }
+        for(int i=1; i<=count; i++){
+            if((p[i] & 0xc0) != 0x80){
+                return false;
+            }
+            code = (code << 6) | (p[i] & 0x3f);
+        }
+        // no overlong forms, surrogates or code points past U+10FFFF
+        if(code < min || code > 0x10ffff || (code >= 0xd800 && code <= 0xdfff)){
+            return false;
+        }
+        p += count + 1;
+    }
+    return true;
+}
+
+static int hexValue(char ch){
+    if(ch >= '0' && ch <= '9') return ch - '0';
+    if(ch >= 'a' && ch <= 'f') return ch - 'a' + 10;
+    if(ch >= 'A' && ch <= 'F') return ch - 'A' + 10;
+    return -1;
+}
+
+static char* appendUtf8(char* out,uint32_t code){
+    if(code < 0x80){
+        *out++ = (char)code;
+    }
+    else if(code < 0x800){
+        *out++ = (char)(0xc0 | (code >> 6));
+        *out++ = (char)(0x80 | (code & 0x3f));
+    }
+    else if(code < 0x10000){
+        *out++ = (char)(0xe0 | (code >> 12));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+        *out++ = (char)(0x80 | (code & 0x3f));
+    }
+    else{
+        *out++ = (char)(0xf0 | (code >> 18));
+        *out++ = (char)(0x80 | ((code >> 12) & 0x3f));
+        *out++ = (char)(0x80 | ((code >> 6) & 0x3f));
+        *out++ = (char)(0x80 | (code & 0x3f));
+    }
+    return out;
+}
+
+// a decimal array index, as accepted by JsonChild()
+static bool parseIndex(std::string_view term,size_t& n){
+    const char* last = term.data() + term.length();
+    return !term.empty() && term.length() <= 9 && term[0] != '+' &&
+        std::from_chars(term.data(),last,n).ptr == last;
+}
+
+class TapeParser{
+    typedef JsonProjection::Node Node;
+
+    std::pmr::vector<JsonTape::Entry>& tape;
+    char* base;
+    char* p;
+    char* end;
+    bool validateUtf8;
+
+    [[noreturn]] void fail(const char* reason){
+        throw MinibarException("Invalid JSON at offset " + std::to_string(p - base) + ": " + reason);
+    }
+
+    void skipWhitespace(){
+        while(p != end && (*p == ' ' || *p == '\n' || *p == '\r' || *p == '\t')){
+            p++;
+        }
+    }
+
+    void expectColon(){
+        skipWhitespace();
+        if(p == end || *p != ':'){
+            fail("expected ':'");
+        }
+        p++;
+    }
+
+    // consumes the ',' or 'close' after a member or element; true at the
+    // end of the container
+    bool endOfContainer(char close,const char* reason){
+        skipWhitespace();
+        if(p != end && *p == ','){
+            p++;
+            return false;
+        }
+        if(p != end && *p == close){
+            p++;
+            return true;
+        }
+        fail(reason);
+    }
+
+    size_t push(JsonTape::Type type){
+        JsonTape::Entry entry;
+        entry.type = type;
+        entry.size = 0;
+        entry.next = tape.size() + 1;
+        entry.intValue = 0;
+        tape.push_back(entry);
+        return tape.size() - 1;
+    }
+
+    void pushString(std::string_view str){
+        JsonTape::Entry& entry = tape[push(JsonTape::STRING_VALUE)];
+        entry.string = str.data();
+        entry.size = str.length();
+    }
+
+    // reads the 4 hex digits after "\u"
+    uint32_t readHex4(){
+        if(end - p < 4) fail("truncated unicode escape");
+        uint32_t code = 0;
+        for(int i=0; i<4; i++){
+            int value = hexValue(p[i]);
+            if(value < 0) fail("invalid unicode escape");
+            code = (code << 4) | value;
+        }
+        p += 4;
+        return code;
+    }
+
+    // Reads the string starting after the opening quote.  With 'decode' set
+    // it is unescaped in place and returned; plain runs are found sixteen
+    // bytes at a time, and only moved once an escape has shifted the output
+    // behind the input.  Otherwise the string is only validated.
+    template<bool decode>
+    std::string_view scanString(){
+        char* start = p;
+        char* out = p;
+        bool nonAscii = false;
+
+        while(true){
+            char* run = p;
+#ifdef __SSE2__
+            const __m128i quote = _mm_set1_epi8('"');
+            const __m128i backslash = _mm_set1_epi8('\\');
+            const __m128i control = _mm_set1_epi8(0x1f);
+            while(end - p >= 16){
+                __m128i chunk = _mm_loadu_si128((const __m128i*)p);
+                __m128i stops = _mm_or_si128(
+                    _mm_or_si128(_mm_cmpeq_epi8(chunk,quote),_mm_cmpeq_epi8(chunk,backslash)),
+                    _mm_cmpeq_epi8(_mm_min_epu8(chunk,control),chunk));
+                unsigned stopMask = _mm_movemask_epi8(stops);
+                unsigned highMask = _mm_movemask_epi8(chunk);
+                if(stopMask != 0){
+                    int offset = __builtin_ctz(stopMask);
+                    nonAscii |= (highMask & ((1u << offset) - 1)) != 0;
+                    p += offset;
+                    break;
+                }
+                nonAscii |= highMask != 0;
+                p += 16;
+            }
+#endif
+            while(p != end && *p != '"' && *p != '\\' && (unsigned char)*p >= 0x20){
+                nonAscii |= (unsigned char)*p >= 0x80;
+                p++;
+            }
+            if constexpr(decode){
+                if(out != run){
+                    memmove(out,run,p - run);
+                }
+                out += p - run;
+            }
+
+            if(p == end){
+                fail("unterminated string");
+            }
+            if(*p == '"'){
+                break;
+            }
+            if(*p != '\\'){
+                fail("control character in string");
+            }
+
+            // escape sequence; the output is never longer than the input
+            p++;
+            if(p == end) fail("unterminated string");
+            char ch;
+            switch(*p++){
+            case '"':  ch = '"'; break;
+            case '\\': ch = '\\'; break;
+            case '/':  ch = '/'; break;
+            case 'b':  ch = '\b'; break;
+            case 'f':  ch = '\f'; break;
+            case 'n':  ch = '\n'; break;
+            case 'r':  ch = '\r'; break;
+            case 't':  ch = '\t'; break;
+            case 'u':{
+                uint32_t code = readHex4();
+                if(code >= 0xd800 && code <= 0xdbff){
+                    if(end - p < 2 || p[0] != '\\' || p[1] != 'u'){
+                        fail("unpaired surrogate in unicode escape");
+                    }
+                    p += 2;
+                    uint32_t low = readHex4();
+                    if(low < 0xdc00 || low > 0xdfff){
+                        fail("unpaired surrogate in unicode escape");
+                    }
+                    code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+                }
+                else if(code >= 0xdc00 && code <= 0xdfff){
+                    fail("unpaired surrogate in unicode escape");
+                }
+                if constexpr(decode){
+                    out = appendUtf8(out,code);
+                }
+                continue;
+            }
+            default:
+                p--;
+                fail("invalid escape");
+            }
+            if constexpr(decode){
+                *out++ = ch;
+            }
+        }
+
+        // escapes are plain ASCII, so an undecoded string validates the same
+        if constexpr(!decode){
+            out = p;
+        }
+        if(nonAscii && validateUtf8 && !isUtf8((unsigned char*)start,(unsigned char*)out)){
+            fail("string is not valid UTF-8");
+        }
+        p++;
+        return std::string_view(start,out - start);
+    }
+
+    // checks the number syntax; returns false for reals
+    bool scanNumber(){
+        bool integral = true;
+
+        if(p != end && *p == '-') p++;
+        if(p == end || *p < '0' || *p > '9') fail("invalid number");
+        if(*p == '0'){
+            p++;
+        }
+        else{
+            while(p != end && *p >= '0' && *p <= '9') p++;
+        }
+        if(p != end && *p == '.'){
+            integral = false;
+            p++;
+            if(p == end || *p < '0' || *p > '9') fail("invalid number");
+            while(p != end && *p >= '0' && *p <= '9') p++;
+        }
+        if(p != end && (*p == 'e' || *p == 'E')){
+            integral = false;
+            p++;
+            if(p != end && (*p == '+' || *p == '-')) p++;
+            if(p == end || *p < '0' || *p > '9') fail("invalid number");
+            while(p != end && *p >= '0' && *p <= '9') p++;
+        }
+        return integral;
+    }
+
+    void parseNumber(size_t index){
+        char* start = p;
+        bool integral = scanNumber();
+
+        JsonTape::Entry& entry = tape[index];
+        if(integral){
+            if(std::from_chars(start,p,entry.intValue).ec == std::errc()){
+                entry.type = JsonTape::INT_VALUE;
+                return;
+            }
+            if(*start != '-' && std::from_chars(start,p,entry.uintValue).ec == std::errc()){
+                entry.type = JsonTape::UINT_VALUE;
+                return;
+            }
+        }
+        // too large for an integer is read as a real, like jsoncpp does
+        entry.type = JsonTape::REAL_VALUE;
+        if(std::from_chars(start,p,entry.realValue).ec != std::errc()){
+            fail("number out of range");
+        }
+    }
+
+    void matchLiteral(const char* literal,size_t length){
+        if((size_t)(end - p) < length || memcmp(p,literal,length) != 0){
+            fail("unexpected character");
+        }
+        p += length;
+    }
+
+    // the selection to parse a child with; NULL keeps everything
+    static const Node* descend(const Node* child){
+        return child->all ? NULL : child;
+    }
+
+    // Parses a value onto the tape.  If 'select' is set, only the members
+    // and elements it names are kept; the rest are validated and skipped.
+    void parseValue(int depth,const Node* select){
+        if(depth > MAX_DEPTH){
+            fail("nesting too deep");
+        }
+        skipWhitespace();
+        if(p == end){
+            fail("unexpected end of input");
+        }
+
+        size_t index;
+        switch(*p){
+        case '{':
+            index = push(JsonTape::OBJECT_VALUE);
+            p++;
+            skipWhitespace();
+            if(p != end && *p == '}'){
+                p++;
+                break;
+            }
+            do{
+                skipWhitespace();
+                if(p == end || *p != '"'){
+                    fail("expected a member name");
+                }
+                p++;
+                if(select == NULL){
+                    pushString(scanString<true>());
+                    expectColon();
+                    parseValue(depth + 1,NULL);
+                    tape[index].size++;
+                    continue;
+                }
+                std::string_view key = scanString<true>();
+                expectColon();
+                const Node* child = select->child(key);
+                if(child != NULL){
+                    pushString(key);
+                    parseValue(depth + 1,descend(child));
+                    tape[index].size++;
+                }
+                else{
+                    skipValue(depth + 1);
+                }
+            } while(!endOfContainer('}',"expected ',' or '}'"));
+            break;
+        case '[':
+            index = push(JsonTape::ARRAY_VALUE);
+            p++;
+            skipWhitespace();
+            if(p != end && *p == ']'){
+                p++;
+                break;
+            }
+            do{
+                size_t n = tape[index].size;
+                const Node* child = select != NULL ? select->element(n) : NULL;
+                if(select == NULL || child != NULL){
+                    parseValue(depth + 1,select != NULL ? descend(child) : NULL);
+                }
+                else if(n < select->limit){
+                    // keeps the positions of later selected elements
+                    push(JsonTape::NULL_VALUE);
+                    skipValue(depth + 1);
+                }
+                else{
+                    skipValue(depth + 1);
+                    continue;
+                }
+                tape[index].size++;
+            } while(!endOfContainer(']',"expected ',' or ']'"));
+            break;
+        case '"':
+            p++;
+            pushString(scanString<true>());
+            return;
+        case 't':
+            matchLiteral("true",4);
+            push(JsonTape::TRUE_VALUE);
+            return;
+        case 'f':
+            matchLiteral("false",5);
+            push(JsonTape::FALSE_VALUE);
+            return;
+        case 'n':
+            matchLiteral("null",4);
+            push(JsonTape::NULL_VALUE);
+            return;
+        default:
+            parseNumber(push(JsonTape::NULL_VALUE));
+            return;
+        }
+        tape[index].next = tape.size();
+    }
+
+    // validates a value without adding it to the tape or decoding strings
+    void skipValue(int depth){
+        if(depth > MAX_DEPTH){
+            fail("nesting too deep");
+        }
+        skipWhitespace();
+        if(p == end){
+            fail("unexpected end of input");
+        }
+
+        switch(*p){
+        case '{':
+            p++;
+            skipWhitespace();
+            if(p != end && *p == '}'){
+                p++;
+                return;
+            }
+            do{
+                skipWhitespace();
+                if(p == end || *p != '"'){
+                    fail("expected a member name");
+                }
+                p++;
+                scanString<false>();
+                expectColon();
+                skipValue(depth + 1);
+            } while(!endOfContainer('}',"expected ',' or '}'"));
+            return;
+        case '[':
+            p++;
+            skipWhitespace();
+            if(p != end && *p == ']'){
+                p++;
+                return;
+            }
+            do{
+                skipValue(depth + 1);
+            } while(!endOfContainer(']',"expected ',' or ']'"));
+            return;
+        case '"':
+            p++;
+            scanString<false>();
+            return;
+        case 't':
+            matchLiteral("true",4);
+            return;
+        case 'f':
+            matchLiteral("false",5);
+            return;
+        case 'n':
+            matchLiteral("null",4);
+            return;
+        default:
+            scanNumber();
+            return;
+        }
+    }
+
+public:
+    TapeParser(std::pmr::vector<JsonTape::Entry>& tape,char* data,size_t length,bool validateUtf8):
+        tape(tape),base(data),p(data),end(data + length),validateUtf8(validateUtf8){
+        //do nothing
+    }
+
+    void parse(const Node* select){
+        parseValue(0,select);
+        skipWhitespace();
+        if(p != end){
+            fail("unexpected data after the document");
+        }
+    }
+};
+
+///////////
+
+JsonProjection::Node::Node(std::string_view term):
+    term(term),index(JsonTape::NOT_FOUND),all(false),limit(0){
+    size_t n;
+    if(parseIndex(term,n)){
+        index = n;
+    }
+}
+
+const JsonProjection::Node* JsonProjection::Node::child(std::string_view key) const{
+    for(const Node& node: children){
+        if(node.term == key){
+            return &node;
+        }
+    }
+    return NULL;
+}
+
+const JsonProjection::Node* JsonProjection::Node::element(size_t n) const{
+    if(n >= limit){
+        return NULL;
+    }
+    for(const Node& node: children){
+        if(node.index == n){
+            return &node;
+        }
+    }
+    return NULL;
+}
+
+JsonProjection::JsonProjection(): root(""){
+    //do nothing
+}
+
+void JsonProjection::add(const TokenSet& path,size_t start){
+    Node* node = &root;
+    for(size_t i=start; i<path.size() && !node->all; i++){
+        Node* next = NULL;
+        for(Node& child: node->children){
+            if(child.term == path[i]){
+                next = &child;
+            }
+        }
+        if(next == NULL){
+            node->children.push_back(Node(path[i]));
+            next = &node->children.back();
+            if(next->index != JsonTape::NOT_FOUND){
+                node->limit = std::max(node->limit,next->index + 1);
+            }
+        }
+        node = next;
+    }
+    // everything below a whole value is kept anyway
+    node->all = true;
+    node->children.clear();
+    node->limit = 0;
+}
+
+
+JsonTape::JsonTape(std::pmr::memory_resource* resource): tape(resource){
+    //do nothing
+}
+
+void JsonTape::parse(char* data,size_t length,bool validateUtf8,const JsonProjection* projection){
+    tape.clear();
+    const JsonProjection::Node* select = NULL;
+    if(projection != NULL && !projection->getRoot().all){
+        select = &projection->getRoot();
+    }
+    else{
+        // roughly one value per 8 bytes of typical request bodies
+        tape.reserve(length / 8 + 1);
+    }
+    TapeParser(tape,data,length,validateUtf8).parse(select);
+}
+
+size_t JsonTape::find(size_t index,std::string_view key) const{
+    if(tape[index].type != OBJECT_VALUE){
+        return NOT_FOUND;
+    }
+    size_t found = NOT_FOUND;
+    size_t i = index + 1;
+    for(uint32_t n=0; n<tape[index].size; n++){
+        if(getString(i) == key){
+            found = i + 1;
+        }
+        i = tape[i+1].next;
+    }
+    return found;
+}
+
+size_t JsonTape::element(size_t index,size_t n) const{
+    if(tape[index].type != ARRAY_VALUE || n >= tape[index].size){
+        return NOT_FOUND;
+    }
+    size_t i = index + 1;
+    while(n-- > 0){
+        i = tape[i].next;
+    }
+    return i;
+}
+
+size_t JsonTape::child(size_t index,std::string_view term) const{
+    size_t result = NOT_FOUND;
+    if(tape[index].type == OBJECT_VALUE){
+        result = find(index,term);
+    }
+    else if(tape[index].type == ARRAY_VALUE){
+        size_t n;
+        if(parseIndex(term,n)){
+            result = element(index,n);
+        }
+    }
+    if(result != NOT_FOUND && tape[result].type == NULL_VALUE){
+        return NOT_FOUND;
+    }
+    return result;
+}
+
+Json::Value JsonTape::toJson(size_t index) const{
+    const Entry& entry = tape[index];
+    switch(entry.type){
+    case FALSE_VALUE:
+        return Json::Value(false);
+    case TRUE_VALUE:
+        return Json::Value(true);
+    case INT_VALUE:
+        return Json::Value((Json::Int64)entry.intValue);
+    case UINT_VALUE:
+        return Json::Value((Json::UInt64)entry.uintValue);
+    case REAL_VALUE:
+        return Json::Value(entry.realValue);
+    case STRING_VALUE:
+        return Json::Value(entry.string,entry.string + entry.size);
+    case ARRAY_VALUE:{
+        Json::Value result(Json::arrayValue);
+        result.resize(entry.size);
+        size_t i = index + 1;
+        for(uint32_t n=0; n<entry.size; n++){
+            result[n] = toJson(i);
+            i = tape[i].next;
+        }
+        return result;
+    }
+    case OBJECT_VALUE:{
+        Json::Value result(Json::objectValue);
+        size_t i = index + 1;
+        for(uint32_t n=0; n<entry.size; n++){
+            result[std::string(getString(i))] = toJson(i+1);
+            i = tape[i+1].next;
+        }
+        return result;
+    }
+    default:
+        return Json::Value();
+    }
+}
+
+}
@@ -0,0 +1,243 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "listener.h"
+
+namespace minibar{
+
+enum{
+    // the most descriptors one SCM_RIGHTS message carries (SCM_MAX_FD)
+    MAX_HANDOFF_SOCKETS = 253,
+    // how long either side of a handoff waits for the other
+    HANDOFF_TIMEOUT = 5
+};
+
+static bool makeUnixAddress(const std::string& path,struct sockaddr_un& addr){
+    memset(&addr,0,sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if(path.length() >= sizeof(addr.sun_path)){
+        fprintf(stderr,"%s: socket path too long\n",path.c_str());
+        return false;
+    }
+    strcpy(addr.sun_path,path.c_str());
+    return true;
+}
+
+static void setHandoffTimeout(int fd){
+    struct timeval timeout = {HANDOFF_TIMEOUT,0};
+    setsockopt(fd,SOL_SOCKET,SO_RCVTIMEO,&timeout,sizeof(timeout));
+    setsockopt(fd,SOL_SOCKET,SO_SNDTIMEO,&timeout,sizeof(timeout));
+}
+
+int listenTcp(const std::string& host,const std::string& port,bool reusePort){
+    struct addrinfo hints;
+    struct addrinfo* addrs;
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    hints.ai_flags = AI_PASSIVE;
+    int result = getaddrinfo(host.empty() ? NULL : host.c_str(),port.c_str(),&hints,&addrs);
+    if(result != 0){
+        fprintf(stderr,"%s:%s: %s\n",host.c_str(),port.c_str(),gai_strerror(result));
+        return -1;
+    }
+
+    int fd = -1;
+    for(struct addrinfo* addr = addrs; addr != NULL; addr = addr->ai_next){
+        fd = socket(addr->ai_family,addr->ai_socktype | SOCK_NONBLOCK | SOCK_CLOEXEC,addr->ai_protocol);
+        if(fd < 0){
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd,SOL_SOCKET,SO_REUSEADDR,&one,sizeof(one));
+        if(reusePort && setsockopt(fd,SOL_SOCKET,SO_REUSEPORT,&one,sizeof(one)) < 0){
+            perror("SO_REUSEPORT");
+            close(fd);
+            fd = -1;
+            break;
+        }
+        if(bind(fd,addr->ai_addr,addr->ai_addrlen) == 0){
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    if(fd < 0){
+        perror("bind");
+        return -1;
+    }
+    if(listen(fd,SOMAXCONN) < 0){
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int listenUnix(const std::string& path){
+    struct sockaddr_un addr;
+    if(!makeUnixAddress(path,addr)){
+        return -1;
+    }
+    unlink(addr.sun_path);
+
+    int fd = socket(AF_UNIX,SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC,0);
+    if(fd < 0 || bind(fd,(struct sockaddr*)&addr,sizeof(addr)) < 0 || listen(fd,SOMAXCONN) < 0){
+        perror(path.c_str());
+        if(fd >= 0){
+            close(fd);
+        }
+        return -1;
+    }
+    return fd;
+}
+
+int listenHandoff(const std::string& path){
+    // the socket file is created with the umask in force at bind()
+    mode_t mask = umask(077);
+    int fd = listenUnix(path);
+    umask(mask);
+    return fd;
+}
+
+bool handOffListeners(int handoffFd,const std::vector<int>& listeners){
+    if(listeners.empty() || listeners.size() > MAX_HANDOFF_SOCKETS){
+        return false;
+    }
+    int fd = accept4(handoffFd,NULL,NULL,SOCK_CLOEXEC);
+    if(fd < 0){
+        if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR){
+            perror("accept");
+        }
+        return false;
+    }
+    setHandoffTimeout(fd);
+
+    size_t size = sizeof(int) * listeners.size();
+    std::vector<char> control(CMSG_SPACE(size));
+    char tag = 'L';
+    struct iovec iov = {&tag,1};
+    struct msghdr msg;
+    memset(&msg,0,sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+    cmsg->cmsg_level = SOL_SOCKET;
+    cmsg->cmsg_type = SCM_RIGHTS;
+    cmsg->cmsg_len = CMSG_LEN(size);
+    memcpy(CMSG_DATA(cmsg),listeners.data(),size);
+
+    // the sockets are only given up once the replacement has them
+    char ack = 0;
+    bool done = sendmsg(fd,&msg,MSG_NOSIGNAL) == 1 && recv(fd,&ack,1,0) == 1 && ack == 'A';
+    if(!done){
+        fprintf(stderr,"listener handoff failed; still serving\n");
+    }
+    close(fd);
+    return done;
+}
+
+bool takeOverListeners(const std::string& path,std::vector<int>& listeners){
+    struct sockaddr_un addr;
+    if(!makeUnixAddress(path,addr)){
+        return false;
+    }
+    int fd = socket(AF_UNIX,SOCK_STREAM | SOCK_CLOEXEC,0);
+    if(fd < 0){
+        return false;
+    }
+    // nothing listening is the usual case of a first start
+    if(connect(fd,(struct sockaddr*)&addr,sizeof(addr)) < 0){
+        close(fd);
+        return false;
+    }
+    setHandoffTimeout(fd);
+
+    std::vector<char> control(CMSG_SPACE(sizeof(int) * MAX_HANDOFF_SOCKETS));
+    char tag = 0;
+    struct iovec iov = {&tag,1};
+    struct msghdr msg;
+    memset(&msg,0,sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.data();
+    msg.msg_controllen = control.size();
+    ssize_t amount = recvmsg(fd,&msg,MSG_CMSG_CLOEXEC);
+
+    std::vector<int> received;
+    for(struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); amount == 1 && cmsg != NULL; cmsg = CMSG_NXTHDR(&msg,cmsg)){
+        if(cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS){
+            size_t count = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            const int* fds = (const int*)CMSG_DATA(cmsg);
+            received.insert(received.end(),fds,fds + count);
+        }
+    }
+    char ack = 'A';
+    if(amount != 1 || tag != 'L' || (msg.msg_flags & MSG_CTRUNC) || received.empty() ||
+        send(fd,&ack,1,MSG_NOSIGNAL) != 1){
+        fprintf(stderr,"%s: listener handoff failed\n",path.c_str());
+        for(int listener: received){
+            close(listener);
+        }
+        close(fd);
+        return false;
+    }
+    close(fd);
+    listeners.insert(listeners.end(),received.begin(),received.end());
+    return true;
+}
+
+bool parseListenAddress(const std::string& address,std::string& host,std::string& port){
+    size_t colon = address.rfind(':');
+    if(colon == std::string::npos){
+        return false;
+    }
+    host = address.substr(0,colon);
+    port = address.substr(colon + 1);
+    // [::1]:8080
+    if(host.length() >= 2 && host.front() == '[' && host.back() == ']'){
+        host = host.substr(1,host.length() - 2);
+    }
+    return !port.empty();
+}
+
+}
@@ -0,0 +1,740 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+// Load generator that talks FastCGI directly to minibar-fastcgi (or any
+// FastCGI responder) over a Unix or TCP socket, so the real binary can be
+// benchmarked without a web server in front of it.  With -H it speaks
+// HTTP/1.1 instead, to drive minibar-httpd.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <netdb.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <random>
+#include <algorithm>
+#include <fstream>
+
+#include "utils.h"
+#include "fcgiproto.h"
+
+namespace minibar{
+
+struct LoadRequest{
+    std::string encoded;    // complete FastCGI or HTTP request, ready to send
+    std::string target;
+};
+
+struct Scenario{
+    std::vector<LoadRequest> requests;
+    std::vector<int> schedule;      // request indices, repeated by weight and shuffled
+};
+
+struct Options{
+    std::string unixPath;
+    std::string host;
+    std::string port;
+    int connections;
+    long requests;                  // total requests; 0 = run for 'duration'
+    double duration;                // seconds
+    double rate;                    // open loop requests/sec across all connections; 0 = closed loop
+    bool keepConn;
+    bool http;
+    bool json;
+};
+
+// Latency histogram with buckets of roughly 3% width
+class LatencyHistogram{
+    enum{
+        SUB_BITS = 5,
+        SUB_COUNT = 1 << SUB_BITS,
+        BUCKETS = 60 * SUB_COUNT
+    };
+    std::vector<uint64_t> counts;
+    uint64_t total;
+    uint64_t maxValue;
+
+    static int bucketFor(uint64_t value){
+        if(value < SUB_COUNT) return value;
+        int msb = 63 - __builtin_clzll(value);
+        int shift = msb - SUB_BITS;
+        return (shift+1) * SUB_COUNT + (int)((value >> shift) - SUB_COUNT);
+    }
+    static uint64_t bucketLow(int bucket){
+        if(bucket < SUB_COUNT) return bucket;
+        int shift = bucket / SUB_COUNT - 1;
+        return (uint64_t)(bucket % SUB_COUNT + SUB_COUNT) << shift;
+    }
+
+public:
+    LatencyHistogram(): counts(BUCKETS,0),total(0),maxValue(0){}
+
+    void record(uint64_t value){
+        counts[std::min(bucketFor(value),(int)BUCKETS-1)]++;
+        total++;
+        maxValue = std::max(maxValue,value);
+    }
+
+    void merge(const LatencyHistogram& other){
+        for(int i=0; i<BUCKETS; i++){
+            counts[i] += other.counts[i];
+        }
+        total += other.total;
+        maxValue = std::max(maxValue,other.maxValue);
+    }
+
+    uint64_t count() const{
+        return total;
+    }
+
+    uint64_t max() const{
+        return maxValue;
+    }
+
+    uint64_t percentile(double p) const{
+        if(total == 0) return 0;
+        uint64_t rank = std::max<uint64_t>(1,(uint64_t)(p * total + 0.5));
+        uint64_t seen = 0;
+        for(int i=0; i<BUCKETS; i++){
+            seen += counts[i];
+            if(seen >= rank){
+                return std::min(bucketLow(i),maxValue);
+            }
+        }
+        return maxValue;
+    }
+
+    // counts per power-of-two range, as [low,count] pairs
+    Json::Value toJson() const{
+        Json::Value result;
+        result.resize(0);
+        uint64_t low = 0;
+        uint64_t rangeCount = 0;
+        for(int i=0; i<BUCKETS; i++){
+            if(i >= SUB_COUNT && i % SUB_COUNT == 0){
+                if(rangeCount > 0){
+                    Json::Value row;
+                    row.append((Json::UInt64)low);
+                    row.append((Json::UInt64)rangeCount);
+                    result.append(row);
+                }
+                low = bucketLow(i);
+                rangeCount = 0;
+            }
+            rangeCount += counts[i];
+        }
+        if(rangeCount > 0){
+            Json::Value row;
+            row.append((Json::UInt64)low);
+            row.append((Json::UInt64)rangeCount);
+            result.append(row);
+        }
+        return result;
+    }
+};
+
+struct Worker{
+    pthread_t thread;
+    int index;
+    const Options* options;
+    const Scenario* scenario;
+    long count;                     // requests to send; 0 = until the deadline
+    uint64_t deadline;
+    double interval;                // ns between sends in open loop mode
+
+    LatencyHistogram latency;       // microseconds
+    unsigned long completed;
+    unsigned long connectErrors;
+    unsigned long ioErrors;
+    unsigned long retries;
+    unsigned long protocolErrors;
+    unsigned long statusErrors;
+    uint64_t bytesReceived;
+    std::string input;              // HTTP response being read
+};
+
+static uint64_t nowNanos(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void sleepUntil(uint64_t nanos){
+    struct timespec ts;
+    ts.tv_sec = nanos / 1000000000ull;
+    ts.tv_nsec = nanos % 1000000000ull;
+    while(clock_nanosleep(CLOCK_MONOTONIC,TIMER_ABSTIME,&ts,NULL) == EINTR){
+        //retry
+    }
+}
+
+// encodes a scenario entry as BEGIN_REQUEST, PARAMS and STDIN records
+static std::string encodeRequest(const std::string& script,const std::string& target,
+    const std::string& query,const std::string& body,bool keepConn){
+
+    size_t slash = target.find('/');
+    std::string method = target.substr(0,slash);
+    std::string path = slash == std::string::npos ? "" : target.substr(slash);
+
+    std::string params;
+    fcgi::appendNameValue(params,"GATEWAY_INTERFACE","CGI/1.1");
+    fcgi::appendNameValue(params,"SERVER_PROTOCOL","HTTP/1.1");
+    fcgi::appendNameValue(params,"SCRIPT_FILENAME",script);
+    fcgi::appendNameValue(params,"REQUEST_METHOD",method);
+    fcgi::appendNameValue(params,"PATH_INFO",path);
+    fcgi::appendNameValue(params,"QUERY_STRING",query);
+    fcgi::appendNameValue(params,"CONTENT_TYPE","application/json");
+    fcgi::appendNameValue(params,"CONTENT_LENGTH",std::to_string(body.length()));
+
+    std::string out;
+    fcgi::appendBeginRequest(out,1,fcgi::RESPONDER,keepConn ? fcgi::KEEP_CONN : 0);
+    fcgi::appendStream(out,fcgi::PARAMS,1,params);
+    if(!params.empty()){
+        fcgi::appendStream(out,fcgi::PARAMS,1,"");
+    }
+    fcgi::appendStream(out,fcgi::STDIN,1,body);
+    if(!body.empty()){
+        fcgi::appendStream(out,fcgi::STDIN,1,"");
+    }
+    return out;
+}
+
+static std::string encodeHttpRequest(const std::string& target,const std::string& query,
+    const std::string& body,bool keepConn){
+
+    size_t slash = target.find('/');
+    std::string out = target.substr(0,slash);
+    out += ' ';
+    out += slash == std::string::npos ? "/" : target.substr(slash);
+    if(!query.empty()){
+        out += '?';
+        out += query;
+    }
+    out += " HTTP/1.1\r\nHost: minibar\r\n";
+    if(!body.empty()){
+        out += "Content-Type: application/json\r\nContent-Length: " + std::to_string(body.length()) + "\r\n";
+    }
+    if(!keepConn){
+        out += "Connection: close\r\n";
+    }
+    out += "\r\n";
+    out += body;
+    return out;
+}
+
+static void loadScenario(const char* filename,const Options& options,Scenario& scenario){
+    Json::Reader reader;
+    Json::Value root;
+
+    std::ifstream inf(filename);
+    std::string data((std::istreambuf_iterator<char>(inf)),
+    std::istreambuf_iterator<char>());
+
+    if(!reader.parse(data,root,false)){
+        throw MinibarException(reader.getFormattedErrorMessages());
+    }
+    if(!root.isObject() || !root["requests"].isArray()){
+        throw MinibarException("Scenario must be an object with a 'requests' array");
+    }
+
+    // relative config paths are resolved by minibar-fastcgi, from its own directory
+    std::string script = root.get("config","resources/test.mini").asString();
+    for(const Json::Value& item: root["requests"]){
+        std::string body;
+        if(item["body"].isString()){
+            body = item["body"].asString();
+        }
+        else if(!item["body"].isNull()){
+            Json::FastWriter writer;
+            body = writer.write(item["body"]);
+        }
+
+        LoadRequest request;
+        request.target = item["target"].asString();
+        std::string query = item.get("query","").asString();
+        if(options.http){
+            request.encoded = encodeHttpRequest(request.target,query,body,options.keepConn);
+        }
+        else{
+            request.encoded = encodeRequest(script,request.target,query,body,options.keepConn);
+        }
+
+        int weight = item.get("weight",1).asInt();
+        for(int i=0; i<weight; i++){
+            scenario.schedule.push_back(scenario.requests.size());
+        }
+        scenario.requests.push_back(request);
+    }
+    if(scenario.schedule.empty()){
+        throw MinibarException("Scenario has no requests");
+    }
+
+    std::mt19937 rng(42);
+    std::shuffle(scenario.schedule.begin(),scenario.schedule.end(),rng);
+}
+
+static int openConnection(const Options& options){
+    int fd;
+    if(!options.unixPath.empty()){
+        struct sockaddr_un addr;
+        memset(&addr,0,sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path,options.unixPath.c_str(),sizeof(addr.sun_path)-1);
+        fd = socket(AF_UNIX,SOCK_STREAM,0);
+        if(fd < 0) return -1;
+        if(connect(fd,(struct sockaddr*)&addr,sizeof(addr)) < 0){
+            close(fd);
+            return -1;
+        }
+        return fd;
+    }
+
+    struct addrinfo hints;
+    struct addrinfo* addrs;
+    memset(&hints,0,sizeof(hints));
+    hints.ai_family = AF_UNSPEC;
+    hints.ai_socktype = SOCK_STREAM;
+    if(getaddrinfo(options.host.c_str(),options.port.c_str(),&hints,&addrs) != 0){
+        return -1;
+    }
+    fd = -1;
+    for(struct addrinfo* ai = addrs; ai != NULL; ai = ai->ai_next){
+        fd = socket(ai->ai_family,ai->ai_socktype,ai->ai_protocol);
+        if(fd < 0) continue;
+        if(connect(fd,ai->ai_addr,ai->ai_addrlen) == 0){
+            int one = 1;
+            setsockopt(fd,IPPROTO_TCP,TCP_NODELAY,&one,sizeof(one));
+            break;
+        }
+        close(fd);
+        fd = -1;
+    }
+    freeaddrinfo(addrs);
+    return fd;
+}
+
+static bool sendAll(int fd,const std::string& data){
+    size_t sent = 0;
+    while(sent < data.length()){
+        ssize_t result = send(fd,data.data()+sent,data.length()-sent,MSG_NOSIGNAL);
+        if(result < 0){
+            if(errno == EINTR) continue;
+            return false;
+        }
+        sent += result;
+    }
+    return true;
+}
+
+static bool recvAll(int fd,char* buf,size_t length){
+    size_t received = 0;
+    while(received < length){
+        ssize_t result = recv(fd,buf+received,length-received,0);
+        if(result < 0 && errno == EINTR) continue;
+        if(result <= 0) return false;
+        received += result;
+    }
+    return true;
+}
+
+enum ResponseResult{
+    RESPONSE_OK,
+    RESPONSE_IO_ERROR,
+    RESPONSE_PROTOCOL_ERROR,
+    RESPONSE_STATUS_ERROR
+};
+
+// reads records until END_REQUEST; the response is an error unless its
+// headers carry a 2xx Status
+static ResponseResult readResponse(int fd,uint64_t& bytes){
+    std::string stdoutData;
+    char header[fcgi::HEADER_LENGTH];
+    std::vector<char> content;
+
+    while(true){
+        if(!recvAll(fd,header,sizeof(header))){
+            return RESPONSE_IO_ERROR;
+        }
+        fcgi::Header h = fcgi::parseHeader((const unsigned char*)header);
+        if(h.version != fcgi::VERSION_1){
+            return RESPONSE_PROTOCOL_ERROR;
+        }
+        content.resize(h.contentLength + h.paddingLength);
+        if(!content.empty() && !recvAll(fd,content.data(),content.size())){
+            return RESPONSE_IO_ERROR;
+        }
+        bytes += sizeof(header) + content.size();
+
+        if(h.type == fcgi::STDOUT){
+            // only the headers are needed
+            if(stdoutData.length() < 256){
+                stdoutData.append(content.data(),h.contentLength);
+            }
+        }
+        else if(h.type == fcgi::END_REQUEST){
+            if(h.contentLength < 8 || content[4] != fcgi::REQUEST_COMPLETE){
+                return RESPONSE_PROTOCOL_ERROR;
+            }
+            break;
+        }
+        else if(h.type != fcgi::STDERR){
+            return RESPONSE_PROTOCOL_ERROR;
+        }
+    }
+
+    if(stdoutData.compare(0,8,"Status: ") != 0 || stdoutData.length() < 9 || stdoutData[8] != '2'){
+        return RESPONSE_STATUS_ERROR;
+    }
+    return RESPONSE_OK;
+}
+
+static bool recvMore(int fd,std::string& buffer){
+    char data[16384];
+    while(true){
+        ssize_t result = recv(fd,data,sizeof(data),0);
+        if(result < 0 && errno == EINTR) continue;
+        if(result <= 0) return false;
+        buffer.append(data,result);
+        return true;
+    }
+}
+
+// reads an HTTP/1.x response framed by Content-Length, chunked encoding or
+// the end of the connection; the response is an error unless its status is 2xx
+static ResponseResult readHttpResponse(int fd,std::string& buffer,uint64_t& bytes){
+    buffer.clear();
+    size_t headEnd;
+    while((headEnd = buffer.find("\r\n\r\n")) == std::string::npos){
+        if(!recvMore(fd,buffer)){
+            return RESPONSE_IO_ERROR;
+        }
+    }
+    headEnd += 4;
+    std::string head = buffer.substr(0,headEnd);
+    std::transform(head.begin(),head.end(),head.begin(),::tolower);
+    if(head.compare(0,7,"http/1.") != 0 || head.length() < 13){
+        return RESPONSE_PROTOCOL_ERROR;
+    }
+    char status = head[9];
+
+    size_t end;
+    size_t field = head.find("\r\ncontent-length:");
+    if(head.find("\r\ntransfer-encoding: chunked") != std::string::npos){
+        end = headEnd;
+        while(true){
+            size_t lineEnd;
+            while((lineEnd = buffer.find("\r\n",end)) == std::string::npos){
+                if(!recvMore(fd,buffer)){
+                    return RESPONSE_IO_ERROR;
+                }
+            }
+            char* digitsEnd;
+            size_t size = strtoul(buffer.c_str() + end,&digitsEnd,16);
+            if(digitsEnd == buffer.c_str() + end){
+                return RESPONSE_PROTOCOL_ERROR;
+            }
+            // the last chunk has no data, only the blank line
+            end = lineEnd + 2 + size + 2;
+            if(size == 0){
+                end = lineEnd + 4;
+            }
+            while(buffer.length() < end){
+                if(!recvMore(fd,buffer)){
+                    return RESPONSE_IO_ERROR;
+                }
+            }
+            if(size == 0){
+                break;
+            }
+        }
+    }
+    else if(field != std::string::npos){
+        end = headEnd + strtoul(head.c_str() + field + 17,NULL,10);
+        while(buffer.length() < end){
+            if(!recvMore(fd,buffer)){
+                return RESPONSE_IO_ERROR;
+            }
+        }
+    }
+    else{
+        while(recvMore(fd,buffer)){
+            //until closed
+        }
+        end = buffer.length();
+    }
+    bytes += end;
+
+    return status == '2' ? RESPONSE_OK : RESPONSE_STATUS_ERROR;
+}
+
+static void* workerMain(void* arg){
+    Worker* worker = (Worker*)arg;
+    const Options& options = *worker->options;
+    const Scenario& scenario = *worker->scenario;
+    size_t next = worker->index * 7919;
+    int fd = -1;
+    bool reused = false;            // fd has answered a request already
+    auto exchange = [&](const LoadRequest& request){
+        if(!sendAll(fd,request.encoded)){
+            return RESPONSE_IO_ERROR;
+        }
+        return options.http ? readHttpResponse(fd,worker->input,worker->bytesReceived) :
+            readResponse(fd,worker->bytesReceived);
+    };
+
+    uint64_t start = nowNanos();
+    for(long i=0; worker->count == 0 || i < worker->count; i++){
+        // open loop requests are timed from when they should have been sent
+        uint64_t intended = nowNanos();
+        if(worker->interval > 0){
+            intended = start + (uint64_t)(i * worker->interval);
+            if(intended > nowNanos()){
+                sleepUntil(intended);
+            }
+        }
+        if(worker->count == 0 && intended >= worker->deadline){
+            break;
+        }
+
+        if(fd < 0){
+            fd = openConnection(options);
+            if(fd < 0){
+                worker->connectErrors++;
+                usleep(10000);
+                continue;
+            }
+        }
+
+        const LoadRequest& request = scenario.requests[scenario.schedule[next++ % scenario.schedule.size()]];
+        uint64_t received = worker->bytesReceived;
+        ResponseResult result = exchange(request);
+        // As web servers do with pooled connections, a request that fails on
+        // a reused connection before any response arrives is sent again on a
+        // new one; the server may have closed the connection while idle.
+        if(result == RESPONSE_IO_ERROR && reused && worker->bytesReceived == received){
+            worker->retries++;
+            close(fd);
+            reused = false;
+            fd = openConnection(options);
+            if(fd >= 0){
+                result = exchange(request);
+            }
+        }
+        worker->latency.record((nowNanos() - intended) / 1000);
+        reused = result == RESPONSE_OK || result == RESPONSE_STATUS_ERROR;
+
+        switch(result){
+        case RESPONSE_OK:
+            worker->completed++;
+            break;
+        case RESPONSE_STATUS_ERROR:
+            worker->statusErrors++;
+            break;
+        case RESPONSE_PROTOCOL_ERROR:
+            worker->protocolErrors++;
+            break;
+        case RESPONSE_IO_ERROR:
+            worker->ioErrors++;
+            break;
+        }
+
+        if(fd >= 0 && (result == RESPONSE_IO_ERROR || result == RESPONSE_PROTOCOL_ERROR || !options.keepConn)){
+            close(fd);
+            fd = -1;
+        }
+    }
+    if(fd >= 0){
+        close(fd);
+    }
+    return NULL;
+}
+
+static void usage(const char* name){
+    fprintf(stderr,"usage: %s (-s socket | -a host:port) [options] scenario.json\n",name);
+    fprintf(stderr,"  -s socket     connect to a Unix domain socket\n");
+    fprintf(stderr,"  -a host:port  connect over TCP\n");
+    fprintf(stderr,"  -c count      concurrent connections (default: 1)\n");
+    fprintf(stderr,"  -n requests   total requests to send\n");
+    fprintf(stderr,"  -d seconds    run for a fixed time instead (default: 10)\n");
+    fprintf(stderr,"  -r rate       open loop at 'rate' requests/sec; default is closed loop\n");
+    fprintf(stderr,"  -x            close the connection after each request\n");
+    fprintf(stderr,"  -H            speak HTTP/1.1, as to minibar-httpd, instead of FastCGI\n");
+    fprintf(stderr,"  -j            print the report as JSON\n");
+}
+
+}
+
+using namespace minibar;
+
+int main(int argc,char** argv){
+    Options options;
+    options.connections = 1;
+    options.requests = 0;
+    options.duration = 10;
+    options.rate = 0;
+    options.keepConn = true;
+    options.http = false;
+    options.json = false;
+    int opt;
+
+    while((opt = getopt(argc,argv,"s:a:c:n:d:r:xHj")) != -1){
+        switch(opt){
+        case 's':
+            options.unixPath = optarg;
+            break;
+        case 'a':{
+            std::string addr = optarg;
+            size_t colon = addr.rfind(':');
+            if(colon == std::string::npos){
+                usage(argv[0]);
+                return 1;
+            }
+            options.host = addr.substr(0,colon);
+            options.port = addr.substr(colon+1);
+            break;
+        }
+        case 'c': options.connections = atoi(optarg); break;
+        case 'n': options.requests = strtol(optarg,NULL,10); break;
+        case 'd': options.duration = atof(optarg); break;
+        case 'r': options.rate = atof(optarg); break;
+        case 'x': options.keepConn = false; break;
+        case 'H': options.http = true; break;
+        case 'j': options.json = true; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(optind != argc-1 || (options.unixPath.empty() == options.host.empty()) ||
+        options.connections < 1 || options.requests < 0 || options.duration <= 0 || options.rate < 0){
+        usage(argv[0]);
+        return 1;
+    }
+
+    Scenario scenario;
+    try{
+        loadScenario(argv[optind],options,scenario);
+    }
+    catch(const std::exception& ex){
+        fprintf(stderr,"%s: %s\n",argv[optind],ex.what());
+        return 1;
+    }
+
+    std::vector<Worker> workers(options.connections);
+    uint64_t start = nowNanos();
+    for(int i=0; i<options.connections; i++){
+        Worker& worker = workers[i];
+        worker.index = i;
+        worker.options = &options;
+        worker.scenario = &scenario;
+        worker.count = options.requests == 0 ? 0 :
+            options.requests / options.connections + (i < options.requests % options.connections ? 1 : 0);
+        worker.deadline = start + (uint64_t)(options.duration * 1e9);
+        worker.interval = options.rate > 0 ? 1e9 * options.connections / options.rate : 0;
+        worker.completed = 0;
+        worker.connectErrors = 0;
+        worker.ioErrors = 0;
+        worker.retries = 0;
+        worker.protocolErrors = 0;
+        worker.statusErrors = 0;
+        worker.bytesReceived = 0;
+        pthread_create(&worker.thread,NULL,workerMain,&worker);
+    }
+
+    LatencyHistogram latency;
+    unsigned long completed = 0, connectErrors = 0, ioErrors = 0, protocolErrors = 0, statusErrors = 0;
+    unsigned long retries = 0;
+    uint64_t bytes = 0;
+    for(Worker& worker: workers){
+        pthread_join(worker.thread,NULL);
+        latency.merge(worker.latency);
+        completed += worker.completed;
+        connectErrors += worker.connectErrors;
+        ioErrors += worker.ioErrors;
+        retries += worker.retries;
+        protocolErrors += worker.protocolErrors;
+        statusErrors += worker.statusErrors;
+        bytes += worker.bytesReceived;
+    }
+    double seconds = (nowNanos() - start) / 1e9;
+
+    Json::Value report;
+    report["mode"] = options.rate > 0 ? "open" : "closed";
+    report["connections"] = options.connections;
+    report["seconds"] = seconds;
+    report["requests"] = (Json::UInt64)latency.count();
+    report["completed"] = (Json::UInt64)completed;
+    report["requestsPerSecond"] = completed / seconds;
+    report["bytesReceived"] = (Json::UInt64)bytes;
+    report["errors"]["connect"] = (Json::UInt64)connectErrors;
+    report["errors"]["io"] = (Json::UInt64)ioErrors;
+    report["errors"]["protocol"] = (Json::UInt64)protocolErrors;
+    report["errors"]["status"] = (Json::UInt64)statusErrors;
+    report["retries"] = (Json::UInt64)retries;
+    report["latencyMicros"]["p50"] = (Json::UInt64)latency.percentile(0.50);
+    report["latencyMicros"]["p90"] = (Json::UInt64)latency.percentile(0.90);
+    report["latencyMicros"]["p99"] = (Json::UInt64)latency.percentile(0.99);
+    report["latencyMicros"]["p999"] = (Json::UInt64)latency.percentile(0.999);
+    report["latencyMicros"]["max"] = (Json::UInt64)latency.max();
+    report["histogram"] = latency.toJson();
+
+    if(options.json){
+        Json::StyledWriter writer;
+        printf("%s",writer.write(report).c_str());
+    }
+    else{
+        printf("%s loop, %d connection(s), %.2f seconds\n",
+            report["mode"].asCString(),options.connections,seconds);
+        printf("requests:     %lu completed of %lu sent, %.0f requests/sec\n",
+            completed,(unsigned long)latency.count(),completed / seconds);
+        printf("errors:       connect %lu, io %lu, protocol %lu, status %lu\n",
+            connectErrors,ioErrors,protocolErrors,statusErrors);
+        printf("retries:      %lu on closed keep-alive connections\n",retries);
+        printf("latency (us): p50 %lu  p90 %lu  p99 %lu  p999 %lu  max %lu\n",
+            (unsigned long)latency.percentile(0.50),(unsigned long)latency.percentile(0.90),
+            (unsigned long)latency.percentile(0.99),(unsigned long)latency.percentile(0.999),
+            (unsigned long)latency.max());
+        printf("histogram (us):\n");
+        for(const Json::Value& row: report["histogram"]){
+            printf("  >= %-10lu %lu\n",(unsigned long)row[0].asUInt64(),(unsigned long)row[1].asUInt64());
+        }
+    }
+    return connectErrors + ioErrors + protocolErrors + statusErrors == 0 ? 0 : 2;
+}
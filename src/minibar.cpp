@@ -29,6 +29,8 @@ either expressed or implied, of the FreeBSD Project.
 
 
 #include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
 
 #include <string>
 #include <exception>
@@ -36,90 +38,75 @@ either expressed or implied, of the FreeBSD Project.
 #include <vector>
 #include <memory>
 #include <fstream>
+#include <algorithm>
 
 #include "utils.h"
 #include "minibar.h"
 #include "cgi.h"
 #include "configure.h"
+#include "configcache.h"
+#include "param.h"
+#include "arena.h"
 #include "database.h"
+#include "jsonstream.h"
 
 namespace minibar{
 
-void writeJson(Json::Value value){
-    Json::StyledWriter writer;
-    writeString(writer.write(value));
-}
-
-void logJson(Json::Value value){
-    Json::StyledWriter writer;
-    logString(writer.write(value));
-}
+void RequestContext::logPrint(const char* format,...){
+    char buff[1024];
+    va_list vptr;
 
-Json::Value getRequestJson(){
-    Json::Reader reader;
-    Json::Value request;
+    va_start(vptr,format);
+    int length = vsnprintf(buff,sizeof(buff),format,vptr);
+    va_end(vptr);
 
-    std::string data = getRequestContent();
-
-    // set an empty object if there's no data
-    if(data.length() == 0){
-        data = "[]";
-    }
-
-    if(!reader.parse(data,request,false)){
-        throw MinibarException(reader.getFormattedErrorMessages());
+    if(length > 0){
+        log(buff,std::min<size_t>(length,sizeof(buff)-1));
     }
+}
 
-    return request;
+char* RequestContext::getMutableRequestContent(size_t& length){
+    std::string_view content = getRequestContent();
+    char* copy = (char*)getRequestArena().allocate(content.length() + 1,1);
+    memcpy(copy,content.data(),content.length());
+    length = content.length();
+    return copy;
+}
 
+void writeJson(const WriteFn& output,const Json::Value& value){
+    Json::StyledWriter writer;
+    std::string text = writer.write(value);
+    output(text.data(),text.length());
 }
 
-Json::Value getQueryJson(){
-    return parseQueryString(getQueryString());
+void writeJson(RequestContext& ctx,const Json::Value& value){
+    writeJson([&ctx](const char* data,size_t length){
+        ctx.write(data,length);
+    },value);
 }
 
-class ConfigCache{
-private:
-     std::map<std::string,Config*> cache;
-public:
-    ~ConfigCache(){
-        auto iter = cache.begin();
-        while(iter != cache.end()){
-            delete iter->second;
-            iter++;
-        }
-    }
-    
-    Config* getConfig(std::string filename){
-        Config* config;
-
-        auto iter = cache.find(filename);
-        if(iter == cache.end()){
-            config = new Config();
-            config->loadConfig(filename);
-            cache[filename] = config;
-        }
-        else{
-            config = iter->second;
-        }
-        return config;
-    }
-};
+void logJson(RequestContext& ctx,const Json::Value& value){
+    Json::StyledWriter writer;
+    ctx.logString(writer.write(value));
+}
 
-ConfigCache cache;
+// config files are checked for changes once a second
+ConfigCache cache(1000);
 
-void processRequest(){
+void processRequest(RequestContext& ctx){
+    // per request allocations are released all at once on the way out
+    RequestArenaScope arenaScope;
 
     try{
-        debugPrint("Handling Request");
+        debugPrint(ctx,"Handling Request");
 
         // parse configuration file and establish root JSON object
 
-        Config* config = cache.getConfig(getConfigFilename());
+        Config* config = cache.getConfig(ctx.getConfigFilename());
  
         // compose the query path and get the query_node indicated by the path
         Json::Value pathValues; 
-        RestNode* restNode = config->getRestNode(getRestTarget(),pathValues);         
+        RestNode* restNode = config->getRestNode(ctx.getRestTarget(),pathValues);         
         
         Json::Value resultJson;
 
@@ -130,61 +117,129 @@ void processRequest(){
                 // dump the sanitized config to JSON
                 resultJson = config->toJson(); 
             }
+            else if(action.compare("stats")==0){
+                // dump database runtime counters
+                resultJson = config->getStats();
+                resultJson["arena"] = getArenaStats();
+            }
             else{
-                writeString(STATUS_400);
-                std::string msg;
-                msg += "Unknown special action: ";
-                msg += restNode->specialAction;
-                writeString(msg.c_str());
+                ctx.writeString(STATUS_400);
+                ctx.writeString("Unknown special action: ");
+                ctx.writeString(restNode->specialAction);
             }
         }
         else{
-            // configure parameter evaluation context
-            Json::Value paramContext;
-            paramContext["conf"] = config->getRoot();
-            paramContext["path"] = pathValues;
-            paramContext["request"] = getRequestJson();
-            paramContext["query"] = getQueryJson();
+            // configure parameter evaluation context; request data is
+            // only parsed if a parameter refers to it, and then only the
+            // fields the parameters use
+            ParamContext paramContext(ctx,config->getRoot(),pathValues,&restNode->requestFields);
+            const vector<ParamBinding>& bindings = restNode->bindings;
+
+            // cached routes evaluate their parameters up front to build the
+            // cache key; a hit skips the database entirely
+            ResultCache& resultCache = config->getResultCache();
+            std::string cacheKey;
+            uint64_t dataVersion = 0;
+            vector<Json::Value> values;
+            if(restNode->cached){
+                // read before the query runs, so a write that lands while it
+                // runs leaves the new entry stale instead of serving old rows
+                dataVersion = restNode->database->getDataVersion();
+
+                cacheKey = restNode->path;
+                cacheKey += '\n';
+                JsonStreamWriter keyWriter([&cacheKey](const char* data,size_t length){
+                    cacheKey.append(data,length);
+                },256,&getRequestArena());
+                values.resize(bindings.size());
+                for(size_t i=0; i<bindings.size(); i++){
+                    Json::Value scratch;
+                    values[i] = bindings[i].evaluate(paramContext,scratch);
+                    keyWriter.value(values[i]);
+                }
+                keyWriter.flush();
+
+                std::shared_ptr<const std::string> response = resultCache.get(cacheKey,dataVersion);
+                if(response != NULL){
+                    ctx.write(response->data(),response->length());
+                    return;
+                }
+            }
             
             // prepare the sql query
-            Connection* con = restNode->database->getConnection();
+            RAIIConnection con(restNode->database);
             con->prepare(restNode->query);
             
             // gather parameters as indicated on the query_node
-            for(QueryParameter param: restNode->parameters){ 
-                Json::Value value = QueryObject(paramContext,param.path);
-                if(param.name.empty()){
-                    con->bind(value);  // positional
+            for(size_t i=0; i<bindings.size(); i++){
+                if(restNode->cached){
+                    bindings[i].bindValue(con.con,values[i]);
                 }
                 else{
-                    con->bind(param.name,value);
+                    bindings[i].bind(paramContext,con.con);
                 }
             }
 
-            resultJson = con->execute();
-            
-            // debug
-            logJson(resultJson);
+            // the response is copied aside for the cache, unless it outgrows
+            // the largest entry the cache will take
+            std::string response;
+            bool capture = restNode->cached;
+            size_t maxCapture = resultCache.getMaxEntryBytes();
+            WriteFn output = [&](const char* data,size_t length){
+                ctx.write(data,length);
+                if(capture){
+                    if(response.length() + length > maxCapture){
+                        capture = false;
+                        response = std::string();
+                    }
+                    else{
+                        response.append(data,length);
+                    }
+                }
+            };
+
+            if(restNode->stream){
+                // serialize rows straight to the frontend as they are stepped
+                JsonStreamWriter writer(output,4096,&getRequestArena());
+                writer.writeRaw(STATUS_200);
+                con->executeStream(writer);
+                writer.flush();
+            }
+            else{
+                resultJson = con->execute();
+
+                // debug
+                logJson(ctx,resultJson);
 
-            // cleanup
-            con->close(); 
+                output(STATUS_200,strlen(STATUS_200));
+                writeJson(output,resultJson);
+            }
+
+            if(capture){
+                resultCache.put(cacheKey,std::move(response),dataVersion,restNode->cacheTtl);
+            }
+            return;
         }
 
         // send response
-        writeString(STATUS_200);
-        writeJson(resultJson);
+        ctx.writeString(STATUS_200);
+        writeJson(ctx,resultJson);
         return;
 
     // exception management
     } 
+    catch (const UnknownRouteException& ex){
+        ctx.writeString(STATUS_404);
+        ctx.writeString(ex.what());
+    }
     catch (const std::exception& ex){
-        logException(ex);
+        ctx.logException(ex);
     }
     catch (const std::string& ex) {
-        logException(ex);
+        ctx.logException(ex);
     }
     catch (...) {
-        logException("Generic Exception"); 
+        ctx.logException("Generic Exception"); 
     }
 }
 
@@ -0,0 +1,377 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <cmath>
+
+#include "param.h"
+#include "cgi.h"
+#include "configure.h"
+#include "arena.h"
+
+namespace minibar{
+
+ParamContext::ParamContext(RequestContext& ctx,const Json::Value& conf,const Json::Value& path,
+    const JsonProjection* requestProjection):
+    ctx(ctx),conf(conf),path(path),requestTape(&getRequestArena()),
+    requestProjection(requestProjection),queryString(&getRequestArena()),
+    requestTapeParsed(false),requestParsed(false),queryStringParsed(false),queryParsed(false){
+    //do nothing
+}
+
+ParamSource getParamSource(std::string_view name){
+    if(name == "conf") return SOURCE_CONF;
+    if(name == "path") return SOURCE_PATH;
+    if(name == "request") return SOURCE_REQUEST;
+    if(name == "query") return SOURCE_QUERY;
+    return SOURCE_NONE;
+}
+
+static Json::Value coerceFailed(const Json::Value& value,const char* typeName){
+    Json::FastWriter writer;
+    std::string text = writer.write(value);
+    if(!text.empty() && text.back() == '\n'){
+        text.pop_back();
+    }
+    throw MinibarException("Cannot convert " + text + " to " + typeName);
+}
+
+// whole-string integer and real parsing; no trailing junk or overflow
+static bool parseInt(const std::string& str,Json::Int64& result){
+    if(str.empty()) return false;
+    char* end;
+    errno = 0;
+    result = strtoll(str.c_str(),&end,10);
+    return errno == 0 && *end == '\0';
+}
+
+static bool parseReal(const std::string& str,double& result){
+    if(str.empty()) return false;
+    char* end;
+    errno = 0;
+    result = strtod(str.c_str(),&end);
+    return errno == 0 && *end == '\0';
+}
+
+Json::Value coerceValue(const Json::Value& value,Json::ValueType type){
+    if(value.isNull() || type == Json::nullValue){
+        return value;
+    }
+
+    Json::Int64 intResult;
+    double realResult;
+
+    switch(type){
+    case Json::intValue:
+    case Json::uintValue:{
+        const char* typeName = type == Json::intValue ? "int" : "uint";
+        switch(value.type()){
+        case Json::uintValue:
+            if(value.asUInt64() > (Json::UInt64)Json::Value::maxInt64){
+                return coerceFailed(value,typeName);
+            }
+            intResult = value.asInt64();
+            break;
+        case Json::intValue:
+        case Json::booleanValue:
+            intResult = value.asInt64();
+            break;
+        case Json::realValue:
+            realResult = value.asDouble();
+            // the cast is undefined for NaN and outside the range of Int64
+            if(!(realResult >= -9.2e18 && realResult < 9.2e18) || std::trunc(realResult) != realResult){
+                return coerceFailed(value,typeName);
+            }
+            intResult = (Json::Int64)realResult;
+            break;
+        case Json::stringValue:
+            if(!parseInt(value.asString(),intResult)){
+                return coerceFailed(value,typeName);
+            }
+            break;
+        default:
+            return coerceFailed(value,typeName);
+        }
+        if(type == Json::uintValue){
+            if(intResult < 0){
+                return coerceFailed(value,typeName);
+            }
+            return Json::Value((Json::UInt64)intResult);
+        }
+        return Json::Value(intResult);
+    }
+
+    case Json::realValue:
+        switch(value.type()){
+        case Json::intValue:
+        case Json::uintValue:
+        case Json::realValue:
+            return Json::Value(value.asDouble());
+        case Json::stringValue:
+            if(parseReal(value.asString(),realResult)){
+                return Json::Value(realResult);
+            }
+            return coerceFailed(value,"real");
+        default:
+            return coerceFailed(value,"real");
+        }
+
+    case Json::stringValue:
+        switch(value.type()){
+        case Json::stringValue:
+            return value;
+        case Json::intValue:
+            return Json::Value(std::to_string(value.asInt64()));
+        case Json::uintValue:
+            return Json::Value(std::to_string(value.asUInt64()));
+        case Json::realValue:{
+            char buffer[32];
+            snprintf(buffer,sizeof(buffer),"%.17g",value.asDouble());
+            return Json::Value(buffer);
+        }
+        case Json::booleanValue:
+            return Json::Value(value.asBool() ? "true" : "false");
+        default:
+            return coerceFailed(value,"string");
+        }
+
+    case Json::booleanValue:
+        switch(value.type()){
+        case Json::booleanValue:
+            return value;
+        case Json::intValue:
+        case Json::uintValue:
+            if(value.asInt64() == 0 || value.asInt64() == 1){
+                return Json::Value(value.asInt64() == 1);
+            }
+            return coerceFailed(value,"bool");
+        case Json::stringValue:{
+            std::string str = value.asString();
+            if(str == "true" || str == "1") return Json::Value(true);
+            if(str == "false" || str == "0") return Json::Value(false);
+            return coerceFailed(value,"bool");
+        }
+        default:
+            return coerceFailed(value,"bool");
+        }
+
+    default:
+        throw MinibarException("Expected a scalar type expression");
+    }
+}
+
+const Json::Value& ParamContext::getRoot(std::string_view name){
+    return getRoot(getParamSource(name));
+}
+
+const Json::Value& ParamContext::getRoot(ParamSource source){
+    switch(source){
+    case SOURCE_PATH:
+        return path;
+    case SOURCE_REQUEST:
+        if(!requestParsed){
+            request = getRequestTape().toJson(0);
+            requestParsed = true;
+        }
+        return request;
+    case SOURCE_QUERY:
+        if(!queryParsed){
+            query = getQueryString().toJson();
+            queryParsed = true;
+        }
+        return query;
+    case SOURCE_CONF:
+        return conf;
+    default:
+        return Json::Value::null;
+    }
+}
+
+const JsonTape& ParamContext::getRequestTape(){
+    if(!requestTapeParsed){
+        size_t length;
+        char* data = ctx.getMutableRequestContent(length);
+
+        // an empty body is an empty array
+        static char empty[] = "[]";
+        if(length == 0){
+            data = empty;
+            length = 2;
+        }
+        requestTape.parse(data,length,true,requestProjection);
+        requestTapeParsed = true;
+    }
+    return requestTape;
+}
+
+const QueryString& ParamContext::getQueryString(){
+    if(!queryStringParsed){
+        queryString.parse(ctx.getQueryString());
+        queryStringParsed = true;
+    }
+    return queryString;
+}
+
+bool ParamContext::getQueryValue(std::string_view key,Json::Value& result){
+    return getQueryString().get(key,result);
+}
+
+const Json::Value& ParamContext::resolve(const std::string& path){
+    return resolve(tokenizePath(path));
+}
+
+const Json::Value& ParamContext::resolve(const TokenSet& path){
+    const Json::Value& root = getRoot(path.empty() ? SOURCE_NONE : getParamSource(path[0]));
+    if(root.isNull()){
+        throw QueryException("Failed to find query element: ",path,0);
+    }
+    return QueryObject(root,path,1);
+}
+
+///////////////////
+
+ParamBinding::ParamBinding(const QueryParameter& param):
+    name(param.name),path(tokenizePath(param.path)),type(param.type),
+    hasDefault(param.hasDefault),bindIndex(UNRESOLVED){
+
+    source = path.empty() ? SOURCE_NONE : getParamSource(path[0]);
+    if(hasDefault){
+        // a default that can never bind is a config error
+        defaultValue = coerceValue(param.defaultValue,type);
+    }
+}
+
+ParamBinding::ParamBinding(const ParamBinding& other):
+    name(other.name),source(other.source),path(other.path),type(other.type),
+    hasDefault(other.hasDefault),defaultValue(other.defaultValue),
+    bindIndex(other.bindIndex.load(std::memory_order_relaxed)){
+    //do nothing
+}
+
+const Json::Value& ParamBinding::evaluate(ParamContext& context,Json::Value& scratch) const{
+    const Json::Value* node;
+    size_t i = 0;
+    const char* error = NULL;
+
+    if(source == SOURCE_REQUEST){
+        // walk the body's tape, converting only the value found
+        const JsonTape& tape = context.getRequestTape();
+        size_t index = 0;
+        if(tape[0].type == JsonTape::NULL_VALUE){
+            error = "Failed to find query element: ";
+        }
+        for(i=1; error == NULL && i<path.size(); i++){
+            uint8_t type = tape[index].type;
+            if(type != JsonTape::OBJECT_VALUE && type != JsonTape::ARRAY_VALUE){
+                error = "Query node must be an object or array: ";
+                break;
+            }
+            index = tape.child(index,path[i]);
+            if(index == JsonTape::NOT_FOUND){
+                error = "Failed to find query element: ";
+                break;
+            }
+        }
+        if(error == NULL){
+            scratch = tape.toJson(index);
+            node = &scratch;
+        }
+    }
+    else if(source == SOURCE_QUERY && path.size() > 1){
+        // only the referenced key is converted to JSON
+        node = &scratch;
+        i = 1;
+        if(!context.getQueryValue(path[1],scratch) || scratch.isNull()){
+            error = "Failed to find query element: ";
+        }
+    }
+    else{
+        node = &context.getRoot(source);
+        if(node->isNull()){
+            error = "Failed to find query element: ";
+        }
+    }
+
+    if(error == NULL){
+        for(i=i+1; i<path.size(); i++){
+            if(!node->isObject() && !node->isArray()){
+                error = "Query node must be an object or array: ";
+                break;
+            }
+            node = JsonChild(*node,path[i]);
+            if(node == NULL){
+                error = "Failed to find query element: ";
+                break;
+            }
+        }
+    }
+
+    if(error != NULL){
+        if(!hasDefault){
+            throw QueryException(error,path,i);
+        }
+        return defaultValue;
+    }
+    if(type == Json::nullValue){
+        return *node;
+    }
+    scratch = coerceValue(*node,type);
+    return scratch;
+}
+
+void ParamBinding::bind(ParamContext& context,Connection* con) const{
+    Json::Value scratch;
+    bindValue(con,evaluate(context,scratch));
+}
+
+void ParamBinding::bindValue(Connection* con,const Json::Value& value) const{
+    if(name.empty()){
+        con->bind(value);  // positional
+        return;
+    }
+
+    int index = bindIndex.load(std::memory_order_relaxed);
+    if(index == UNRESOLVED){
+        // the index depends only on the query text, so any connection will do
+        index = con->getParameterIndex(name);
+        bindIndex.store(index,std::memory_order_relaxed);
+    }
+    if(index < 0){
+        con->bind(name,value);
+    }
+    else if(index > 0){
+        con->bind(index,value);
+    }
+}
+
+}
@@ -0,0 +1,156 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <time.h>
+
+#include "utils.h"
+#include "resultcache.h"
+
+namespace minibar{
+
+enum{
+    // bookkeeping charged per entry on top of the key and response
+    ENTRY_OVERHEAD = 128
+};
+
+static int64_t monotonicMillis(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+ResultCache::ResultCache(size_t maxBytes){
+    pthread_mutex_init(&mutex,NULL);
+    this->maxBytes = maxBytes;
+    bytes = 0;
+    hits = 0;
+    misses = 0;
+    invalidated = 0;
+    expired = 0;
+    evictions = 0;
+}
+
+ResultCache::~ResultCache(){
+    pthread_mutex_destroy(&mutex);
+}
+
+void ResultCache::setMaxBytes(size_t maxBytes){
+    RAIILock lock(&mutex);
+    this->maxBytes = maxBytes;
+    while(bytes > maxBytes){
+        remove(std::prev(entries.end()));
+        evictions++;
+    }
+}
+
+size_t ResultCache::getMaxEntryBytes(){
+    return maxBytes / 4;
+}
+
+// must be called with the mutex held
+void ResultCache::remove(EntryList::iterator it){
+    bytes -= it->size;
+    index.erase(it->key);
+    entries.erase(it);
+}
+
+std::shared_ptr<const std::string> ResultCache::get(const std::string& key,uint64_t dataVersion){
+    RAIILock lock(&mutex);
+    auto found = index.find(key);
+    if(found == index.end()){
+        misses++;
+        return NULL;
+    }
+
+    EntryList::iterator it = found->second;
+    if(it->dataVersion != dataVersion){
+        remove(it);
+        invalidated++;
+        misses++;
+        return NULL;
+    }
+    if(it->expires != 0 && it->expires <= monotonicMillis()){
+        remove(it);
+        expired++;
+        misses++;
+        return NULL;
+    }
+
+    entries.splice(entries.begin(),entries,it);
+    hits++;
+    return it->response;
+}
+
+void ResultCache::put(const std::string& key,std::string&& response,uint64_t dataVersion,int ttl){
+    size_t size = key.length() + response.length() + ENTRY_OVERHEAD;
+    if(size > getMaxEntryBytes()){
+        return;
+    }
+    int64_t expires = ttl > 0 ? monotonicMillis() + ttl * 1000L : 0;
+    auto shared = std::make_shared<const std::string>(std::move(response));
+
+    RAIILock lock(&mutex);
+    auto found = index.find(key);
+    if(found != index.end()){
+        remove(found->second);
+    }
+    while(!entries.empty() && bytes + size > maxBytes){
+        remove(std::prev(entries.end()));
+        evictions++;
+    }
+
+    entries.push_front(Entry{key,shared,dataVersion,expires,size});
+    index[entries.front().key] = entries.begin();
+    bytes += size;
+}
+
+void ResultCache::clear(){
+    RAIILock lock(&mutex);
+    entries.clear();
+    index.clear();
+    bytes = 0;
+}
+
+Json::Value ResultCache::getStats(){
+    RAIILock lock(&mutex);
+    Json::Value stats;
+    unsigned long lookups = hits + misses;
+    stats["maxBytes"] = (Json::UInt64)maxBytes;
+    stats["bytes"] = (Json::UInt64)bytes;
+    stats["entries"] = (Json::UInt64)entries.size();
+    stats["hits"] = (Json::UInt64)hits;
+    stats["misses"] = (Json::UInt64)misses;
+    stats["invalidated"] = (Json::UInt64)invalidated;
+    stats["expired"] = (Json::UInt64)expired;
+    stats["evictions"] = (Json::UInt64)evictions;
+    stats["hitRate"] = lookups == 0 ? 0.0 : (double)hits / lookups;
+    return stats;
+}
+
+}
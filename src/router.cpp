@@ -125,4 +125,191 @@ int RouteNode::matchRoute(TokenSet tokens,Json::Value& pathValues){
     return matchRoute(tokens.begin(),tokens.end(),pathValues);
 }
 
+///////////
+
+static uint64_t hashSegment(int parent,std::string_view segment){
+    // FNV-1a, seeded with the parent node
+    uint64_t hash = 14695981039346656037ull ^ (uint64_t)parent;
+    for(char ch: segment){
+        hash ^= (unsigned char)ch;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// splits 'target' on '/' into 'segs'; returns the count or -1 if there are too many
+static int splitSegments(std::string_view target,std::string_view* segs,int max){
+    int count = 0;
+    size_t start = 0;
+    while(true){
+        if(count == max){
+            return -1;
+        }
+        size_t pos = target.find('/',start);
+        if(pos == std::string_view::npos){
+            segs[count++] = target.substr(start);
+            return count;
+        }
+        segs[count++] = target.substr(start,pos-start);
+        start = pos + 1;
+    }
+}
+
+RouteTable::RouteTable(){
+    clear();
+}
+
+void RouteTable::clear(){
+    nodes.clear();
+    edges.assign(16,Edge{0,-1,-1,0,0});
+    edgeCount = 0;
+    segments.clear();
+    paramNames.clear();
+    newNode();
+}
+
+int RouteTable::newNode(){
+    nodes.push_back(Node{NO_ROUTE_MATCH,-1,-1});
+    return nodes.size() - 1;
+}
+
+int RouteTable::findEdge(int parent,std::string_view segment,uint64_t hash) const{
+    size_t mask = edges.size() - 1;
+    for(size_t i = hash & mask; edges[i].parent != -1; i = (i+1) & mask){
+        const Edge& edge = edges[i];
+        if(edge.hash == hash && edge.parent == parent &&
+            std::string_view(segments.data()+edge.offset,edge.length) == segment){
+            return edge.child;
+        }
+    }
+    return -1;
+}
+
+void RouteTable::insertEdge(int parent,int child,std::string_view segment,uint64_t hash){
+    if((edgeCount+1)*2 > edges.size()){
+        growEdges();
+    }
+    size_t mask = edges.size() - 1;
+    size_t i = hash & mask;
+    while(edges[i].parent != -1){
+        i = (i+1) & mask;
+    }
+    edges[i] = Edge{hash,parent,child,(uint32_t)segments.length(),(uint32_t)segment.length()};
+    segments.append(segment);
+    edgeCount++;
+}
+
+void RouteTable::growEdges(){
+    vector<Edge> old;
+    old.swap(edges);
+    edges.assign(old.size()*2,Edge{0,-1,-1,0,0});
+    size_t mask = edges.size() - 1;
+    for(const Edge& edge: old){
+        if(edge.parent == -1) continue;
+        size_t i = edge.hash & mask;
+        while(edges[i].parent != -1){
+            i = (i+1) & mask;
+        }
+        edges[i] = edge;
+    }
+}
+
+void RouteTable::addRoute(std::string_view pattern,int matchId){
+    std::string_view segs[MAX_SEGMENTS];
+    int count = splitSegments(pattern,segs,MAX_SEGMENTS);
+    if(count < 0){
+        throw RouteException("route has too many segments");
+    }
+    if(matchId < 0){
+        throw RouteException("route id must not be negative");
+    }
+
+    vector<string> names;
+    int node = 0;
+    for(int i=0; i<count; i++){
+        std::string_view seg = segs[i];
+        int next;
+        if(seg.compare("*") == 0){
+            next = nodes[node].wildcardChild;
+            if(next == -1){
+                next = newNode();
+                nodes[node].wildcardChild = next;
+            }
+        }
+        else if(!seg.empty() && seg[0] == ':'){
+            if(names.size() == MAX_PARAMS){
+                throw RouteException("route has too many parameters");
+            }
+            names.push_back(string(seg.substr(1)));
+            next = nodes[node].paramChild;
+            if(next == -1){
+                next = newNode();
+                nodes[node].paramChild = next;
+            }
+        }
+        else{
+            uint64_t hash = hashSegment(node,seg);
+            next = findEdge(node,seg,hash);
+            if(next == -1){
+                next = newNode();
+                insertEdge(node,next,seg,hash);
+            }
+        }
+        node = next;
+    }
+
+    if(nodes[node].matchId != NO_ROUTE_MATCH){
+        throw RouteException("route already exists");
+    }
+    nodes[node].matchId = matchId;
+
+    if(paramNames.size() <= (size_t)matchId){
+        paramNames.resize(matchId+1);
+    }
+    paramNames[matchId] = names;
+}
+
+bool RouteTable::match(int node,const std::string_view* segs,int count,Match& result) const{
+    if(count == 0){
+        result.id = nodes[node].matchId;
+        return result.id != NO_ROUTE_MATCH;
+    }
+
+    const Node& current = nodes[node];
+    int child = findEdge(node,segs[0],hashSegment(node,segs[0]));
+    if(child != -1 && match(child,segs+1,count-1,result)){
+        return true;
+    }
+    if(current.paramChild != -1){
+        int slot = result.paramCount++;
+        result.params[slot] = segs[0];
+        if(match(current.paramChild,segs+1,count-1,result)){
+            return true;
+        }
+        result.paramCount = slot;
+    }
+    if(current.wildcardChild != -1 && match(current.wildcardChild,segs+1,count-1,result)){
+        return true;
+    }
+    return false;
+}
+
+bool RouteTable::matchRoute(std::string_view target,Match& result) const{
+    std::string_view segs[MAX_SEGMENTS];
+    result.id = NO_ROUTE_MATCH;
+    result.paramCount = 0;
+
+    int count = splitSegments(target,segs,MAX_SEGMENTS);
+    if(count < 0 || !match(0,segs,count,result)){
+        result.id = NO_ROUTE_MATCH;
+        result.paramCount = 0;
+        return false;
+    }
+    return true;
+}
+
+const vector<string>& RouteTable::getParamNames(int matchId) const{
+    return paramNames.at(matchId);
+}
+
 }
@@ -30,6 +30,9 @@ either expressed or implied, of the FreeBSD Project.
 #include "sqlite3db.h"
 #include "configure.h"
 
+#include <errno.h>
+#include <algorithm>
+
 namespace minibar{
 
 REGISTER_DB(sqlite,SqliteDb::Create);
@@ -59,43 +62,97 @@ static void sqlite3_fn(int result){
 
 ///////// 
 
-SqliteDbConnection::SqliteDbConnection(std::string dbFile){
+SqliteDbConnection::SqliteDbConnection(SqliteDb* db){
+    this->db = db;
     handle = NULL;
     stmt = NULL;
+    stmtCached = false;
+    written = false;
+    statement = NULL;
     bindIndex = 0;
-    sqlite3_fn(sqlite3_open(dbFile.c_str(),&handle));
+    owner = pthread_self();
+    released = 0;
+
+    int result = sqlite3_open(db->dbFile.c_str(),&handle);
+    if(result != SQLITE_OK){
+        // sqlite3_open allocates a handle even on failure
+        sqlite3_close_v2(handle);
+        throw SqlException(result);
+    }
 }
 
 SqliteDbConnection::~SqliteDbConnection(){
     close();
+    for(SqliteStatement& cached: statements){
+        sqlite3_finalize(cached.stmt);
+    }
+    sqlite3_close_v2(handle);
 }
 
 void SqliteDbConnection::prepare(std::string query){
     //@breakpoint
     int result;
-    result = sqlite3_prepare_v2(handle,query.data(),query.length(),&stmt,NULL);
+    close();
+
+    // reuse a cached statement; close() has already reset it
+    auto it = statementIndex.find(query);
+    if(it != statementIndex.end()){
+        statements.splice(statements.begin(),statements,it->second);
+        statement = &*it->second;
+        stmt = statement->stmt;
+        stmtCached = true;
+        db->statementHits++;
+        return;
+    }
+
+    if(db->statementCacheSize == 0){
+        result = sqlite3_prepare_v2(handle,query.data(),query.length(),&stmt,NULL);
+        sqlite3_fn(result);
+        uncached.stmt = stmt;
+        uncached.reprepares = -1;
+        statement = &uncached;
+        return;
+    }
+
+    db->statementMisses++;
+    result = sqlite3_prepare_v3(handle,query.data(),query.length(),
+        SQLITE_PREPARE_PERSISTENT,&stmt,NULL);
     sqlite3_fn(result);
+
+    // evict the least recently used statement
+    if(statements.size() >= db->statementCacheSize){
+        SqliteStatement& last = statements.back();
+        statementIndex.erase(last.query);
+        sqlite3_finalize(last.stmt);
+        statements.pop_back();
+    }
+    statements.push_front(SqliteStatement{query,stmt,{},-1});
+    statementIndex[statements.front().query] = statements.begin();
+    statement = &statements.front();
+    stmtCached = true;
 }
 
-void SqliteDbConnection::bind(int idx,Json::Value value){
+void SqliteDbConnection::bind(int idx,const Json::Value& value){
     //@breakpoint
-    std::string str;
     switch(value.type()){
     case Json::nullValue: 
         sqlite3_fn(sqlite3_bind_null(stmt,idx));
         break;
     case Json::intValue:     
-        sqlite3_fn(sqlite3_bind_int64(stmt,idx,value.asInt()));
+        sqlite3_fn(sqlite3_bind_int64(stmt,idx,value.asInt64()));
         break;
     case Json::uintValue:     
-        sqlite3_fn(sqlite3_bind_int64(stmt,idx,value.asUInt()));
+        // SQLite integers are signed 64 bit
+        if(value.asUInt64() > (Json::UInt64)Json::Value::maxInt64){
+            throw SqlException("Integer parameter out of range");
+        }
+        sqlite3_fn(sqlite3_bind_int64(stmt,idx,value.asInt64()));
         break;
     case Json::realValue:     
         sqlite3_fn(sqlite3_bind_double(stmt,idx,value.asDouble()));
         break;
     case Json::stringValue:
-        str = value.asString();
-        sqlite3_fn(sqlite3_bind_text(stmt,idx,str.c_str(),-1,SQLITE_TRANSIENT));
+        sqlite3_fn(sqlite3_bind_text(stmt,idx,value.asCString(),-1,SQLITE_TRANSIENT));
         break;
     case Json::booleanValue:
         sqlite3_fn(sqlite3_bind_int64(stmt,idx,value.asInt()));
@@ -107,18 +164,22 @@ void SqliteDbConnection::bind(int idx,Json::Value value){
     }
 }
 
-void SqliteDbConnection::bind(Json::Value value){
+void SqliteDbConnection::bind(const Json::Value& value){
     bind(bindIndex+1,value);
     bindIndex++;
 }
 
-void SqliteDbConnection::bind(std::string name,Json::Value value){
-    int idx = sqlite3_bind_parameter_index(stmt,name.c_str());
+void SqliteDbConnection::bind(const std::string& name,const Json::Value& value){
+    int idx = getParameterIndex(name);
     if(idx != 0){
         bind(idx,value);
     }
 }
 
+int SqliteDbConnection::getParameterIndex(const std::string& name){
+    return sqlite3_bind_parameter_index(stmt,name.c_str());
+}
+
 int SqliteDbConnection::queryStep(){
     int result = sqlite3_step(stmt);
     switch(result){
@@ -131,28 +192,51 @@ int SqliteDbConnection::queryStep(){
     }
 }
 
-Json::Value SqliteDbConnection::queryGetRow(){
+// column metadata for the current statement, gathered on first use.  SQLite
+// re-prepares a statement after a schema change, which may rename or replace
+// its columns, so the metadata is gathered again whenever that has happened.
+const std::vector<SqliteColumn>& SqliteDbConnection::describe(){
+    int reprepares = sqlite3_stmt_status(stmt,SQLITE_STMTSTATUS_REPREPARE,0);
+    if(statement->reprepares == reprepares){
+        return statement->columns;
+    }
+
+    int count = sqlite3_column_count(stmt);
+    statement->columns.clear();
+    statement->columns.reserve(count);
+    for(int i=0; i<count; i++){
+        SqliteColumn column;
+        column.name = sqlite3_column_name(stmt,i);
+        appendJsonString(column.quotedKey,column.name);
+        column.quotedKey += ':';
+        statement->columns.push_back(column);
+    }
+    statement->reprepares = reprepares;
+    return statement->columns;
+}
+
+Json::Value SqliteDbConnection::queryGetRow(const std::vector<SqliteColumn>& columns){
     Json::Value row;
-    for(int i=0; i<sqlite3_column_count(stmt); i++){
-        const char* name = sqlite3_column_name(stmt,i);
+    for(size_t i=0; i<columns.size(); i++){
+        const SqliteColumn& column = columns[i];
+        Json::Value& value = row[column.name];
 
         switch(sqlite3_column_type(stmt,i)){
         case SQLITE_INTEGER:
-            row[name] = (Json::Int64)sqlite3_column_int64(stmt,i);
+            value = (Json::Int64)sqlite3_column_int64(stmt,i);
             break;
         case SQLITE_FLOAT:
-            row[name] = sqlite3_column_double(stmt,i);
+            value = sqlite3_column_double(stmt,i);
             break;
         case SQLITE_TEXT:
-            row[name] = (const char*)sqlite3_column_text(stmt,i);
+            value = (const char*)sqlite3_column_text(stmt,i);
             break;
         case SQLITE_BLOB:
             throw SqlException("BLOB column data is not supported");
         case SQLITE_NULL:
-            row[name] = Json::Value();
             break;
         default:
-            row[name] = (const char*)sqlite3_column_text(stmt,i);
+            value = (const char*)sqlite3_column_text(stmt,i);
             break;
         } 
     }
@@ -162,39 +246,312 @@ Json::Value SqliteDbConnection::queryGetRow(){
 Json::Value SqliteDbConnection::execute(){
     Json::Value rowData;
     rowData.resize(0);
-    while(queryStep()==SQLITE_ROW){
-        rowData.append(queryGetRow());
+    if(queryStep()==SQLITE_ROW){
+        const std::vector<SqliteColumn>& columns = describe();
+        do{
+            rowData.append(queryGetRow(columns));
+        }while(queryStep()==SQLITE_ROW);
     }
     return rowData;
 }
 
+void SqliteDbConnection::executeStream(JsonStreamWriter& writer){
+    writer.beginArray();
+    if(queryStep()!=SQLITE_ROW){
+        writer.endArray();
+        return;
+    }
+
+    const std::vector<SqliteColumn>& columns = describe();
+    do{
+        writer.beginObject();
+        for(size_t i=0; i<columns.size(); i++){
+            const SqliteColumn& column = columns[i];
+            writer.escapedKey(column.quotedKey);
+
+            switch(sqlite3_column_type(stmt,i)){
+            case SQLITE_INTEGER:
+                writer.intValue(sqlite3_column_int64(stmt,i));
+                break;
+            case SQLITE_FLOAT:
+                writer.realValue(sqlite3_column_double(stmt,i));
+                break;
+            case SQLITE_BLOB:
+                throw SqlException("BLOB column data is not supported");
+            case SQLITE_NULL:
+                writer.nullValue();
+                break;
+            case SQLITE_TEXT:
+            default:
+                writer.stringValue(std::string_view(
+                    (const char*)sqlite3_column_text(stmt,i),
+                    sqlite3_column_bytes(stmt,i)));
+                break;
+            }
+        }
+        writer.endObject();
+    }while(queryStep()==SQLITE_ROW);
+    writer.endArray();
+}
+
+// finishes the current statement; the database handle stays open for reuse
 void SqliteDbConnection::close(){
-    if(handle != NULL){
-        sqlite3_finalize(stmt);
-        handle = NULL;
+    if(stmt != NULL){
+        // BEGIN and COMMIT count as read-only, so a write inside a
+        // transaction is held over until the transaction ends
+        if(!sqlite3_stmt_readonly(stmt)){
+            written = true;
+        }
+        if(stmtCached){
+            sqlite3_reset(stmt);
+            sqlite3_clear_bindings(stmt);
+        }
+        else{
+            sqlite3_finalize(stmt);
+        }
+        stmt = NULL;
+        stmtCached = false;
+        statement = NULL;
     }
-    if(handle != NULL){
-        sqlite3_close_v2(handle);
-        handle = NULL;
-    } 
+    // the statement has finished, so any autocommit has happened
+    if(written && sqlite3_get_autocommit(handle)){
+        db->dataVersion++;
+        written = false;
+    }
+    bindIndex = 0;
 }
 
 ///////////
-SqliteDb::SqliteDb(std::string dbFile){
+SqliteDb::SqliteDb(std::string dbFile,const Json::Value& poolConfig,size_t statementCacheSize,
+    int dataVersionInterval){
     this->dbFile = dbFile;
+    this->statementCacheSize = statementCacheSize;
+    this->dataVersionInterval = dataVersionInterval;
+
+    poolSize = poolConfig.get("size",8).asUInt();
+    maxIdle = poolConfig.get("maxIdle",(Json::UInt)poolSize).asUInt();
+    idleTimeout = poolConfig.get("idleTimeout",300).asInt();
+    waitTimeout = poolConfig.get("waitTimeout",5000).asInt();
+    if(poolSize == 0){
+        throw MinibarException("DB pool size must be at least 1");
+    }
+
+    pthread_mutex_init(&mutex,NULL);
+    pthread_cond_init(&available,NULL);
+    openCount = 0;
+    hits = 0;
+    misses = 0;
+    waits = 0;
+    timeouts = 0;
+    statementHits = 0;
+    statementMisses = 0;
+
+    pthread_mutex_init(&versionMutex,NULL);
+    dataVersion = 0;
+    versionHandle = NULL;
+    versionStmt = NULL;
+    externalVersion = -1;
+    nextVersionCheck = 0;
 }
 
 SqliteDb::~SqliteDb(){
-    //do nothing
+    for(SqliteDbConnection* con: idle){
+        delete con;
+    }
+    sqlite3_finalize(versionStmt);
+    sqlite3_close_v2(versionHandle);
+    pthread_mutex_destroy(&versionMutex);
+    pthread_cond_destroy(&available);
+    pthread_mutex_destroy(&mutex);
+}
+
+// moves connections idle for longer than idleTimeout to 'expired'
+// must be called with the pool mutex held
+void SqliteDb::expireIdle(vector<SqliteDbConnection*>& expired){
+    if(idleTimeout <= 0) return;
+
+    time_t cutoff = time(NULL) - idleTimeout;
+    auto keep = std::partition(idle.begin(),idle.end(),[cutoff](SqliteDbConnection* con){
+        return con->released < cutoff;
+    });
+    expired.assign(idle.begin(),keep);
+    idle.erase(idle.begin(),keep);
+    openCount -= expired.size();
 }
 
 Connection* SqliteDb::getConnection(){
-    return new SqliteDbConnection(dbFile);
+    vector<SqliteDbConnection*> expired;
+    SqliteDbConnection* con = NULL;
+    pthread_t self = pthread_self();
+    bool timedOut = false;
+    {
+        RAIILock lock(&mutex);
+        expireIdle(expired);
+
+        if(idle.empty() && openCount >= poolSize){
+            // exhausted - wait for a connection to be released
+            waits++;
+            struct timespec deadline;
+            clock_gettime(CLOCK_REALTIME,&deadline);
+            deadline.tv_sec += waitTimeout / 1000;
+            deadline.tv_nsec += (waitTimeout % 1000) * 1000000L;
+            if(deadline.tv_nsec >= 1000000000L){
+                deadline.tv_sec++;
+                deadline.tv_nsec -= 1000000000L;
+            }
+            while(idle.empty() && openCount >= poolSize){
+                if(pthread_cond_timedwait(&available,&mutex,&deadline) == ETIMEDOUT){
+                    break;
+                }
+            }
+        }
+
+        if(!idle.empty()){
+            // prefer the connection this thread used last, then the most recent
+            auto it = std::find_if(idle.rbegin(),idle.rend(),[self](SqliteDbConnection* con){
+                return pthread_equal(con->owner,self);
+            });
+            if(it == idle.rend()){
+                it = idle.rbegin();
+            }
+            con = *it;
+            idle.erase(std::next(it).base());
+            hits++;
+        }
+        else if(openCount < poolSize){
+            // reserve a slot and open outside the lock
+            openCount++;
+            misses++;
+        }
+        else{
+            timeouts++;
+            timedOut = true;
+        }
+    }
+
+    for(SqliteDbConnection* old: expired){
+        delete old;
+    }
+    if(timedOut){
+        throw SqlException("Timed out waiting for a database connection");
+    }
+
+    if(con == NULL){
+        try{
+            con = new SqliteDbConnection(this);
+        }
+        catch(...){
+            RAIILock lock(&mutex);
+            openCount--;
+            pthread_cond_signal(&available);
+            throw;
+        }
+    }
+    con->owner = self;
+    return con;
+}
+
+void SqliteDb::releaseConnection(Connection* con){
+    SqliteDbConnection* sqliteCon = static_cast<SqliteDbConnection*>(con);
+    sqliteCon->close();
+    sqliteCon->released = time(NULL);
+    {
+        RAIILock lock(&mutex);
+        if(idle.size() < maxIdle){
+            idle.push_back(sqliteCon);
+            sqliteCon = NULL;
+        }
+        else{
+            openCount--;
+        }
+        pthread_cond_signal(&available);
+    }
+    delete sqliteCon;
+}
+
+Json::Value SqliteDb::getStats(){
+    RAIILock lock(&mutex);
+    Json::Value stats;
+    stats["type"] = "sqlite3";
+    stats["poolSize"] = (Json::UInt64)poolSize;
+    stats["open"] = (Json::UInt64)openCount;
+    stats["idle"] = (Json::UInt64)idle.size();
+    stats["hits"] = (Json::UInt64)hits;
+    stats["misses"] = (Json::UInt64)misses;
+    stats["waits"] = (Json::UInt64)waits;
+    stats["timeouts"] = (Json::UInt64)timeouts;
+
+    unsigned long statementLookups = statementHits + statementMisses;
+    stats["statementCacheSize"] = (Json::UInt64)statementCacheSize;
+    stats["statementHits"] = (Json::UInt64)statementHits;
+    stats["statementMisses"] = (Json::UInt64)statementMisses;
+    stats["statementHitRate"] = statementLookups == 0 ? 0.0 :
+        (double)statementHits / statementLookups;
+    return stats;
+}
+
+bool SqliteDb::tracksChanges(){
+    return true;
+}
+
+static int64_t monotonicMillis(){
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC,&ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+uint64_t SqliteDb::getDataVersion(){
+    if(dataVersionInterval >= 0){
+        int64_t now = monotonicMillis();
+        // only one thread checks at a time; the rest carry on with the
+        // version as it stands
+        if(now >= nextVersionCheck.load(std::memory_order_relaxed) &&
+            pthread_mutex_trylock(&versionMutex) == 0){
+            try{
+                checkExternalChanges();
+            }
+            catch(...){
+                pthread_mutex_unlock(&versionMutex);
+                throw;
+            }
+            nextVersionCheck.store(now + dataVersionInterval,std::memory_order_relaxed);
+            pthread_mutex_unlock(&versionMutex);
+        }
+    }
+    return dataVersion.load();
+}
+
+// PRAGMA data_version changes when any other connection commits, including
+// the pool's own.  Must be called with versionMutex held.
+void SqliteDb::checkExternalChanges(){
+    if(versionHandle == NULL){
+        int result = sqlite3_open_v2(dbFile.c_str(),&versionHandle,SQLITE_OPEN_READONLY,NULL);
+        if(result == SQLITE_OK){
+            result = sqlite3_prepare_v2(versionHandle,"PRAGMA data_version",-1,&versionStmt,NULL);
+        }
+        if(result != SQLITE_OK){
+            sqlite3_close_v2(versionHandle);
+            versionHandle = NULL;
+            throw SqlException(result);
+        }
+    }
+
+    int64_t version = -1;
+    if(sqlite3_step(versionStmt) == SQLITE_ROW){
+        version = sqlite3_column_int64(versionStmt,0);
+    }
+    sqlite3_reset(versionStmt);
+    if(version != externalVersion){
+        externalVersion = version;
+        dataVersion++;
+    }
 }
 
 Database* SqliteDb::Create(Json::Value root){
     std::string dbFile = root["filename"].asString();
-    return new SqliteDb(dbFile);
+    size_t statementCacheSize = root.get("statementCache",32).asUInt();
+    int dataVersionInterval = root.get("dataVersionInterval",1000).asInt();
+    return new SqliteDb(dbFile,root["pool"],statementCacheSize,dataVersionInterval);
 }
 
 }
@@ -0,0 +1,212 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/prctl.h>
+#include <sys/wait.h>
+
+#include <vector>
+
+#include "supervisor.h"
+
+namespace minibar{
+
+static volatile sig_atomic_t stopSignal = 0;
+
+static void onStop(int signal){
+    stopSignal = signal;
+}
+
+// SIGCHLD and SIGALRM only need to interrupt ppoll()
+static void onWake(int){
+}
+
+struct ChildProcess{
+    pid_t pid;
+    time_t started;
+    time_t restartAt;
+};
+
+// the first two stop the supervisor
+static const int HANDLED_SIGNALS[] = {SIGTERM, SIGINT, SIGCHLD, SIGALRM};
+static const int HANDLED_COUNT = sizeof(HANDLED_SIGNALS) / sizeof(HANDLED_SIGNALS[0]);
+
+static void describeExit(int index,pid_t pid,int status){
+    if(WIFSIGNALED(status)){
+        fprintf(stderr,"worker %d (pid %d) killed by signal %d\n",index,(int)pid,WTERMSIG(status));
+    }
+    else{
+        fprintf(stderr,"worker %d (pid %d) exited with status %d\n",index,(int)pid,WEXITSTATUS(status));
+    }
+}
+
+int superviseWorkers(int processes,const std::function<int(int index)>& childMain,
+    int controlFd,const std::function<bool()>& onControl){
+    sigset_t handled;
+    sigset_t original;
+    sigemptyset(&handled);
+    for(int signal: HANDLED_SIGNALS){
+        sigaddset(&handled,signal);
+    }
+    // signals are only taken in ppoll(), so none is missed between
+    // checking for work and waiting for it
+    sigprocmask(SIG_BLOCK,&handled,&original);
+
+    struct sigaction action;
+    struct sigaction previous[HANDLED_COUNT];
+    memset(&action,0,sizeof(action));
+    sigemptyset(&action.sa_mask);
+    for(int i=0; i<HANDLED_COUNT; i++){
+        action.sa_handler = i < 2 ? onStop : onWake;
+        sigaction(HANDLED_SIGNALS[i],&action,&previous[i]);
+    }
+    stopSignal = 0;
+    bool stopping = false;
+    pid_t supervisor = getpid();
+
+    std::vector<ChildProcess> children(processes);
+    for(ChildProcess& child: children){
+        child.pid = 0;
+        child.started = 0;
+        child.restartAt = 0;
+    }
+
+    while(true){
+        int status;
+        pid_t pid;
+        while((pid = waitpid(-1,&status,WNOHANG)) > 0){
+            for(int i=0; i<processes; i++){
+                if(children[i].pid != pid){
+                    continue;
+                }
+                time_t now = time(NULL);
+                children[i].pid = 0;
+                children[i].restartAt = now - children[i].started < 1 ? now + 1 : now;
+                if(!stopSignal && !stopping){
+                    describeExit(i,pid,status);
+                }
+            }
+        }
+        if(stopSignal || stopping){
+            break;
+        }
+
+        time_t now = time(NULL);
+        bool pending = false;
+        for(int i=0; i<processes; i++){
+            ChildProcess& child = children[i];
+            if(child.pid != 0){
+                continue;
+            }
+            if(child.restartAt > now){
+                pending = true;
+                continue;
+            }
+            fflush(NULL);
+            child.pid = fork();
+            if(child.pid == 0){
+                for(int s=0; s<HANDLED_COUNT; s++){
+                    sigaction(HANDLED_SIGNALS[s],&previous[s],NULL);
+                }
+                sigprocmask(SIG_SETMASK,&original,NULL);
+                if(controlFd >= 0){
+                    close(controlFd);
+                }
+                prctl(PR_SET_PDEATHSIG,SIGTERM);
+                if(getppid() != supervisor){
+                    _exit(1);
+                }
+                exit(childMain(i));
+            }
+            if(child.pid < 0){
+                perror("fork");
+                child.pid = 0;
+                child.restartAt = now + 1;
+                pending = true;
+                continue;
+            }
+            child.started = now;
+        }
+        if(pending){
+            alarm(1);
+        }
+        struct pollfd control = {controlFd,POLLIN,0};
+        if(ppoll(&control,1,NULL,&original) > 0 && onControl()){
+            stopping = true;
+        }
+    }
+
+    for(ChildProcess& child: children){
+        if(child.pid != 0){
+            kill(child.pid,SIGTERM);
+        }
+    }
+    while(waitpid(-1,NULL,0) > 0 || errno == EINTR){
+        //until every child is gone
+    }
+
+    alarm(0);
+    for(int i=0; i<HANDLED_COUNT; i++){
+        sigaction(HANDLED_SIGNALS[i],&previous[i],NULL);
+    }
+    sigprocmask(SIG_SETMASK,&original,NULL);
+    return 0;
+}
+
+bool pinToCpu(int index){
+    cpu_set_t allowed;
+    if(sched_getaffinity(0,sizeof(allowed),&allowed) < 0){
+        return false;
+    }
+    int count = CPU_COUNT(&allowed);
+    if(count == 0){
+        return false;
+    }
+    int target = index % count;
+    for(int cpu=0; cpu<CPU_SETSIZE; cpu++){
+        if(!CPU_ISSET(cpu,&allowed) || target-- > 0){
+            continue;
+        }
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(cpu,&set);
+        return sched_setaffinity(0,sizeof(set),&set) == 0;
+    }
+    return false;
+}
+
+}
@@ -0,0 +1,93 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string.h>
+#include <string>
+#include <vector>
+
+#include "arena.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+TEST(Arena,Allocate){
+    Arena arena(256);
+    ASSERT_EQ(arena.bytesUsed(),0u);
+
+    char* a = (char*)arena.allocate(10,1);
+    char* b = (char*)arena.allocate(8,8);
+    ASSERT_EQ((uintptr_t)b % 8,0u);
+    ASSERT_GE(b,a + 10);
+    memset(a,'a',10);
+    memset(b,'b',8);
+
+    // larger than a chunk
+    char* big = (char*)arena.allocate(1000,16);
+    ASSERT_EQ((uintptr_t)big % 16,0u);
+    memset(big,'c',1000);
+    ASSERT_GE(arena.bytesUsed(),1018u);
+    ASSERT_EQ(a[9],'a');
+    ASSERT_EQ(b[7],'b');
+
+    arena.reset();
+    ASSERT_EQ(arena.bytesUsed(),0u);
+
+    // after a reset the arena holds everything the last round needed in one
+    // chunk, so the same allocations stay within it
+    char* first = (char*)arena.allocate(10,1);
+    ASSERT_TRUE(arena.allocate(8,8) != NULL);
+    char* again = (char*)arena.allocate(1000,16);
+    ASSERT_LT(again - first,1100);
+}
+
+TEST(Arena,Containers){
+    Arena arena;
+    {
+        std::pmr::vector<std::pmr::string> strings(&arena);
+        for(int i=0; i<100; i++){
+            strings.emplace_back("a string long enough to skip the small string buffer " + std::to_string(i));
+        }
+        ASSERT_EQ(strings[99],"a string long enough to skip the small string buffer 99");
+        ASSERT_GT(arena.bytesUsed(),100u * 50);
+    }
+    arena.reset();
+    ASSERT_EQ(arena.bytesUsed(),0u);
+}
+
+TEST(Arena,RequestScope){
+    uint64_t before = getArenaStats()["requests"].asUInt64();
+    {
+        RequestArenaScope scope;
+        ASSERT_TRUE(getRequestArena().allocate(100,8) != NULL);
+        ASSERT_GE(getRequestArena().bytesUsed(),100u);
+    }
+    ASSERT_EQ(getRequestArena().bytesUsed(),0u);
+    ASSERT_EQ(getArenaStats()["requests"].asUInt64(),before + 1);
+    ASSERT_GE(getArenaStats()["maxBytes"].asUInt64(),100u);
+}
@@ -31,6 +31,72 @@ either expressed or implied, of the FreeBSD Project.
 #include "minibar.h"
 #include "gtest/gtest.h"
 
-//TEST(MinibarCGI,Unittest){
-//   //do nothing
-//}
+
+using namespace minibar;
+
+TEST(MinibarCGI,QueryString){
+    QueryString query;
+    std::string data = "a=1&b=two&&flag&c=x=y&";
+    query.parse(data);
+    ASSERT_EQ(query.size(),4u);
+    ASSERT_EQ(query[0].key,"a");
+    ASSERT_EQ(query[0].value,"1");
+    ASSERT_EQ(query[1].key,"b");
+    ASSERT_EQ(query[1].value,"two");
+    ASSERT_EQ(query[2].key,"flag");
+    ASSERT_FALSE(query[2].hasValue);
+    ASSERT_EQ(query[3].key,"c");
+    ASSERT_EQ(query[3].value,"x=y");
+
+    // unescaped pairs are views into the original buffer
+    ASSERT_EQ(query[1].value.data(),data.data() + 6);
+
+    Json::Value value;
+    ASSERT_TRUE(query.get("b",value));
+    ASSERT_EQ(value,"two");
+    ASSERT_TRUE(query.get("flag",value));
+    ASSERT_TRUE(value.isNull());
+    ASSERT_FALSE(query.get("missing",value));
+}
+
+TEST(MinibarCGI,QueryStringEscapes){
+    QueryString query;
+    // long enough to take the vectorized path, with escapes in both halves
+    std::string data = "name=John+Smith&filter=age%3E30%26name%3Dbob&plain=value&sp%61ce=a%20b";
+    query.parse(data);
+    ASSERT_EQ(query.size(),4u);
+    ASSERT_EQ(query[0].value,"John Smith");
+    ASSERT_EQ(query[1].value,"age>30&name=bob");
+    ASSERT_EQ(query[2].value,"value");
+    ASSERT_EQ(query[2].value.data(),data.data() + data.find("value"));
+    ASSERT_EQ(query[3].key,"space");
+    ASSERT_EQ(query[3].value,"a b");
+
+    // the source is left alone
+    ASSERT_EQ(data,"name=John+Smith&filter=age%3E30%26name%3Dbob&plain=value&sp%61ce=a%20b");
+
+    ASSERT_THROW(query.parse("a=%4"),MinibarException);
+    ASSERT_THROW(query.parse("a=%zz"),MinibarException);
+}
+
+TEST(MinibarCGI,QueryStringRepeated){
+    QueryString query;
+    std::string data;
+    for(int i=0; i<40; i++){
+        data += "id=" + std::to_string(i) + "&";
+    }
+    data += "last=1";
+    query.parse(data);
+    ASSERT_EQ(query.size(),41u);
+
+    Json::Value ids;
+    ASSERT_TRUE(query.get("id",ids));
+    ASSERT_TRUE(ids.isArray());
+    ASSERT_EQ(ids.size(),40u);
+    ASSERT_EQ(ids[39],"39");
+
+    Json::Value json = parseQueryString(data);
+    ASSERT_EQ(json["id"].size(),40u);
+    ASSERT_EQ(json["last"],"1");
+    ASSERT_EQ(parseQueryString(""),Json::Value(Json::objectValue));
+}
@@ -0,0 +1,131 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "configcache.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+// temporary config file, removed when the test ends
+class TempConfig{
+public:
+    std::string filename;
+
+    TempConfig(){
+        char path[] = "/tmp/minibar-config-XXXXXX";
+        close(mkstemp(path));
+        filename = path;
+    }
+    ~TempConfig(){
+        unlink(filename.c_str());
+    }
+    void write(const std::string& data){
+        std::ofstream out(filename,std::ios::trunc);
+        out << data;
+    }
+};
+
+static const char* CONFIG_A = R"({"DB":{},"REST":{"GET/a":{"special":"api"}}})";
+static const char* CONFIG_B = R"({"DB":{},"REST":{"GET/b":{"special":"api"},"GET/bb":{"special":"api"}}})";
+
+TEST(ConfigCache,Load){
+    TempConfig file;
+    file.write(CONFIG_A);
+    ConfigCache cache(0);
+
+    Config* config = cache.getConfig(file.filename);
+    ASSERT_EQ(cache.getConfig(file.filename),config);
+    ASSERT_EQ(cache.checkForChanges(),0);
+    ASSERT_EQ(cache.getConfig(file.filename),config);
+    ASSERT_EQ(cache.getGeneration(file.filename),0u);
+
+    ASSERT_THROW(cache.getConfig("/tmp/minibar-config-missing"),MinibarException);
+}
+
+TEST(ConfigCache,Reload){
+    TempConfig file;
+    file.write(CONFIG_A);
+    ConfigCache cache(0);
+
+    Json::Value pathValues;
+    Config* before = cache.getConfig(file.filename);
+    ASSERT_NO_THROW(before->getRestNode("GET/a",pathValues));
+
+    file.write(CONFIG_B);
+    ASSERT_EQ(cache.checkForChanges(),1);
+    ASSERT_EQ(cache.getGeneration(file.filename),1u);
+
+    // a request already holding the old config can still use it
+    ASSERT_NO_THROW(before->getRestNode("GET/a",pathValues));
+    ASSERT_EQ(before->toJson()["REST"].size(),1u);
+
+    Config* after = cache.getConfig(file.filename);
+    ASSERT_NE(after,before);
+    ASSERT_NO_THROW(after->getRestNode("GET/b",pathValues));
+    ASSERT_THROW(after->getRestNode("GET/a",pathValues),MinibarException);
+}
+
+TEST(ConfigCache,BadReload){
+    TempConfig file;
+    file.write(CONFIG_A);
+    ConfigCache cache(0);
+    Config* config = cache.getConfig(file.filename);
+
+    // a broken edit keeps the previous config
+    file.write("{\"DB\":");
+    ASSERT_EQ(cache.checkForChanges(),0);
+    ASSERT_EQ(cache.getConfig(file.filename),config);
+
+    // and a missing file is ignored
+    unlink(file.filename.c_str());
+    ASSERT_EQ(cache.checkForChanges(),0);
+    ASSERT_EQ(cache.getConfig(file.filename),config);
+
+    file.write(CONFIG_B);
+    ASSERT_EQ(cache.checkForChanges(),1);
+    ASSERT_NE(cache.getConfig(file.filename),config);
+}
+
+TEST(ConfigCache,Watcher){
+    TempConfig file;
+    file.write(CONFIG_A);
+    ConfigCache cache(10);
+    Config* config = cache.getConfig(file.filename);
+
+    file.write(CONFIG_B);
+    for(int i=0; i<200 && cache.getGeneration(file.filename) == 0; i++){
+        usleep(10000);
+    }
+    ASSERT_EQ(cache.getGeneration(file.filename),1u);
+    ASSERT_NE(cache.getConfig(file.filename),config);
+}
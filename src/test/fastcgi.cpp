@@ -27,8 +27,6 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the FreeBSD Project.
 */
 
-#include "fcgi_config.h"
-#include "fcgiapp.h"
 #include "utils.h"
 #include "minibar.h"
 
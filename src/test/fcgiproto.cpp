@@ -0,0 +1,352 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "fcgiproto.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+TEST(FcgiProto,Header){
+    std::string out;
+    fcgi::appendHeader(out,fcgi::STDOUT,0x1234,0x5678,3);
+    ASSERT_EQ(out.length(),(size_t)fcgi::HEADER_LENGTH);
+
+    fcgi::Header header = fcgi::parseHeader((const unsigned char*)out.data());
+    ASSERT_EQ(header.version,fcgi::VERSION_1);
+    ASSERT_EQ(header.type,fcgi::STDOUT);
+    ASSERT_EQ(header.requestId,0x1234);
+    ASSERT_EQ(header.contentLength,0x5678);
+    ASSERT_EQ(header.paddingLength,3);
+}
+
+TEST(FcgiProto,Stream){
+    std::string out;
+    fcgi::appendStream(out,fcgi::STDIN,1,"");
+    ASSERT_EQ(out.length(),(size_t)fcgi::HEADER_LENGTH);
+
+    // content above the record limit is split and each record padded to 8 bytes
+    std::string content(fcgi::MAX_CONTENT_LENGTH + 10,'x');
+    out.clear();
+    fcgi::appendStream(out,fcgi::STDIN,1,content);
+
+    std::string decoded;
+    size_t pos = 0;
+    int records = 0;
+    while(pos < out.length()){
+        fcgi::Header header = fcgi::parseHeader((const unsigned char*)out.data()+pos);
+        ASSERT_EQ(header.type,fcgi::STDIN);
+        ASSERT_EQ((header.contentLength + header.paddingLength) % 8,0);
+        decoded.append(out,pos+fcgi::HEADER_LENGTH,header.contentLength);
+        pos += fcgi::HEADER_LENGTH + header.contentLength + header.paddingLength;
+        records++;
+    }
+    ASSERT_EQ(pos,out.length());
+    ASSERT_EQ(records,2);
+    ASSERT_EQ(decoded,content);
+}
+
+TEST(FcgiProto,NameValue){
+    std::string longValue(300,'v');
+    std::string out;
+    fcgi::appendNameValue(out,"REQUEST_METHOD","GET");
+    fcgi::appendNameValue(out,"QUERY_STRING",longValue);
+    fcgi::appendNameValue(out,"EMPTY","");
+    // 1 byte lengths below 128, 4 bytes above
+    ASSERT_EQ(out.length(),(size_t)(2+14+3 + 1+4+12+300 + 2+5));
+
+    const char* pos = out.data();
+    const char* end = out.data() + out.length();
+    std::string_view name,value;
+    ASSERT_TRUE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(name,"REQUEST_METHOD");
+    ASSERT_EQ(value,"GET");
+    ASSERT_TRUE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(name,"QUERY_STRING");
+    ASSERT_EQ(value,longValue);
+    ASSERT_TRUE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(name,"EMPTY");
+    ASSERT_EQ(value,"");
+    ASSERT_EQ(pos,end);
+    ASSERT_FALSE(fcgi::readNameValue(pos,end,name,value));
+
+    // truncated pairs are rejected without moving pos
+    pos = out.data();
+    end = out.data() + 10;
+    ASSERT_FALSE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(pos,out.data());
+}
+
+TEST(FcgiProto,BeginEndRequest){
+    std::string out;
+    fcgi::appendBeginRequest(out,7,fcgi::RESPONDER,fcgi::KEEP_CONN);
+    fcgi::appendEndRequest(out,7,0x01020304,fcgi::REQUEST_COMPLETE);
+    ASSERT_EQ(out.length(),(size_t)32);
+
+    const unsigned char* data = (const unsigned char*)out.data();
+    fcgi::Header header = fcgi::parseHeader(data);
+    ASSERT_EQ(header.type,fcgi::BEGIN_REQUEST);
+    ASSERT_EQ(header.requestId,7);
+    ASSERT_EQ(header.contentLength,8);
+    ASSERT_EQ((data[8] << 8) | data[9],fcgi::RESPONDER);
+    ASSERT_EQ(data[10],fcgi::KEEP_CONN);
+
+    header = fcgi::parseHeader(data+16);
+    ASSERT_EQ(header.type,fcgi::END_REQUEST);
+    ASSERT_EQ(data[24],1);
+    ASSERT_EQ(data[27],4);
+    ASSERT_EQ(data[28],fcgi::REQUEST_COMPLETE);
+}
+
+static std::string encodeParams(std::string_view method,std::string_view path){
+    std::string params;
+    fcgi::appendNameValue(params,"SCRIPT_FILENAME","resources/test.mini");
+    fcgi::appendNameValue(params,"REQUEST_METHOD",method);
+    fcgi::appendNameValue(params,"SERVER_PROTOCOL","HTTP/1.1");
+    fcgi::appendNameValue(params,"PATH_INFO",path);
+    return params;
+}
+
+TEST(FcgiProto,ServerInterleaved){
+    // two requests with their records interleaved
+    std::string in;
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,fcgi::KEEP_CONN);
+    fcgi::appendBeginRequest(in,2,fcgi::RESPONDER,0);
+    fcgi::appendStream(in,fcgi::PARAMS,2,encodeParams("POST","/two"));
+    fcgi::appendStream(in,fcgi::PARAMS,1,encodeParams("GET","/one"));
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,2,"{\"a\":");
+    fcgi::appendStream(in,fcgi::STDIN,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,2,"1}");
+    fcgi::appendStream(in,fcgi::PARAMS,2,"");
+    fcgi::appendStream(in,fcgi::STDIN,2,"");
+
+    // fed a few bytes at a time, as reads may split records anywhere
+    fcgi::ServerConnection connection(10,10);
+    std::string out;
+    std::vector<fcgi::ServerRequest*> ready;
+    std::string buffered;
+    for(size_t pos=0; pos<in.length(); pos+=5){
+        buffered.append(in,pos,5);
+        long used = connection.consume(buffered.data(),buffered.length(),out,ready);
+        ASSERT_GE(used,0);
+        buffered.erase(0,used);
+    }
+    ASSERT_EQ(buffered,"");
+    ASSERT_EQ(out,"");
+    ASSERT_EQ(ready.size(),2u);
+    ASSERT_EQ(connection.getActiveCount(),2);
+
+    fcgi::ServerRequest* one = ready[0];
+    ASSERT_EQ(one->id,1);
+    ASSERT_TRUE(one->keepConn);
+    ASSERT_EQ(one->getParam(fcgi::PARAM_REQUEST_METHOD),"GET");
+    ASSERT_EQ(one->getParam(fcgi::PARAM_PATH_INFO),"/one");
+    ASSERT_EQ(one->getParam(fcgi::PARAM_SCRIPT_FILENAME),"resources/test.mini");
+    ASSERT_EQ(one->getParam(fcgi::PARAM_QUERY_STRING),"");
+    ASSERT_EQ(one->body,"");
+
+    fcgi::ServerRequest* two = ready[1];
+    ASSERT_EQ(two->id,2);
+    ASSERT_FALSE(two->keepConn);
+    ASSERT_EQ(two->getParam(fcgi::PARAM_REQUEST_METHOD),"POST");
+    ASSERT_EQ(two->getParam(fcgi::PARAM_PATH_INFO),"/two");
+    ASSERT_EQ(two->body,"{\"a\":1}");
+
+    connection.finish(two,out);
+    connection.finish(one,out);
+    ASSERT_EQ(connection.getActiveCount(),0);
+    ASSERT_EQ(out.length(),32u);
+    ASSERT_EQ(fcgi::parseHeader((const unsigned char*)out.data()).requestId,2);
+    ASSERT_EQ(fcgi::parseHeader((const unsigned char*)out.data()+16).type,fcgi::END_REQUEST);
+
+    // ids are reused once finished
+    in.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,1,"");
+    ready.clear();
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(ready.size(),1u);
+    ASSERT_EQ(ready[0]->getParam(fcgi::PARAM_PATH_INFO),"");
+}
+
+// the record types and request ids answered in 'out'
+static std::vector<std::pair<int,int>> replies(const std::string& out){
+    std::vector<std::pair<int,int>> result;
+    for(size_t pos=0; pos<out.length();){
+        fcgi::Header header = fcgi::parseHeader((const unsigned char*)out.data()+pos);
+        result.push_back(std::make_pair(header.type,header.requestId));
+        pos += fcgi::HEADER_LENGTH + header.contentLength + header.paddingLength;
+    }
+    return result;
+}
+
+TEST(FcgiProto,ServerManagement){
+    fcgi::ServerConnection connection(4,2);
+    std::string in,out;
+    std::vector<fcgi::ServerRequest*> ready;
+
+    std::string names;
+    fcgi::appendNameValue(names,"FCGI_MPXS_CONNS","");
+    fcgi::appendNameValue(names,"FCGI_MAX_REQS","");
+    fcgi::appendNameValue(names,"UNKNOWN","");
+    fcgi::appendStream(in,fcgi::GET_VALUES,0,names);
+    fcgi::appendHeader(in,42,0,0);
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(replies(out),(std::vector<std::pair<int,int>>{{fcgi::GET_VALUES_RESULT,0},{fcgi::UNKNOWN_TYPE,0}}));
+
+    const char* pos = out.data() + fcgi::HEADER_LENGTH;
+    const char* end = pos + fcgi::parseHeader((const unsigned char*)out.data()).contentLength;
+    std::string_view name,value;
+    ASSERT_TRUE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(name,"FCGI_MPXS_CONNS");
+    ASSERT_EQ(value,"1");
+    ASSERT_TRUE(fcgi::readNameValue(pos,end,name,value));
+    ASSERT_EQ(name,"FCGI_MAX_REQS");
+    ASSERT_EQ(value,"2");
+    ASSERT_EQ(pos,end);
+    ASSERT_EQ(out[out.length()-8],42);
+
+    // only responders are served, and only up to FCGI_MAX_REQS at once
+    in.clear();
+    out.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::AUTHORIZER,0);
+    fcgi::appendBeginRequest(in,2,fcgi::RESPONDER,0);
+    fcgi::appendBeginRequest(in,3,fcgi::RESPONDER,0);
+    fcgi::appendBeginRequest(in,4,fcgi::RESPONDER,0);
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(replies(out),(std::vector<std::pair<int,int>>{{fcgi::END_REQUEST,1},{fcgi::END_REQUEST,4}}));
+    ASSERT_EQ(out[fcgi::HEADER_LENGTH+4],fcgi::UNKNOWN_ROLE);
+    ASSERT_EQ(out[16+fcgi::HEADER_LENGTH+4],fcgi::OVERLOADED);
+    ASSERT_EQ(connection.getActiveCount(),2);
+
+    // an abort ends a request still arriving at once, and marks one that
+    // was handed out
+    in.clear();
+    out.clear();
+    fcgi::appendStream(in,fcgi::PARAMS,3,"");
+    fcgi::appendStream(in,fcgi::STDIN,3,"");
+    fcgi::appendHeader(in,fcgi::ABORT_REQUEST,2,0);
+    fcgi::appendHeader(in,fcgi::ABORT_REQUEST,3,0);
+    fcgi::appendHeader(in,fcgi::ABORT_REQUEST,9,0);
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(replies(out),(std::vector<std::pair<int,int>>{{fcgi::END_REQUEST,2}}));
+    ASSERT_EQ(ready.size(),1u);
+    ASSERT_TRUE(ready[0]->aborted);
+    connection.finish(ready[0],out);
+    ASSERT_EQ(connection.getActiveCount(),0);
+}
+
+TEST(FcgiProto,ServerErrors){
+    std::string out;
+    std::vector<fcgi::ServerRequest*> ready;
+    std::string in;
+
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    in[0] = 2;
+    fcgi::ServerConnection badVersion(1,1);
+    ASSERT_EQ(badVersion.consume(in.data(),in.length(),out,ready),-1);
+
+    // a request id that is already in use
+    in.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::ServerConnection duplicate(1,1);
+    ASSERT_EQ(duplicate.consume(in.data(),in.length(),out,ready),-1);
+
+    // a truncated name-value pair
+    in.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::appendStream(in,fcgi::PARAMS,1,std::string("\x05\x01" "abc",5));
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::ServerConnection truncated(1,1);
+    ASSERT_EQ(truncated.consume(in.data(),in.length(),out,ready),-1);
+
+    // a partial record is left for later
+    in.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::ServerConnection partial(1,1);
+    ASSERT_EQ(partial.consume(in.data(),in.length()-1,out,ready),0);
+    ASSERT_EQ(out,"");
+}
+
+TEST(FcgiProto,ServerLimits){
+    fcgi::ServerConnection connection(1,2,10);
+    std::string in,out;
+    std::vector<fcgi::ServerRequest*> ready;
+
+    // a body past the limit is refused before it is all buffered
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,fcgi::KEEP_CONN);
+    fcgi::appendStream(in,fcgi::PARAMS,1,encodeParams("POST","/one"));
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,1,"0123456789");
+    fcgi::appendStream(in,fcgi::STDIN,1,"a");
+    fcgi::appendStream(in,fcgi::STDIN,1,"more");
+    fcgi::appendStream(in,fcgi::STDIN,1,"");
+
+    // so is a PARAMS stream past MAX_PARAMS_LENGTH
+    fcgi::appendBeginRequest(in,2,fcgi::RESPONDER,fcgi::KEEP_CONN);
+    fcgi::appendStream(in,fcgi::PARAMS,2,std::string(fcgi::MAX_PARAMS_LENGTH + 1,'x'));
+    fcgi::appendStream(in,fcgi::PARAMS,2,"");
+    fcgi::appendStream(in,fcgi::STDIN,2,"");
+
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(ready.size(),0u);
+    ASSERT_EQ(connection.getActiveCount(),0);
+    std::vector<std::pair<int,int>> expected = {
+        {fcgi::STDOUT,1},{fcgi::STDOUT,1},{fcgi::END_REQUEST,1},
+        {fcgi::STDOUT,2},{fcgi::STDOUT,2},{fcgi::END_REQUEST,2}};
+    ASSERT_EQ(replies(out),expected);
+    ASSERT_NE(out.find("Status: 413 "),std::string::npos);
+    ASSERT_NE(out.find("Status: 431 "),std::string::npos);
+    ASSERT_FALSE(connection.isCloseRequested());
+
+    // a body at the limit is accepted
+    in.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,fcgi::KEEP_CONN);
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,1,"0123456789");
+    fcgi::appendStream(in,fcgi::STDIN,1,"");
+    ASSERT_EQ(connection.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(ready.size(),1u);
+    ASSERT_EQ(ready[0]->body,"0123456789");
+
+    // without KEEP_CONN, the connection closes after the refusal
+    fcgi::ServerConnection closing(1,2,10);
+    in.clear();
+    out.clear();
+    ready.clear();
+    fcgi::appendBeginRequest(in,1,fcgi::RESPONDER,0);
+    fcgi::appendStream(in,fcgi::PARAMS,1,"");
+    fcgi::appendStream(in,fcgi::STDIN,1,"0123456789a");
+    ASSERT_EQ(closing.consume(in.data(),in.length(),out,ready),(long)in.length());
+    ASSERT_EQ(ready.size(),0u);
+    ASSERT_NE(out.find("Status: 413 "),std::string::npos);
+    ASSERT_TRUE(closing.isCloseRequested());
+}
@@ -0,0 +1,152 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "httpproto.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+static http::ParseResult parse(std::string_view data,http::Request& request){
+    return http::parseRequestHead(data,request);
+}
+
+TEST(HttpProto,Request){
+    http::Request request;
+    std::string data = "POST /users/bob%20smith?limit=10&x HTTP/1.1\r\n"
+        "Host: localhost\r\n"
+        "content-length:  12 \r\n"
+        "Expect: 100-continue\r\n"
+        "\r\n"
+        "{\"a\":\"body\"}";
+    ASSERT_EQ(parse(data,request),http::PARSE_COMPLETE);
+    ASSERT_EQ(request.method,"POST");
+    ASSERT_EQ(request.path,"/users/bob%20smith");
+    ASSERT_EQ(request.query,"limit=10&x");
+    ASSERT_EQ(request.minorVersion,1);
+    ASSERT_EQ(request.headLength,data.find('{'));
+    ASSERT_EQ(request.contentLength,12u);
+    ASSERT_TRUE(request.keepAlive);
+    ASSERT_TRUE(request.expectContinue);
+
+    // every prefix of the head is incomplete
+    for(size_t length=0; length<request.headLength; length++){
+        ASSERT_EQ(parse(data.substr(0,length),request),http::PARSE_INCOMPLETE) << length;
+    }
+}
+
+TEST(HttpProto,KeepAlive){
+    http::Request request;
+    ASSERT_EQ(parse("GET / HTTP/1.0\r\n\r\n",request),http::PARSE_COMPLETE);
+    ASSERT_FALSE(request.keepAlive);
+    ASSERT_EQ(parse("GET / HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n",request),http::PARSE_COMPLETE);
+    ASSERT_TRUE(request.keepAlive);
+    ASSERT_EQ(parse("GET / HTTP/1.1\r\nConnection: foo, close\r\n\r\n",request),http::PARSE_COMPLETE);
+    ASSERT_FALSE(request.keepAlive);
+
+    // leading blank lines and absolute-form targets
+    std::string data = "\r\n\r\nGET http://example.com/a?b HTTP/1.1\r\n\r\n";
+    ASSERT_EQ(parse(data,request),http::PARSE_COMPLETE);
+    ASSERT_EQ(request.path,"/a");
+    ASSERT_EQ(request.query,"b");
+    ASSERT_EQ(request.headLength,data.length());
+}
+
+TEST(HttpProto,Errors){
+    struct{
+        const char* data;
+        int status;
+    } invalid[] = {
+        {"GET\r\n\r\n",400},
+        {"GET  / HTTP/1.1\r\n\r\n",400},
+        {"GET / HTTP/2.0\r\n\r\n",505},
+        {"GET / FTP/1.0\r\n\r\n",400},
+        {"GET * HTTP/1.1\r\n\r\n",400},
+        {"G(T / HTTP/1.1\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nHost : x\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nHost: x\r\n folded\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nno colon\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nContent-Length: 1x\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nContent-Length: 1\r\nContent-Length: 2\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nTransfer-Encoding: gzip\r\n\r\n",501},
+        {"GET / HTTP/1.1\r\nTransfer-Encoding: chunked\r\nContent-Length: 1\r\n\r\n",400},
+        {"GET / HTTP/1.1\r\nExpect: something\r\n\r\n",417}
+    };
+    for(auto& test: invalid){
+        http::Request request;
+        ASSERT_EQ(parse(test.data,request),http::PARSE_ERROR) << test.data;
+        ASSERT_EQ(request.errorStatus,test.status) << test.data;
+    }
+
+    http::Request request;
+    ASSERT_EQ(parse("GET / HTTP/1.1\r\nTransfer-Encoding: gzip, chunked\r\n\r\n",request),http::PARSE_COMPLETE);
+    ASSERT_TRUE(request.chunked);
+
+    std::string huge = "GET / HTTP/1.1\r\nX: " + std::string(http::MAX_HEAD_LENGTH,'x');
+    ASSERT_EQ(parse(huge,request),http::PARSE_ERROR);
+    ASSERT_EQ(request.errorStatus,431);
+}
+
+TEST(HttpProto,DecodePath){
+    std::string out = "GET";
+    ASSERT_TRUE(http::decodePath("/users/bob%20smith/%C3%a9",out));
+    ASSERT_EQ(out,"GET/users/bob smith/\xc3\xa9");
+
+    out.clear();
+    ASSERT_FALSE(http::decodePath("/a%2",out));
+    out.clear();
+    ASSERT_FALSE(http::decodePath("/a%zz",out));
+    out.clear();
+    ASSERT_FALSE(http::decodePath("/a%00",out));
+}
+
+TEST(HttpProto,Response){
+    std::string cgiHead = "Status: 200 OK\r\nContent-type: application/json\r\n\r\n";
+    ASSERT_EQ(http::findCgiHeadEnd(cgiHead + "[]"),cgiHead.length());
+    ASSERT_EQ(http::findCgiHeadEnd("Status: 200 OK\r\n"),0u);
+
+    std::string out;
+    http::appendResponseHead(out,cgiHead,2,true);
+    ASSERT_EQ(out,"HTTP/1.1 200 OK\r\nContent-type: application/json\r\nContent-Length: 2\r\n\r\n");
+
+    out.clear();
+    http::appendResponseHead(out,"Status: 400 Bad Request\r\nContent-type: application/json\r\n\r\n",-1,false);
+    ASSERT_EQ(out,"HTTP/1.1 400 Bad Request\r\nContent-type: application/json\r\n"
+        "Transfer-Encoding: chunked\r\nConnection: close\r\n\r\n");
+
+    out.clear();
+    http::appendChunk(out,std::string(300,'x'));
+    http::appendChunk(out,"");
+    http::appendLastChunk(out);
+    ASSERT_EQ(out,"12c\r\n" + std::string(300,'x') + "\r\n0\r\n\r\n");
+
+    out.clear();
+    http::appendTextResponse(out,413,"too big",false);
+    ASSERT_EQ(out,"HTTP/1.1 413 Content Too Large\r\nContent-Type: text/plain\r\n"
+        "Content-Length: 7\r\nConnection: close\r\n\r\ntoo big");
+}
@@ -0,0 +1,143 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdlib.h>
+#include <math.h>
+#include <string>
+
+#include "jsonstream.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+static std::string writeJson(std::function<void(JsonStreamWriter&)> fn,size_t flushSize = 4096){
+    std::string output;
+    JsonStreamWriter writer([&output](const char* data,size_t length){
+        output.append(data,length);
+    },flushSize);
+    fn(writer);
+    writer.flush();
+    return output;
+}
+
+TEST(JsonStream,Escape){
+    std::string out;
+    appendJsonString(out,std::string_view("a\"b\\c\n\t\x01/\xc3\xa9",11));
+    ASSERT_EQ(out,"\"a\\\"b\\\\c\\n\\t\\u0001/\xc3\xa9\"");
+}
+
+TEST(JsonStream,EscapeRuns){
+    // escapes at every offset around the sixteen byte blocks
+    for(size_t length=0; length<40; length++){
+        for(size_t at=0; at<length; at++){
+            std::string str(length,'a');
+            str[at] = at % 2 ? '\n' : '"';
+            std::string expected = "\"" + str.substr(0,at) + (at % 2 ? "\\n" : "\\\"") +
+                str.substr(at + 1) + "\"";
+            std::string out;
+            appendJsonString(out,str);
+            ASSERT_EQ(out,expected) << length << " " << at;
+        }
+    }
+    std::string out;
+    appendJsonString(out,std::string_view("\x1f\x7f\x00\x80",4));
+    ASSERT_EQ(out,std::string("\"\\u001f\x7f\\u0000\x80\""));
+}
+
+TEST(JsonStream,Numbers){
+    ASSERT_EQ(writeJson([](JsonStreamWriter& w){
+        w.beginArray();
+        w.intValue(INT64_MIN);
+        w.intValue(0);
+        w.realValue(0.1);
+        w.realValue(1.0/3);
+        w.realValue(1e300);
+        w.realValue(-2.5e-8);
+        w.realValue(NAN);
+        w.endArray();
+    }),"[-9223372036854775808,0,0.1,0.3333333333333333,1e+300,-2.5e-08,null]");
+
+    // reals read back exactly
+    double values[] = {0.1, 19.99 + 7, 1.0/7, 5e-324, 1.7976931348623157e308};
+    for(double value: values){
+        std::string text = writeJson([value](JsonStreamWriter& w){
+            w.realValue(value);
+        });
+        ASSERT_EQ(strtod(text.c_str(),NULL),value) << text;
+    }
+}
+
+TEST(JsonStream,Structure){
+    ASSERT_EQ(writeJson([](JsonStreamWriter& w){
+        w.beginArray();
+        w.beginObject();
+        w.key("a");
+        w.intValue(-1);
+        w.key("b");
+        w.beginArray();
+        w.boolValue(true);
+        w.nullValue();
+        w.realValue(0.5);
+        w.endArray();
+        w.endObject();
+        w.stringValue("x");
+        w.uintValue(18446744073709551615ull);
+        w.endArray();
+    }),R"([{"a":-1,"b":[true,null,0.5]},"x",18446744073709551615])");
+}
+
+TEST(JsonStream,Value){
+    Json::Value value;
+    value["name"] = "minibar";
+    value["list"].append(1);
+    value["list"].append("two");
+    ASSERT_EQ(writeJson([&value](JsonStreamWriter& w){
+        w.value(value);
+    }),R"({"list":[1,"two"],"name":"minibar"})");
+}
+
+TEST(JsonStream,Flush){
+    std::vector<std::string> chunks;
+    JsonStreamWriter writer([&chunks](const char* data,size_t length){
+        chunks.push_back(std::string(data,length));
+    },8);
+    writer.beginArray();
+    for(int i=0; i<10; i++){
+        writer.intValue(i);
+    }
+    ASSERT_GT(chunks.size(),0u);
+    writer.endArray();
+    writer.flush();
+
+    std::string output;
+    for(auto& chunk: chunks){
+        output += chunk;
+    }
+    ASSERT_EQ(output,"[0,1,2,3,4,5,6,7,8,9]");
+}
@@ -0,0 +1,169 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string>
+
+#include "utils.h"
+#include "jsontape.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+static Json::Value parseTape(std::string text,bool validateUtf8 = true){
+    JsonTape tape;
+    tape.parse(text.data(),text.length(),validateUtf8);
+    return tape.toJson(0);
+}
+
+static Json::Value parseProjected(std::string text,const JsonProjection& projection){
+    JsonTape tape;
+    tape.parse(text.data(),text.length(),true,&projection);
+    return tape.toJson(0);
+}
+
+static Json::Value parseReader(const std::string& text){
+    Json::Reader reader;
+    Json::Value value;
+    reader.parse(text,value,false);
+    return value;
+}
+
+TEST(JsonTape,Values){
+    std::string text = R"( {"a":[1,-2,3.5,1e3,true,false,null],"b":{"c":"d"},"e":[],"f":{},
+        "big":18446744073709551615,"bigger":1e400, "neg":-9223372036854775808} )";
+    // everything but the out of range real, which jsoncpp reads as inf
+    std::string expected = text;
+    expected.replace(expected.find("1e400"),5,"0");
+    Json::Value value = parseTape(expected);
+    ASSERT_EQ(value,parseReader(expected));
+    ASSERT_EQ(value["big"].asUInt64(),18446744073709551615ull);
+    ASSERT_EQ(value["neg"].asInt64(),INT64_MIN);
+    ASSERT_EQ(value["a"][1].asInt(),-2);
+    ASSERT_THROW(parseTape(text),MinibarException);
+}
+
+TEST(JsonTape,Strings){
+    std::string text = R"({"plain":"a string long enough for the vector path","esc":"q\"b\\s\/n\nt\tu\u00e9\ud83d\ude00 end","key\u0041":1})";
+    JsonTape tape;
+    tape.parse(text.data(),text.length());
+
+    size_t plain = tape.find(0,"plain");
+    ASSERT_EQ(tape.getString(plain),"a string long enough for the vector path");
+    // decoded in place, inside the input buffer
+    ASSERT_GE(tape[plain].string,text.data());
+    ASSERT_LT(tape[plain].string,text.data() + text.length());
+
+    ASSERT_EQ(tape.getString(tape.find(0,"esc")),"q\"b\\s/n\nt\tu\xc3\xa9\xf0\x9f\x98\x80 end");
+    ASSERT_NE(tape.find(0,"keyA"),JsonTape::NOT_FOUND);
+}
+
+TEST(JsonTape,Navigate){
+    std::string text = R"({"user":{"tags":["x","y",{"z":null}],"name":"bob","name":"alice"}})";
+    JsonTape tape;
+    tape.parse(text.data(),text.length());
+
+    size_t user = tape.child(0,"user");
+    ASSERT_NE(user,JsonTape::NOT_FOUND);
+    // the last of repeated keys wins, as with jsoncpp
+    ASSERT_EQ(tape.getString(tape.child(user,"name")),"alice");
+
+    size_t tags = tape.child(user,"tags");
+    ASSERT_EQ(tape[tags].size,3u);
+    ASSERT_EQ(tape.getString(tape.child(tags,"1")),"y");
+    ASSERT_EQ(tape.child(tags,"3"),JsonTape::NOT_FOUND);
+    ASSERT_EQ(tape.child(tags,"-1"),JsonTape::NOT_FOUND);
+    ASSERT_EQ(tape.child(tape.child(tags,"2"),"z"),JsonTape::NOT_FOUND);
+    ASSERT_EQ(tape.child(user,"missing"),JsonTape::NOT_FOUND);
+}
+
+TEST(JsonTape,Errors){
+    const char* invalid[] = {
+        "", "{", "[1,]", "{\"a\" 1}", "{\"a\":1,}", "[01]", "[1.]", "[-]", "[tru]",
+        "\"unterminated", "\"bad \\x escape\"", "\"\\ud800\"", "\"ctl \x01\"", "[1] 2",
+        "\"\xc3\x28\"", "\"\xed\xa0\x80\"", "\"\xc0\xaf\""
+    };
+    for(const char* text: invalid){
+        ASSERT_THROW(parseTape(text),MinibarException) << text;
+    }
+    ASSERT_EQ(parseTape("\"\xc3\x28\"",false),Json::Value("\xc3\x28"));
+
+    std::string deep(1000,'[');
+    ASSERT_THROW(parseTape(deep),MinibarException);
+}
+
+TEST(JsonTape,Projection){
+    std::string text = R"({"user":{"name":"bob","bio":"long é text","tags":["a","b","c","d"]},
+        "blob":[{"x":1},"\n",2.5],"id":7,"id":8})";
+    JsonProjection projection;
+    projection.add(tokenizePath("user.name"));
+    projection.add(tokenizePath("user.tags[2]"));
+    projection.add(tokenizePath("id"));
+
+    JsonTape tape;
+    tape.parse(text.data(),text.length(),true,&projection);
+    ASSERT_EQ(tape.toJson(0),parseReader(R"({"user":{"name":"bob","tags":[null,null,"c"]},"id":8})"));
+
+    // a path to the root keeps everything, however it's combined
+    projection.add(TokenSet());
+    projection.add(tokenizePath("user.name"));
+    text = R"({"user":{"name":"bob"},"blob":[1]})";
+    tape.parse(text.data(),text.length(),true,&projection);
+    ASSERT_EQ(tape.toJson(0),parseReader(text));
+
+    // a whole member keeps everything below it
+    JsonProjection user;
+    user.add(tokenizePath("user.name"));
+    user.add(tokenizePath("user"));
+    text = R"({"user":{"name":"bob","age":3},"blob":[1]})";
+    tape.parse(text.data(),text.length(),true,&user);
+    ASSERT_EQ(tape.toJson(0),parseReader(R"({"user":{"name":"bob","age":3}})"));
+}
+
+TEST(JsonTape,ProjectionErrors){
+    JsonProjection projection;
+    projection.add(tokenizePath("name"));
+
+    // skipped values are still validated
+    const char* invalid[] = {
+        R"({"name":"bob","skip":[1,})",
+        R"({"name":"bob","skip":"\q"})",
+        R"({"name":"bob","skip":"\ud800"})",
+        "{\"name\":\"bob\",\"skip\":\"\xc3\x28\"}",
+        R"({"name":"bob","skip":{"a" 1}})",
+        R"({"name":"bob","skip":01})",
+        R"({"name":"bob","skip":nul})",
+        R"({"name":"bob"} [])"
+    };
+    for(const char* text: invalid){
+        ASSERT_THROW(parseProjected(text,projection),MinibarException) << text;
+    }
+
+    std::string deep = "{\"skip\":" + std::string(1000,'[');
+    ASSERT_THROW(parseProjected(deep,projection),MinibarException);
+}
@@ -0,0 +1,116 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "listener.h"
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+static const char* HANDOFF_PATH = "/tmp/minibar-test-handoff.sock";
+
+struct Handoff{
+    int handoffFd;
+    std::vector<int> listeners;
+    bool result;
+};
+
+static void* handOffMain(void* arg){
+    Handoff* handoff = (Handoff*)arg;
+    handoff->result = handOffListeners(handoff->handoffFd,handoff->listeners);
+    return NULL;
+}
+
+static int getPort(int fd){
+    struct sockaddr_in addr;
+    socklen_t length = sizeof(addr);
+    getsockname(fd,(struct sockaddr*)&addr,&length);
+    return ntohs(addr.sin_port);
+}
+
+TEST(Listener,HandOff){
+    int first = listenTcp("127.0.0.1","0");
+    int second = listenTcp("127.0.0.1","0");
+    ASSERT_LE(0,first);
+    ASSERT_LE(0,second);
+
+    Handoff handoff;
+    handoff.handoffFd = listenHandoff(HANDOFF_PATH);
+    ASSERT_LE(0,handoff.handoffFd);
+    handoff.listeners = {first,second};
+    handoff.result = false;
+
+    // a blocking accept keeps the handoff from racing the connect
+    int flags = fcntl(handoff.handoffFd,F_GETFL);
+    fcntl(handoff.handoffFd,F_SETFL,flags & ~O_NONBLOCK);
+    pthread_t thread;
+    pthread_create(&thread,NULL,handOffMain,&handoff);
+
+    std::vector<int> received;
+    ASSERT_TRUE(takeOverListeners(HANDOFF_PATH,received));
+    pthread_join(thread,NULL);
+    ASSERT_TRUE(handoff.result);
+    ASSERT_EQ(2,received.size());
+    ASSERT_EQ(getPort(first),getPort(received[0]));
+    ASSERT_EQ(getPort(second),getPort(received[1]));
+
+    // the received socket accepts connections queued on the original
+    int client = socket(AF_INET,SOCK_STREAM,0);
+    struct sockaddr_in addr;
+    memset(&addr,0,sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = htons(getPort(first));
+    ASSERT_EQ(0,connect(client,(struct sockaddr*)&addr,sizeof(addr)));
+    close(first);
+    close(second);
+    int accepted = accept(received[0],NULL,NULL);
+    ASSERT_LE(0,accepted);
+
+    close(accepted);
+    close(client);
+    close(received[0]);
+    close(received[1]);
+    close(handoff.handoffFd);
+    unlink(HANDOFF_PATH);
+}
+
+TEST(Listener,NoHandoff){
+    unlink(HANDOFF_PATH);
+    std::vector<int> received;
+    ASSERT_FALSE(takeOverListeners(HANDOFF_PATH,received));
+    ASSERT_TRUE(received.empty());
+}
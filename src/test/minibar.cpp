@@ -33,83 +33,22 @@ either expressed or implied, of the FreeBSD Project.
 #include "cgi.h"
 #include "configure.h"
 #include "database.h"
+#include "mockcontext.h"
 #include "gtest/gtest.h"
 #include <stdarg.h>
 #include <iostream>
 #include <fstream>
 
-// Mock frontend
-namespace minibar{
-
-std::string logPrintResult;
-void logPrint(const char* format,...){
-    char buff[1024];
-    va_list vptr;
-
-    va_start(vptr,format);
-    vsnprintf(buff,1024,format,vptr);
-    logPrintResult = buff;
-}
-
-std::string _logStringResult;
-void logString(std::string str){
-    _logStringResult += str;
-}
-
-std::string _writeStringResult;
-void writeString(std::string str){
-    _writeStringResult += str;
-}
-
-std::string _configFilename;
-std::string getConfigFilename(){
-    return _configFilename;
-
-}
-
-std::string _requestContent;
-std::string getRequestContent(){
-    return _requestContent;
-}
-
-std::string _queryString;
-std::string getQueryString(){
-    return _queryString;
-}
-
-std::string _restTarget;
-std::string getRestTarget(){
-    return _restTarget;
-}
-
-std::string _logException;
-void logException(const std::exception& ex){
-    _logException = ex.what();
-}
-
-void logException(const std::string& ex){
-    _logException = ex;
-}
-
-void _resetFrontend(){
-    _logStringResult = "";
-    _writeStringResult = "";
-    _logException = "";
-}
-
-}
-
 using namespace minibar;
 
 TEST(Minibar,Unittest){
-    _configFilename = "resources/test.mini";
-    
-    _resetFrontend();
-    _restTarget = "GET/users/guest";
-    _requestContent = R"({"username":"user"})";
-
-    processRequest();
-    ASSERT_EQ(_logException,""); 
+    MockRequestContext ctx;
+    ctx.configFilename = "resources/test.mini";
+    ctx.restTarget = "GET/users/guest";
+    ctx.requestContent = R"({"username":"user"})";
+
+    processRequest(ctx);
+    ASSERT_EQ(ctx.exceptionResult,""); 
     std::string result = 
 "Status: 200 OK\r\nContent-type: application/json\r\n\r\n"
 R"([
@@ -120,8 +59,73 @@ R"([
    }
 ]
 )";
-    ASSERT_EQ(_writeStringResult,result);
+    ASSERT_EQ(ctx.writeResult,result);
+}
+
+TEST(Minibar,NamedParams){
+    MockRequestContext ctx;
+    ctx.configFilename = "resources/test.mini";
+    ctx.restTarget = "GET/roles/admin";
+
+    // 'limit' falls back to its default
+    processRequest(ctx);
+    ASSERT_EQ(ctx.exceptionResult,"");
+    ASSERT_NE(ctx.writeResult.find(R"("username" : "admin")"),std::string::npos);
+
+    MockRequestContext limited;
+    limited.configFilename = "resources/test.mini";
+    limited.restTarget = "GET/roles/admin";
+    limited.queryString = "limit=0";
+    processRequest(limited);
+    ASSERT_EQ(limited.exceptionResult,"");
+    ASSERT_EQ(limited.writeResult.find("admin"),std::string::npos);
+
+    MockRequestContext invalid;
+    invalid.configFilename = "resources/test.mini";
+    invalid.restTarget = "GET/roles/admin";
+    invalid.queryString = "limit=ten";
+    processRequest(invalid);
+    ASSERT_EQ(invalid.exceptionResult,R"(Cannot convert "ten" to int)");
+}
+
+TEST(Minibar,UnknownRoute){
+    MockRequestContext ctx;
+    ctx.configFilename = "resources/test.mini";
+    ctx.restTarget = "GET/nothing/here";
+
+    processRequest(ctx);
+    ASSERT_EQ(ctx.exceptionResult,"");
+    ASSERT_EQ(ctx.writeResult,
+        "Status: 404 Not Found\r\nContent-type: application/json\r\n\r\nUnknown route GET/nothing/here");
+}
+
+TEST(Minibar,Stats){
+    MockRequestContext ctx;
+    ctx.configFilename = "resources/test.mini";
+    ctx.restTarget = "GET/stats";
 
-    
+    processRequest(ctx);
+    ASSERT_EQ(ctx.exceptionResult,"");
 
+    Json::Reader reader;
+    Json::Value stats;
+    std::string body = ctx.writeResult.substr(ctx.writeResult.find("\r\n\r\n")+4);
+    ASSERT_TRUE(reader.parse(body,stats,false));
+    ASSERT_EQ(stats["DB"]["default"]["type"].asString(),"sqlite3");
+    ASSERT_TRUE(stats["DB"]["default"].isMember("hits"));
+}
+
+TEST(Minibar,Stream){
+    MockRequestContext ctx;
+    ctx.configFilename = "resources/test.mini";
+    ctx.restTarget = "GET/stream/users";
+
+    processRequest(ctx);
+    ASSERT_EQ(ctx.exceptionResult,"");
+    std::string result =
+"Status: 200 OK\r\nContent-type: application/json\r\n\r\n"
+R"([{"username":"admin","role":"admin","password":"password"},)"
+R"({"username":"guest","role":"guest","password":"password"},)"
+R"({"username":"user","role":"user","password":"password"}])";
+    ASSERT_EQ(ctx.writeResult,result);
 }
@@ -0,0 +1,80 @@
+#pragma once
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <string>
+#include <string_view>
+
+#include "minibar.h"
+
+namespace minibar{
+
+// Mock frontend shared by the tests: serves a request from the fields below
+// and collects what processRequest() writes and logs.
+struct MockRequestContext: public RequestContext{
+    std::string configFilename;
+    std::string requestContent;
+    std::string queryString;
+    std::string restTarget;
+    std::string writeResult;
+    std::string logResult;
+    std::string exceptionResult;
+    int contentReads;           // times the request data was read
+    int queryReads;
+
+    using RequestContext::logException;
+
+    MockRequestContext(): contentReads(0),queryReads(0){}
+
+    virtual void write(const char* data,size_t length){
+        writeResult.append(data,length);
+    }
+    virtual void log(const char* data,size_t length){
+        logResult.append(data,length);
+    }
+    virtual std::string_view getConfigFilename(){
+        return configFilename;
+    }
+    virtual std::string_view getRequestContent(){
+        contentReads++;
+        return requestContent;
+    }
+    virtual std::string_view getQueryString(){
+        queryReads++;
+        return queryString;
+    }
+    virtual std::string_view getRestTarget(){
+        return restTarget;
+    }
+    virtual void logException(std::string_view msg){
+        exceptionResult = msg;
+    }
+};
+
+}
@@ -0,0 +1,171 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <math.h>
+
+#include "param.h"
+#include "configure.h"
+#include "mockcontext.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+TEST(ParamContext,Lazy){
+    MockRequestContext ctx;
+    ctx.requestContent = R"({"user":{"name":"bob"}})";
+    ctx.queryString = "limit=10";
+
+    Json::Value conf;
+    conf["debug"] = true;
+    Json::Value path;
+    path["username"] = "guest";
+
+    ParamContext context(ctx,conf,path);
+    ASSERT_EQ(context.resolve("path.username"),"guest");
+    ASSERT_EQ(context.resolve("conf.debug"),true);
+    ASSERT_EQ(ctx.contentReads,0);
+    ASSERT_EQ(ctx.queryReads,0);
+
+    // parsed once, on first use
+    ASSERT_EQ(context.resolve("request.user.name"),"bob");
+    ASSERT_EQ(context.resolve("request.user.name"),"bob");
+    ASSERT_EQ(ctx.contentReads,1);
+    ASSERT_EQ(ctx.queryReads,0);
+
+    ASSERT_EQ(context.resolve("query.limit"),"10");
+    ASSERT_EQ(ctx.queryReads,1);
+
+    // the config is referenced rather than copied
+    ASSERT_EQ(&context.getRoot("conf"),&conf);
+}
+
+TEST(ParamContext,Errors){
+    MockRequestContext ctx;
+    ctx.requestContent = "{not json";
+
+    Json::Value conf;
+    conf["debug"] = true;
+    Json::Value path;
+
+    ParamContext context(ctx,conf,path);
+    ASSERT_THROW(context.resolve("bogus.value"),QueryException);
+    ASSERT_THROW(context.resolve("path.username"),QueryException);
+    ASSERT_THROW(context.resolve("conf.missing"),QueryException);
+    ASSERT_THROW(context.resolve("conf.debug.value"),QueryException);
+
+    // a malformed body only fails requests that use it
+    ASSERT_THROW(context.resolve("request.user"),MinibarException);
+}
+
+TEST(ParamContext,Coerce){
+    ASSERT_EQ(coerceValue(Json::Value("42"),Json::intValue),Json::Value((Json::Int64)42));
+    ASSERT_EQ(coerceValue(Json::Value(2.0),Json::intValue),Json::Value((Json::Int64)2));
+    ASSERT_EQ(coerceValue(Json::Value("7"),Json::uintValue),Json::Value((Json::UInt64)7));
+    ASSERT_EQ(coerceValue(Json::Value("5000000000"),Json::intValue),Json::Value((Json::Int64)5000000000ll));
+    ASSERT_EQ(coerceValue(Json::Value(-5e9),Json::intValue),Json::Value((Json::Int64)-5000000000ll));
+    ASSERT_EQ(coerceValue(Json::Value("1.5"),Json::realValue),Json::Value(1.5));
+    ASSERT_EQ(coerceValue(Json::Value(12),Json::stringValue),Json::Value("12"));
+    ASSERT_EQ(coerceValue(Json::Value("true"),Json::booleanValue),Json::Value(true));
+    ASSERT_EQ(coerceValue(Json::Value(0),Json::booleanValue),Json::Value(false));
+    ASSERT_TRUE(coerceValue(Json::Value::null,Json::intValue).isNull());
+
+    ASSERT_THROW(coerceValue(Json::Value("12abc"),Json::intValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value(2.5),Json::intValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value(NAN),Json::intValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value(INFINITY),Json::intValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value(1e19),Json::uintValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value((Json::UInt64)1 << 63),Json::intValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value("-1"),Json::uintValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value("yes"),Json::booleanValue),MinibarException);
+    ASSERT_THROW(coerceValue(Json::Value(Json::arrayValue),Json::stringValue),MinibarException);
+}
+
+TEST(ParamContext,Binding){
+    MockRequestContext ctx;
+    ctx.requestContent = R"({"user":{"age":"31","name":"bob"}})";
+
+    Json::Value conf;
+    conf["name"] = "minibar";
+    Json::Value path;
+    ParamContext context(ctx,conf,path);
+    Json::Value scratch;
+
+    Json::Value param;
+    param["path"] = "request.user.name";
+    ParamBinding name{QueryParameter(param)};
+    ASSERT_EQ(name.evaluate(context,scratch),"bob");
+
+    // untyped values are not copied out of the context
+    param["path"] = "conf.name";
+    ParamBinding confName{QueryParameter(param)};
+    ASSERT_EQ(&confName.evaluate(context,scratch),&conf["name"]);
+
+    param["path"] = "request.user.age";
+    param["type"] = "int";
+    ParamBinding age{QueryParameter(param)};
+    ASSERT_EQ(age.evaluate(context,scratch),Json::Value((Json::Int64)31));
+
+    param["path"] = "request.user.height";
+    ParamBinding missing{QueryParameter(param)};
+    ASSERT_THROW(missing.evaluate(context,scratch),QueryException);
+
+    param["default"] = "180";
+    ParamBinding withDefault{QueryParameter(param)};
+    ASSERT_EQ(withDefault.evaluate(context,scratch),Json::Value((Json::Int64)180));
+
+    // defaults are checked against the type when the config is loaded
+    param["default"] = "tall";
+    ASSERT_THROW(ParamBinding{QueryParameter(param)},MinibarException);
+}
+
+TEST(ParamContext,Projection){
+    MockRequestContext ctx;
+    ctx.requestContent = R"({"user":{"name":"bob","bio":"..."},"items":[1,2,3],"blob":{"a":[]}})";
+
+    Json::Value conf;
+    Json::Value path;
+    Json::Value param;
+    param["path"] = "request.user.name";
+    ParamBinding name{QueryParameter(param)};
+    param["path"] = "request.items[1]";
+    ParamBinding item{QueryParameter(param)};
+
+    JsonProjection projection;
+    projection.add(name.getPath(),1);
+    projection.add(item.getPath(),1);
+
+    ParamContext context(ctx,conf,path,&projection);
+    Json::Value scratch;
+    ASSERT_EQ(name.evaluate(context,scratch),"bob");
+    ASSERT_EQ(item.evaluate(context,scratch),2);
+
+    // fields no parameter refers to are never parsed
+    ASSERT_FALSE(context.getRoot("request").isMember("blob"));
+    ASSERT_FALSE(context.getRoot("request")["user"].isMember("bio"));
+}
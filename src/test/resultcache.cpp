@@ -0,0 +1,208 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fstream>
+
+#include "sqlite3.h"
+#include "minibar.h"
+#include "resultcache.h"
+#include "mockcontext.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+TEST(ResultCache,Lookup){
+    ResultCache cache;
+    ASSERT_EQ(cache.get("a",1),nullptr);
+
+    cache.put("a",std::string("response a"),1,0);
+    ASSERT_EQ(*cache.get("a",1),"response a");
+
+    // a new data version drops the entry
+    ASSERT_EQ(cache.get("a",2),nullptr);
+    ASSERT_EQ(cache.get("a",1),nullptr);
+
+    cache.put("a",std::string("first"),1,0);
+    cache.put("a",std::string("second"),1,0);
+    ASSERT_EQ(*cache.get("a",1),"second");
+
+    Json::Value stats = cache.getStats();
+    ASSERT_EQ(stats["entries"].asUInt(),1u);
+    ASSERT_EQ(stats["hits"].asUInt(),2u);
+    ASSERT_EQ(stats["misses"].asUInt(),3u);
+    ASSERT_EQ(stats["invalidated"].asUInt(),1u);
+}
+
+TEST(ResultCache,Evict){
+    ResultCache cache(4096);
+    std::string response(500,'x');
+    for(int i=0; i<20; i++){
+        cache.put("key" + std::to_string(i),std::string(response),1,0);
+        // keep the first entry in use
+        ASSERT_NE(cache.get("key0",1),nullptr);
+    }
+    Json::Value stats = cache.getStats();
+    ASSERT_LE(stats["bytes"].asUInt(),4096u);
+    ASSERT_GT(stats["evictions"].asUInt(),0u);
+    ASSERT_NE(cache.get("key0",1),nullptr);
+    ASSERT_NE(cache.get("key19",1),nullptr);
+    ASSERT_EQ(cache.get("key1",1),nullptr);
+
+    // entries over a quarter of the cache aren't kept
+    cache.put("big",std::string(2000,'x'),1,0);
+    ASSERT_EQ(cache.get("big",1),nullptr);
+
+    cache.setMaxBytes(1024);
+    ASSERT_LE(cache.getStats()["bytes"].asUInt(),1024u);
+}
+
+TEST(ResultCache,Expire){
+    ResultCache cache;
+    cache.put("a",std::string("a"),1,1);
+    cache.put("b",std::string("b"),1,0);
+    ASSERT_NE(cache.get("a",1),nullptr);
+    usleep(1100000);
+    ASSERT_EQ(cache.get("a",1),nullptr);
+    ASSERT_NE(cache.get("b",1),nullptr);
+    ASSERT_EQ(cache.getStats()["expired"].asUInt(),1u);
+}
+
+// temporary database and config with a cached route over it
+class CacheFixture: public ::testing::Test{
+protected:
+    std::string dbFile;
+    std::string configFile;
+
+    void SetUp(){
+        char dbPath[] = "/tmp/minibar-cache-db-XXXXXX";
+        close(mkstemp(dbPath));
+        dbFile = dbPath;
+        execSql("create table items(name text primary key, count int);"
+            "insert into items values('a',1);");
+
+        char configPath[] = "/tmp/minibar-cache-config-XXXXXX";
+        close(mkstemp(configPath));
+        configFile = configPath;
+        std::ofstream out(configFile);
+        out << R"({"DB":{"default":{"type":"sqlite3","dataVersionInterval":0,"filename":")"
+            << dbFile << R"("}},"REST":{
+            "GET/stats":{"special":"stats"},
+            "GET/items/:name":{
+                "query":"select count from items where name = ?",
+                "params":["path.name"],
+                "cache":true
+            },
+            "GET/stream/items":{
+                "query":"select * from items order by name",
+                "stream":true,
+                "cache":60
+            },
+            "GET/bump/:name":{
+                "query":"update items set count = count + 1 where name = ?",
+                "params":["path.name"]
+            }
+        }})";
+    }
+    void TearDown(){
+        unlink(dbFile.c_str());
+        unlink(configFile.c_str());
+    }
+
+    // writes from outside the pool, as another process would
+    void execSql(const char* sql){
+        sqlite3* handle;
+        ASSERT_EQ(sqlite3_open(dbFile.c_str(),&handle),SQLITE_OK);
+        ASSERT_EQ(sqlite3_exec(handle,sql,NULL,NULL,NULL),SQLITE_OK);
+        sqlite3_close(handle);
+    }
+
+    std::string request(const std::string& target){
+        MockRequestContext ctx;
+        ctx.configFilename = configFile;
+        ctx.restTarget = target;
+        processRequest(ctx);
+        EXPECT_EQ(ctx.exceptionResult,"");
+        return ctx.writeResult.substr(ctx.writeResult.find("\r\n\r\n") + 4);
+    }
+
+    // non-stream routes answer in jsoncpp's styled format
+    static std::string styled(const char* json){
+        Json::Reader reader;
+        Json::Value value;
+        reader.parse(json,value,false);
+        return Json::StyledWriter().write(value);
+    }
+
+    Json::Value cacheStats(){
+        Json::Reader reader;
+        Json::Value stats;
+        reader.parse(request("GET/stats"),stats,false);
+        return stats["resultCache"];
+    }
+};
+
+TEST_F(CacheFixture,Hit){
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":1}])"));
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":1}])"));
+    ASSERT_EQ(request("GET/items/b"),styled("[]"));
+    ASSERT_EQ(request("GET/stream/items"),R"([{"name":"a","count":1}])");
+    ASSERT_EQ(request("GET/stream/items"),R"([{"name":"a","count":1}])");
+
+    Json::Value stats = cacheStats();
+    ASSERT_EQ(stats["hits"].asUInt(),2u);
+    ASSERT_EQ(stats["misses"].asUInt(),3u);
+    ASSERT_EQ(stats["entries"].asUInt(),3u);
+}
+
+TEST_F(CacheFixture,Invalidate){
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":1}])"));
+
+    // a write through the pool
+    request("GET/bump/a");
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":2}])"));
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":2}])"));
+
+    // a write from another process
+    execSql("update items set count = 10 where name = 'a'");
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":10}])"));
+
+    Json::Value stats = cacheStats();
+    ASSERT_EQ(stats["hits"].asUInt(),1u);
+    ASSERT_EQ(stats["invalidated"].asUInt(),2u);
+}
+
+TEST_F(CacheFixture,Uncached){
+    // routes without "cache" never go through it
+    request("GET/bump/a");
+    request("GET/bump/a");
+    ASSERT_EQ(cacheStats()["misses"].asUInt(),0u);
+    ASSERT_EQ(request("GET/items/a"),styled(R"([{"count":3}])"));
+}
@@ -74,3 +74,88 @@ TEST(MinibarRouter,Unittest){
     ASSERT_TRUE(pathValues.isMember("gorf"));
     ASSERT_TRUE(pathValues["gorf"].asString().compare("goat") == 0);
 }
+
+TEST(MinibarRouter,RouteTable){
+    RouteTable table;
+    RouteTable::Match match;
+
+    table.addRoute("GET/foo/bar/baz",42);
+    table.addRoute("GET/foo/*/gorf",13);
+    table.addRoute("GET/foo/bar/baz/:gorf",29);
+    table.addRoute("POST/foo/bar/baz",7);
+
+    // prevent duplicates
+    ASSERT_THROW(table.addRoute("GET/foo/bar/baz",43),MinibarException);
+
+    // matching
+    ASSERT_FALSE(table.matchRoute("GET/x/y/z",match));
+    ASSERT_EQ(match.id,RouteTable::NO_ROUTE_MATCH);
+
+    ASSERT_TRUE(table.matchRoute("GET/foo/bar/baz",match));
+    ASSERT_EQ(match.id,42);
+    ASSERT_EQ(match.paramCount,0);
+
+    ASSERT_TRUE(table.matchRoute("POST/foo/bar/baz",match));
+    ASSERT_EQ(match.id,7);
+
+    ASSERT_FALSE(table.matchRoute("GET/foo/bar",match));
+    ASSERT_FALSE(table.matchRoute("PUT/foo/bar/baz",match));
+
+    ASSERT_TRUE(table.matchRoute("GET/foo/bar/baz/goat",match));
+    ASSERT_EQ(match.id,29);
+    ASSERT_EQ(match.paramCount,1);
+    ASSERT_EQ(match.params[0],"goat");
+    ASSERT_EQ(table.getParamNames(29)[0],"gorf");
+
+    ASSERT_TRUE(table.matchRoute("GET/foo/anything/gorf",match));
+    ASSERT_EQ(match.id,13);
+}
+
+TEST(MinibarRouter,RouteTablePrecedence){
+    RouteTable table;
+    RouteTable::Match match;
+
+    table.addRoute("GET/users/:name",1);
+    table.addRoute("GET/users/me",2);
+    table.addRoute("GET/users/:name/roles/:role",3);
+    table.addRoute("GET/users/me/settings",4);
+    table.addRoute("GET/users/*/stats",5);
+
+    // literal segments win over parameters
+    ASSERT_TRUE(table.matchRoute("GET/users/me",match));
+    ASSERT_EQ(match.id,2);
+    ASSERT_TRUE(table.matchRoute("GET/users/bob",match));
+    ASSERT_EQ(match.id,1);
+    ASSERT_EQ(match.params[0],"bob");
+
+    // backtrack out of the literal branch
+    ASSERT_TRUE(table.matchRoute("GET/users/me/roles/admin",match));
+    ASSERT_EQ(match.id,3);
+    ASSERT_EQ(match.paramCount,2);
+    ASSERT_EQ(match.params[0],"me");
+    ASSERT_EQ(match.params[1],"admin");
+
+    // backtrack out of the parameter branch
+    ASSERT_TRUE(table.matchRoute("GET/users/bob/stats",match));
+    ASSERT_EQ(match.id,5);
+    ASSERT_EQ(match.paramCount,0);
+
+    // empty segments are matched like any other
+    ASSERT_TRUE(table.matchRoute("GET/users/",match));
+    ASSERT_EQ(match.id,1);
+    ASSERT_EQ(match.params[0],"");
+}
+
+TEST(MinibarRouter,RouteTableLarge){
+    RouteTable table;
+    RouteTable::Match match;
+
+    for(int i=0; i<1000; i++){
+        table.addRoute("GET/items" + std::to_string(i) + "/:id",i);
+    }
+    for(int i=0; i<1000; i++){
+        ASSERT_TRUE(table.matchRoute("GET/items" + std::to_string(i) + "/x",match));
+        ASSERT_EQ(match.id,i);
+    }
+    ASSERT_FALSE(table.matchRoute("GET/items1000/x",match));
+}
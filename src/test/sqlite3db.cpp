@@ -30,3 +30,160 @@ either expressed or implied, of the FreeBSD Project.
 #include "sqlite3db.h"
 #include "configure.h"
 
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+class SqliteDbTest : public SqliteDb{
+public:
+    SqliteDbTest(const Json::Value& poolConfig,size_t statementCacheSize = 2):
+        SqliteDb("resources/test.db",poolConfig,statementCacheSize){
+        //do nothing
+    }
+};
+
+static Json::Value poolConfig(int size,int waitTimeout){
+    Json::Value config;
+    config["size"] = size;
+    config["waitTimeout"] = waitTimeout;
+    return config;
+}
+
+TEST(SqliteDb,Query){
+    SqliteDbTest db(poolConfig(1,0));
+    RAIIConnection con(&db);
+
+    con->prepare("select username from users where role = ?");
+    con->bind(Json::Value("admin"));
+    Json::Value result = con->execute();
+    ASSERT_EQ(result.size(),1u);
+    ASSERT_EQ(result[0]["username"].asString(),"admin");
+}
+
+TEST(SqliteDb,BindInt64){
+    SqliteDbTest db(poolConfig(1,0));
+    RAIIConnection con(&db);
+
+    con->prepare("select ? as signed, ? as unsigned");
+    con->bind(Json::Value((Json::Int64)-5000000000ll));
+    con->bind(Json::Value((Json::UInt64)5000000000ull));
+    Json::Value result = con->execute();
+    ASSERT_EQ(result[0]["signed"].asInt64(),-5000000000ll);
+    ASSERT_EQ(result[0]["unsigned"].asInt64(),5000000000ll);
+
+    con->prepare("select ?");
+    ASSERT_THROW(con->bind(Json::Value((Json::UInt64)1 << 63)),SqlException);
+}
+
+TEST(SqliteDb,PoolReuse){
+    SqliteDbTest db(poolConfig(2,0));
+
+    Connection* first = db.getConnection();
+    db.releaseConnection(first);
+    Connection* second = db.getConnection();
+    ASSERT_EQ(first,second);
+    db.releaseConnection(second);
+
+    Json::Value stats = db.getStats();
+    ASSERT_EQ(stats["misses"].asUInt(),1u);
+    ASSERT_EQ(stats["hits"].asUInt(),1u);
+    ASSERT_EQ(stats["open"].asUInt(),1u);
+    ASSERT_EQ(stats["idle"].asUInt(),1u);
+}
+
+TEST(SqliteDb,PoolExhausted){
+    SqliteDbTest db(poolConfig(1,10));
+
+    Connection* con = db.getConnection();
+    ASSERT_THROW(db.getConnection(),SqlException);
+    db.releaseConnection(con);
+
+    Json::Value stats = db.getStats();
+    ASSERT_EQ(stats["waits"].asUInt(),1u);
+    ASSERT_EQ(stats["timeouts"].asUInt(),1u);
+}
+
+TEST(SqliteDb,StatementCache){
+    SqliteDbTest db(poolConfig(1,0),2);
+    const char* byRole = "select username from users where role = ?";
+    const char* byName = "select role from users where username = ?";
+    const char* count = "select count(*) as n from users";
+
+    for(const char* role: {"admin","user","admin"}){
+        RAIIConnection con(&db);
+        con->prepare(byRole);
+        con->bind(Json::Value(role));
+        Json::Value result = con->execute();
+        ASSERT_EQ(result.size(),1u);
+        ASSERT_EQ(result[0]["username"].asString(),role);
+    }
+
+    Json::Value stats = db.getStats();
+    ASSERT_EQ(stats["statementMisses"].asUInt(),1u);
+    ASSERT_EQ(stats["statementHits"].asUInt(),2u);
+
+    // fill the cache past capacity; 'byRole' is evicted
+    for(const char* query: {byName,count,byRole}){
+        RAIIConnection con(&db);
+        con->prepare(query);
+    }
+    stats = db.getStats();
+    ASSERT_EQ(stats["statementMisses"].asUInt(),4u);
+    ASSERT_EQ(stats["statementHits"].asUInt(),2u);
+}
+
+TEST(SqliteDb,ColumnMetadata){
+    SqliteDbTest db(poolConfig(1,0),2);
+    {
+        RAIIConnection con(&db);
+        con->prepare("create temp table flags (\"na\"\"me\" text, enabled boolean, ratio real)");
+        con->execute();
+        con->prepare("insert into flags values ('a',1,0.5),('b',0,null)");
+        con->execute();
+    }
+
+    for(int i=0; i<2; i++){
+        RAIIConnection con(&db);
+        con->prepare("select * from flags order by 1");
+        Json::Value result = con->execute();
+        ASSERT_EQ(result.size(),2u);
+        ASSERT_EQ(result[0]["na\"me"].asString(),"a");
+        // declared types don't change how values are returned
+        ASSERT_TRUE(result[0]["enabled"].isInt());
+        ASSERT_EQ(result[0]["enabled"].asInt(),1);
+        ASSERT_EQ(result[1]["enabled"].asInt(),0);
+        ASSERT_TRUE(result[1]["ratio"].isNull());
+    }
+
+    std::string output;
+    {
+        JsonStreamWriter writer([&output](const char* data,size_t length){
+            output.append(data,length);
+        });
+        RAIIConnection con(&db);
+        con->prepare("select * from flags order by 1");
+        con->executeStream(writer);
+        writer.flush();
+    }
+    ASSERT_EQ(output,R"([{"na\"me":"a","enabled":1,"ratio":0.5},{"na\"me":"b","enabled":0,"ratio":null}])");
+}
+
+TEST(SqliteDb,ColumnRename){
+    SqliteDbTest db(poolConfig(1,0),2);
+    RAIIConnection con(&db);
+    con->prepare("create temp table renamed (a int, b int)");
+    con->execute();
+    con->prepare("insert into renamed values (1,2)");
+    con->execute();
+
+    con->prepare("select * from renamed");
+    ASSERT_EQ(con->execute()[0]["a"].asInt(),1);
+
+    // the cached statement is re-prepared with the same number of columns
+    con->prepare("alter table renamed rename column a to c");
+    con->execute();
+    con->prepare("select * from renamed");
+    Json::Value result = con->execute();
+    ASSERT_EQ(result[0]["c"].asInt(),1);
+    ASSERT_FALSE(result[0].isMember("a"));
+}
@@ -0,0 +1,125 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include "supervisor.h"
+
+#include <poll.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+// reads a worker's pid from the pipe, or returns -1 after five seconds
+static pid_t readPid(int fd){
+    struct pollfd pfd = {fd,POLLIN,0};
+    pid_t pid;
+    if(poll(&pfd,1,5000) != 1 || read(fd,&pid,sizeof(pid)) != sizeof(pid)){
+        return -1;
+    }
+    return pid;
+}
+
+TEST(Supervisor,RestartAndStop){
+    int fds[2];
+    ASSERT_EQ(0,pipe(fds));
+
+    pid_t supervisor = fork();
+    ASSERT_NE(-1,supervisor);
+    if(supervisor == 0){
+        close(fds[0]);
+        int result = superviseWorkers(2,[&](int index){
+            pid_t pid = getpid();
+            if(write(fds[1],&pid,sizeof(pid)) != sizeof(pid)){
+                return 1;
+            }
+            pause();
+            return 0;
+        });
+        _exit(result);
+    }
+    close(fds[1]);
+
+    pid_t first = readPid(fds[0]);
+    pid_t second = readPid(fds[0]);
+    ASSERT_NE(-1,first);
+    ASSERT_NE(-1,second);
+    ASSERT_NE(first,second);
+
+    // a crashed worker is replaced
+    ASSERT_EQ(0,kill(first,SIGKILL));
+    pid_t third = readPid(fds[0]);
+    ASSERT_NE(-1,third);
+    ASSERT_NE(first,third);
+    ASSERT_NE(second,third);
+
+    // stopping the supervisor stops every worker
+    ASSERT_EQ(0,kill(supervisor,SIGTERM));
+    int status;
+    ASSERT_EQ(supervisor,waitpid(supervisor,&status,0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(0,WEXITSTATUS(status));
+    ASSERT_EQ(-1,kill(second,0));
+    ASSERT_EQ(-1,kill(third,0));
+    close(fds[0]);
+}
+
+TEST(Supervisor,Control){
+    int control[2];
+    ASSERT_EQ(0,pipe(control));
+
+    pid_t supervisor = fork();
+    ASSERT_NE(-1,supervisor);
+    if(supervisor == 0){
+        close(control[1]);
+        int result = superviseWorkers(1,[&](int){
+            pause();
+            return 0;
+        },control[0],[&](){
+            char command;
+            return read(control[0],&command,1) == 1 && command == 'q';
+        });
+        _exit(result == 0 ? 3 : 1);
+    }
+    close(control[0]);
+
+    // other commands leave it running
+    ASSERT_EQ(1,write(control[1],"x",1));
+    usleep(100000);
+    int status;
+    ASSERT_EQ(0,waitpid(supervisor,&status,WNOHANG));
+
+    ASSERT_EQ(1,write(control[1],"q",1));
+    ASSERT_EQ(supervisor,waitpid(supervisor,&status,0));
+    ASSERT_TRUE(WIFEXITED(status));
+    ASSERT_EQ(3,WEXITSTATUS(status));
+    close(control[1]);
+}
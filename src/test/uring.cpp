@@ -0,0 +1,128 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+#include <string>
+
+#include "uring.h"
+#include "gtest/gtest.h"
+
+using namespace minibar;
+
+#define INIT_OR_SKIP(uring) \
+    if(!(uring).init(8)){ \
+        GTEST_SKIP() << "io_uring unavailable: " << strerror(errno); \
+    }
+
+TEST(Uring,Nop){
+    Uring uring;
+    INIT_OR_SKIP(uring);
+
+    // more entries than the submission queue holds
+    for(int i=0; i<20; i++){
+        struct io_uring_sqe* sqe = uring.getSqe();
+        ASSERT_TRUE(sqe != NULL);
+        sqe->opcode = IORING_OP_NOP;
+        sqe->user_data = i;
+        if(i % 7 == 6){
+            ASSERT_GE(uring.submitAndWait(1),0);
+        }
+    }
+    int seen = 0;
+    while(seen < 20){
+        ASSERT_GE(uring.submitAndWait(1,1000),0);
+        struct io_uring_cqe* cqe;
+        while((cqe = uring.peekCqe()) != NULL){
+            ASSERT_EQ(cqe->user_data,(uint64_t)seen);
+            ASSERT_EQ(cqe->res,0);
+            uring.advanceCqe();
+            seen++;
+        }
+    }
+
+    // nothing is outstanding, so this times out
+    ASSERT_EQ(uring.submitAndWait(1,10),0);
+    ASSERT_TRUE(uring.peekCqe() == NULL);
+}
+
+TEST(Uring,MultishotRecv){
+    Uring uring;
+    INIT_OR_SKIP(uring);
+    BufferRing buffers;
+    ASSERT_TRUE(buffers.init(uring,3,4,8));
+
+    int fds[2];
+    ASSERT_EQ(socketpair(AF_UNIX,SOCK_STREAM,0,fds),0);
+
+    struct io_uring_sqe* sqe = uring.getSqe();
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = fds[0];
+    sqe->ioprio = IORING_RECV_MULTISHOT;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = 3;
+    sqe->user_data = 42;
+
+    // each write is split over buffers of 8 bytes
+    std::string received;
+    const char* messages[] = {"hello", "multishot world", "!"};
+    bool more = true;
+    for(const char* message: messages){
+        ASSERT_EQ(write(fds[1],message,strlen(message)),(ssize_t)strlen(message));
+        std::string expected = received + message;
+        while(received != expected){
+            ASSERT_GE(uring.submitAndWait(1,1000),0);
+            struct io_uring_cqe* cqe = uring.peekCqe();
+            ASSERT_TRUE(cqe != NULL);
+            ASSERT_EQ(cqe->user_data,42u);
+            ASSERT_GT(cqe->res,0);
+            ASSERT_TRUE(cqe->flags & IORING_CQE_F_BUFFER);
+            uint16_t bufferId = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+            received.append(buffers.get(bufferId),cqe->res);
+            buffers.recycle(bufferId);
+            more = cqe->flags & IORING_CQE_F_MORE;
+            uring.advanceCqe();
+            ASSERT_TRUE(more);
+        }
+    }
+    ASSERT_EQ(received,"hellomultishot world!");
+
+    // end of stream finishes the receive
+    close(fds[1]);
+    ASSERT_GE(uring.submitAndWait(1,1000),0);
+    struct io_uring_cqe* cqe = uring.peekCqe();
+    ASSERT_TRUE(cqe != NULL);
+    ASSERT_EQ(cqe->res,0);
+    ASSERT_FALSE(cqe->flags & IORING_CQE_F_MORE);
+    uring.advanceCqe();
+    close(fds[0]);
+}
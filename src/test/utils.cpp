@@ -52,3 +52,62 @@ TEST(MinibarUtils,Unittest){
 
     ASSERT_TRUE(tokensEqual(test,test2));
 }
+
+static Json::Value parseJson(const char* text){
+    Json::Reader reader;
+    Json::Value value;
+    reader.parse(text,value,false);
+    return value;
+}
+
+TEST(MinibarUtils,TokenizePath){
+    TokenSet test = tokenizePath("request.items[0].tags[12][3]");
+    TokenSet expected = {"request","items","0","tags","12","3"};
+    ASSERT_TRUE(tokensEqual(test,expected));
+
+    test = tokenizePath("a.b");
+    expected = {"a","b"};
+    ASSERT_TRUE(tokensEqual(test,expected));
+}
+
+TEST(MinibarUtils,FindObject){
+    Json::Value root = parseJson(R"({"user":{"name":"bob","tags":["a","b",{"x":1}]},"0":"zero","n":null})");
+
+    const Json::Value* value = FindObject(root,"user.name");
+    ASSERT_TRUE(value != NULL);
+    ASSERT_EQ(*value,"bob");
+    // a reference into the document, not a copy
+    ASSERT_EQ(value,&root["user"]["name"]);
+
+    ASSERT_EQ(*FindObject(root,"user.tags.1"),"b");
+    ASSERT_EQ(*FindObject(root,"user.tags[1]"),"b");
+    ASSERT_EQ(*FindObject(root,"user.tags[2].x"),1);
+    ASSERT_EQ(*FindObject(root,"0"),"zero");
+
+    ASSERT_TRUE(FindObject(root,"user.tags[3]") == NULL);
+    ASSERT_TRUE(FindObject(root,"user.tags.-1") == NULL);
+    ASSERT_TRUE(FindObject(root,"user.name.first") == NULL);
+    ASSERT_TRUE(FindObject(root,"user.missing") == NULL);
+    ASSERT_TRUE(FindObject(root,"n") == NULL);
+}
+
+TEST(MinibarUtils,QueryObject){
+    Json::Value root = parseJson(R"({"user":{"tags":["a","b"]}})");
+
+    ASSERT_EQ(&QueryObject(root,"user.tags[0]"),&root["user"]["tags"][0]);
+
+    try{
+        QueryObject(root,"user.tags.5");
+        FAIL();
+    }
+    catch(const QueryException& ex){
+        ASSERT_STREQ(ex.what(),"Failed to find query element: .user.tags.>>5<<");
+    }
+    try{
+        QueryObject(root,"user.tags.0.x");
+        FAIL();
+    }
+    catch(const QueryException& ex){
+        ASSERT_STREQ(ex.what(),"Query node must be an object or array: .user.tags.0.>>x<<");
+    }
+}
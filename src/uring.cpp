@@ -0,0 +1,229 @@
+/*
+Copyright (c) 2013, Eric Anderton
+All rights reserved.
+
+Redistribution and use in source and binary forms, with or without
+modification, are permitted provided that the following conditions are met: 
+
+1. Redistributions of source code must retain the above copyright notice, this
+   list of conditions and the following disclaimer. 
+2. Redistributions in binary form must reproduce the above copyright notice,
+   this list of conditions and the following disclaimer in the documentation
+   and/or other materials provided with the distribution. 
+
+THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS "AS IS" AND
+ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT LIMITED TO, THE IMPLIED
+WARRANTIES OF MERCHANTABILITY AND FITNESS FOR A PARTICULAR PURPOSE ARE
+DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT OWNER OR CONTRIBUTORS BE LIABLE FOR
+ANY DIRECT, INDIRECT, INCIDENTAL, SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES
+(INCLUDING, BUT NOT LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES;
+LOSS OF USE, DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND
+ON ANY THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+(INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+
+The views and conclusions contained in the software and documentation are those
+of the authors and should not be interpreted as representing official policies, 
+either expressed or implied, of the FreeBSD Project.
+*/
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+
+#include "uring.h"
+
+namespace minibar{
+
+// features without which init() fails
+static const unsigned REQUIRED_FEATURES = IORING_FEAT_SINGLE_MMAP | IORING_FEAT_NODROP |
+    IORING_FEAT_FAST_POLL | IORING_FEAT_EXT_ARG;
+
+static int setup(unsigned entries,struct io_uring_params& params,unsigned flags){
+    memset(&params,0,sizeof(params));
+    params.flags = IORING_SETUP_CQSIZE | flags;
+    params.cq_entries = entries * 4;
+    return syscall(__NR_io_uring_setup,entries,&params);
+}
+
+Uring::Uring(){
+    ringFd = -1;
+    features = 0;
+    sqRing = MAP_FAILED;
+    sqRingSize = 0;
+    cqRing = MAP_FAILED;
+    cqRingSize = 0;
+    sqes = (struct io_uring_sqe*)MAP_FAILED;
+    sqesSize = 0;
+    sqLocalTail = 0;
+}
+
+Uring::~Uring(){
+    if(sqes != MAP_FAILED){
+        munmap(sqes,sqesSize);
+    }
+    if(cqRing != MAP_FAILED && cqRing != sqRing){
+        munmap(cqRing,cqRingSize);
+    }
+    if(sqRing != MAP_FAILED){
+        munmap(sqRing,sqRingSize);
+    }
+    if(ringFd >= 0){
+        close(ringFd);
+    }
+}
+
+bool Uring::init(unsigned entries){
+    struct io_uring_params params;
+    // completions are only reaped by the owning thread, so the kernel can
+    // defer its completion work until then instead of interrupting it
+    ringFd = setup(entries,params,IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_DEFER_TASKRUN);
+    if(ringFd < 0 && errno == EINVAL){
+        ringFd = setup(entries,params,0);
+    }
+    if(ringFd < 0){
+        return false;
+    }
+    features = params.features;
+    if((features & REQUIRED_FEATURES) != REQUIRED_FEATURES){
+        errno = ENOSYS;
+        return false;
+    }
+
+    sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+    if(cqRingSize > sqRingSize){
+        sqRingSize = cqRingSize;
+    }
+    cqRingSize = sqRingSize;
+    sqRing = mmap(NULL,sqRingSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,ringFd,IORING_OFF_SQ_RING);
+    if(sqRing == MAP_FAILED){
+        return false;
+    }
+    cqRing = sqRing;
+    sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    sqes = (struct io_uring_sqe*)mmap(NULL,sqesSize,PROT_READ | PROT_WRITE,MAP_SHARED | MAP_POPULATE,
+        ringFd,IORING_OFF_SQES);
+    if(sqes == MAP_FAILED){
+        return false;
+    }
+
+    char* sq = (char*)sqRing;
+    sqHead = (unsigned*)(sq + params.sq_off.head);
+    sqTail = (unsigned*)(sq + params.sq_off.tail);
+    sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    sqEntries = params.sq_entries;
+    sqLocalTail = *sqTail;
+    // submission entries are always used in ring order
+    unsigned* array = (unsigned*)(sq + params.sq_off.array);
+    for(unsigned i=0; i<sqEntries; i++){
+        array[i] = i;
+    }
+
+    char* cq = (char*)cqRing;
+    cqHead = (unsigned*)(cq + params.cq_off.head);
+    cqTail = (unsigned*)(cq + params.cq_off.tail);
+    cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    cqes = (struct io_uring_cqe*)(cq + params.cq_off.cqes);
+    return true;
+}
+
+int Uring::enter(unsigned toSubmit,unsigned minComplete,unsigned flags,void* arg,size_t argSize){
+    int result = syscall(__NR_io_uring_enter,ringFd,toSubmit,minComplete,flags,arg,argSize);
+    return result < 0 ? -errno : result;
+}
+
+struct io_uring_sqe* Uring::getSqe(){
+    if(sqLocalTail - __atomic_load_n(sqHead,__ATOMIC_ACQUIRE) >= sqEntries){
+        if(submit() < 0 || sqLocalTail - __atomic_load_n(sqHead,__ATOMIC_ACQUIRE) >= sqEntries){
+            return NULL;
+        }
+    }
+    struct io_uring_sqe* sqe = &sqes[sqLocalTail & sqMask];
+    memset(sqe,0,sizeof(*sqe));
+    sqLocalTail++;
+    return sqe;
+}
+
+int Uring::submitAndWait(unsigned minComplete,int timeoutMillis){
+    unsigned toSubmit = sqLocalTail - *sqTail;
+    __atomic_store_n(sqTail,sqLocalTail,__ATOMIC_RELEASE);
+
+    unsigned flags = 0;
+    struct io_uring_getevents_arg arg;
+    struct __kernel_timespec ts;
+    memset(&arg,0,sizeof(arg));
+    if(minComplete > 0){
+        flags |= IORING_ENTER_GETEVENTS;
+        if(timeoutMillis >= 0){
+            ts.tv_sec = timeoutMillis / 1000;
+            ts.tv_nsec = (timeoutMillis % 1000) * 1000000L;
+            arg.ts = (uint64_t)(uintptr_t)&ts;
+        }
+    }
+    else if(toSubmit == 0){
+        return 0;
+    }
+
+    while(true){
+        int result = enter(toSubmit,minComplete,flags | IORING_ENTER_EXT_ARG,&arg,sizeof(arg));
+        if(result == -EINTR){
+            continue;
+        }
+        if(result == -ETIME){
+            return 0;
+        }
+        return result;
+    }
+}
+
+///////////
+
+BufferRing::BufferRing(){
+    ring = (struct io_uring_buf_ring*)MAP_FAILED;
+    ringSize = 0;
+    buffers = (char*)MAP_FAILED;
+    count = 0;
+    mask = 0;
+    bufferSize = 0;
+    tail = 0;
+}
+
+BufferRing::~BufferRing(){
+    if(buffers != MAP_FAILED){
+        munmap(buffers,count * bufferSize);
+    }
+    if(ring != MAP_FAILED){
+        munmap(ring,ringSize);
+    }
+}
+
+bool BufferRing::init(Uring& uring,uint16_t groupId,unsigned count,size_t bufferSize){
+    this->count = count;
+    this->bufferSize = bufferSize;
+    mask = count - 1;
+    ringSize = count * sizeof(struct io_uring_buf);
+    ring = (struct io_uring_buf_ring*)mmap(NULL,ringSize,PROT_READ | PROT_WRITE,
+        MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    buffers = (char*)mmap(NULL,count * bufferSize,PROT_READ | PROT_WRITE,MAP_PRIVATE | MAP_ANONYMOUS,-1,0);
+    if(ring == MAP_FAILED || buffers == MAP_FAILED){
+        return false;
+    }
+
+    struct io_uring_buf_reg reg;
+    memset(&reg,0,sizeof(reg));
+    reg.ring_addr = (uint64_t)(uintptr_t)ring;
+    reg.ring_entries = count;
+    reg.bgid = groupId;
+    if(syscall(__NR_io_uring_register,uring.getFd(),IORING_REGISTER_PBUF_RING,&reg,1) < 0){
+        return false;
+    }
+    for(unsigned i=0; i<count; i++){
+        recycle(i);
+    }
+    return true;
+}
+
+}
@@ -27,18 +27,20 @@ of the authors and should not be interpreted as representing official policies,
 either expressed or implied, of the FreeBSD Project.
 */
 
+#include <string.h>
+
 #include "utils.h"
 
 namespace minibar{
 
-TokenSet tokenize(const string& str,const string& delimiters,bool trimEmpty)
+TokenSet tokenize(std::string_view str,std::string_view delimiters,bool trimEmpty)
 {
     TokenSet tokens;
     size_t pos, lastPos = 0;
 
     while(true){
         pos = str.find_first_of(delimiters, lastPos);
-        if(pos == std::string::npos){
+        if(pos == std::string_view::npos){
             pos = str.length();
 
             if(pos != lastPos || !trimEmpty){
@@ -60,52 +62,133 @@ QueryException::QueryException(const char* text,TokenSet query,int errterm){
     this->text = text;
     this->query = query;
     this->errterm = errterm;
-}
 
-const char* QueryException::what() const throw(){
-    std::string result;
-
-    result += text;
+    message += text;
     int i = 0;
-    for(std::string term: query){
+    for(std::string term: this->query){
         if(i == errterm){
-            result += ".>>";
-            result += term;
-            result += "<<";
+            message += ".>>";
+            message += term;
+            message += "<<";
         }
         else{
-            result += ".";
-            result += term;
+            message += ".";
+            message += term;
         }
         i++;
     }
-    return result.c_str();
 }
 
-// walks a set of query set tokens through a JSON object graph
-// returns the value indicated by the query
-Json::Value QueryObject(const Json::Value root,const TokenSet& query){
-    int i = 0;
-    Json::Value node = root;
+const char* QueryException::what() const throw(){
+    return message.c_str();
+}
+
+TokenSet tokenizePath(std::string_view path){
+    TokenSet tokens;
+    size_t start = 0;
+    bool closed = false;   // the last token ended with ']'
+
+    for(size_t i=0; i<=path.length(); i++){
+        char ch = i < path.length() ? path[i] : '.';
+        if(ch == '.' || ch == '['){
+            // no empty token between "]" and a following "." or "["
+            if(!(closed && i == start) && !(ch == '[' && i == 0)){
+                tokens.push_back(std::string(path.substr(start,i-start)));
+            }
+            start = i + 1;
+            closed = false;
+        }
+        else if(ch == ']'){
+            tokens.push_back(std::string(path.substr(start,i-start)));
+            start = i + 1;
+            closed = true;
+        }
+    }
+    return tokens;
+}
+
+static bool parseIndex(const char* term,size_t length,Json::ArrayIndex& index){
+    if(length == 0 || length > 9) return false;
+    index = 0;
+    for(size_t i=0; i<length; i++){
+        if(term[i] < '0' || term[i] > '9') return false;
+        index = index * 10 + (term[i] - '0');
+    }
+    return true;
+}
+
+const Json::Value* JsonChild(const Json::Value& node,const char* term,size_t length){
+    const Json::Value* child;
+    Json::ArrayIndex index;
 
-    for(std::string term : query){
-        if(!node.isObject()){
-            throw QueryException("Query node must be an object: ",query,i);
+    if(node.isObject()){
+        child = &node[term];
+    }
+    else if(node.isArray() && parseIndex(term,length,index) && index < node.size()){
+        child = &node[index];
+    }
+    else{
+        return NULL;
+    }
+    return child->isNull() ? NULL : child;
+}
+
+// JsonChild for a token that isn't terminated
+static const Json::Value* findChild(const Json::Value& node,std::string_view term){
+    char buffer[64];
+
+    // object keys need terminating; long ones are rare enough to allocate
+    if(term.length() >= sizeof(buffer)){
+        return JsonChild(node,std::string(term));
+    }
+    memcpy(buffer,term.data(),term.length());
+    buffer[term.length()] = '\0';
+    return JsonChild(node,buffer,term.length());
+}
+
+const Json::Value* FindObject(const Json::Value& root,std::string_view path){
+    const Json::Value* node = &root;
+    size_t start = 0;
+    bool closed = false;
+
+    // same splitting as tokenizePath
+    for(size_t i=0; i<=path.length() && node != NULL; i++){
+        char ch = i < path.length() ? path[i] : '.';
+        if(ch == '.' || ch == '['){
+            if(!(closed && i == start) && !(ch == '[' && i == 0)){
+                node = findChild(*node,path.substr(start,i-start));
+            }
+            start = i + 1;
+            closed = false;
+        }
+        else if(ch == ']'){
+            node = findChild(*node,path.substr(start,i-start));
+            start = i + 1;
+            closed = true;
+        }
+    }
+    return node;
+}
+
+const Json::Value& QueryObject(const Json::Value& root,const TokenSet& query,size_t first){
+    const Json::Value* node = &root;
+
+    for(size_t i=first; i<query.size(); i++){
+        if(!node->isObject() && !node->isArray()){
+            throw QueryException("Query node must be an object or array: ",query,i);
         }
         // query this object to find our path element
-        Json::Value next = node[term];
-        if(next.isNull()){
+        node = JsonChild(*node,query[i]);
+        if(node == NULL){
             throw QueryException("Failed to find query element: ",query,i);
         }
-        node = next;
-        i++;
     }
-    return node;
+    return *node;
 }
 
 // overload of QueryObject that accepts a '.' delimited query expression
-Json::Value QueryObject(const Json::Value root,const std::string& query){
-    return QueryObject(root,tokenize(query,"."));
+const Json::Value& QueryObject(const Json::Value& root,const std::string& query){
+    return QueryObject(root,tokenizePath(query));
 }
 
 char hex_lookup[256] = {